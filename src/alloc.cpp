@@ -0,0 +1,142 @@
+#include "alloc.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+static
+void*
+MallocAlloc(void   *userData,
+            size_t  size)
+{
+  return malloc(size);
+}
+
+static
+void
+MallocFree(void *userData,
+           void *ptr)
+{
+  free(ptr);
+}
+
+static thread_local CompAllocator t_Allocator = {MallocAlloc, MallocFree, NULL};
+
+CompAllocator
+CurrentCompAllocator()
+{
+  return t_Allocator;
+}
+
+CompAllocator
+DefaultCompAllocator()
+{
+  return {MallocAlloc, MallocFree, NULL};
+}
+
+int
+SetCompAllocator(const CompAllocator *alloc)
+{
+  if(!alloc)
+    {
+      t_Allocator = DefaultCompAllocator();
+      return (0);
+    }
+
+  if(!alloc->ca_Alloc || !alloc->ca_Free)
+    return (COMP_ERR_BADPTR);
+
+  t_Allocator = *alloc;
+
+  return (0);
+}
+
+int
+GetCompAllocator(CompAllocator *alloc)
+{
+  if(!alloc)
+    return (COMP_ERR_BADPTR);
+
+  *alloc = t_Allocator;
+
+  return (0);
+}
+
+/*****************************************************************************/
+
+
+/* The start of each allocation is aligned rather than its offset so
+ * the region itself needn't be.
+ */
+static
+void*
+ArenaAlloc(void   *userData,
+           size_t  size)
+{
+  CompArena *arena;
+  uintptr_t  base;
+  uintptr_t  start;
+
+  arena = (CompArena*)userData;
+  base  = (uintptr_t)arena->ca_Base;
+  start = ((base + arena->ca_Used + (COMP_ARENA_ALIGN - 1)) & ~(uintptr_t)(COMP_ARENA_ALIGN - 1));
+
+  if((start - base) > arena->ca_Size)
+    return NULL;
+  if(size > (arena->ca_Size - (start - base)))
+    return NULL;
+
+  arena->ca_Used = ((start - base) + size);
+  if(arena->ca_Used > arena->ca_Peak)
+    arena->ca_Peak = arena->ca_Used;
+
+  return (void*)start;
+}
+
+static
+void
+ArenaFree(void *userData,
+          void *ptr)
+{
+}
+
+int
+InitCompArena(CompArena *arena,
+              void      *region,
+              size_t     size)
+{
+  if(!arena || (!region && size))
+    return (COMP_ERR_BADPTR);
+
+  arena->ca_Base = (uint8_t*)region;
+  arena->ca_Size = size;
+  arena->ca_Used = 0;
+  arena->ca_Peak = 0;
+
+  return (0);
+}
+
+int
+ResetCompArena(CompArena *arena)
+{
+  if(!arena)
+    return (COMP_ERR_BADPTR);
+
+  arena->ca_Used = 0;
+
+  return (0);
+}
+
+int
+CompArenaAllocator(CompArena     *arena,
+                   CompAllocator *alloc)
+{
+  if(!arena || !alloc)
+    return (COMP_ERR_BADPTR);
+
+  alloc->ca_Alloc    = ArenaAlloc;
+  alloc->ca_Free     = ArenaFree;
+  alloc->ca_UserData = (void*)arena;
+
+  return (0);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "api.hpp"
+#include "errors.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+COMP_EXTERN_C_BEGIN
+
+/*
+ * Allocation hooks for the memory the codec allocates itself: a
+ * context created without a work buffer, the optimal parser's buffer
+ * and the pipeline's ring. SetCompAllocator() sets them for the
+ * calling thread only, so worker threads can each have their own
+ * without locking; NULL restores malloc() and free(). A context keeps
+ * the hooks it was created with for everything it later allocates
+ * and frees, whichever thread that happens on. ca_Alloc returns NULL
+ * when it can't satisfy a request, which the codec reports as
+ * COMP_ERR_NOMEM. The memory needn't be zeroed or aligned to more
+ * than malloc() aligns to.
+ *
+ * SimpleCompress() keeps its context for the life of the thread so
+ * always uses malloc().
+ */
+typedef void* (*CompAllocFunc)(void *userData, size_t size);
+typedef void  (*CompFreeFunc)(void *userData, void *ptr);
+
+typedef struct CompAllocator
+{
+  CompAllocFunc  ca_Alloc;
+  CompFreeFunc   ca_Free;
+  void          *ca_UserData;
+} CompAllocator;
+
+COMP_API int SetCompAllocator(const CompAllocator *alloc);
+COMP_API int GetCompAllocator(CompAllocator *alloc);
+
+/*
+ * A bump allocator over a region the caller provides, for bounding
+ * the memory of a request and releasing it in bulk. CompArenaAllocator()
+ * fills in hooks that allocate from the arena; freeing through them
+ * does nothing and ResetCompArena() releases everything at once, so
+ * every context allocated from an arena must be deleted before it is
+ * reset. Allocations are aligned to COMP_ARENA_ALIGN bytes.
+ * ca_Peak is the most of the region used since InitCompArena().
+ * Without the alignment a compressor needs
+ * GetCompressorLevelMemorySize(), and another
+ * GetCompressorPipelineMemorySize() if pipelined, and a decompressor
+ * GetDecompressorWorkBufferSize().
+ */
+#define COMP_ARENA_ALIGN 64
+
+typedef struct CompArena
+{
+  uint8_t *ca_Base;
+  size_t   ca_Size;
+  size_t   ca_Used;
+  size_t   ca_Peak;
+} CompArena;
+
+COMP_API int InitCompArena(CompArena *arena, void *region, size_t size);
+COMP_API int ResetCompArena(CompArena *arena);
+COMP_API int CompArenaAllocator(CompArena *arena, CompAllocator *alloc);
+
+COMP_EXTERN_C_END
+
+#ifdef __cplusplus
+/* For the codec's own use, not exported */
+CompAllocator CurrentCompAllocator();
+CompAllocator DefaultCompAllocator();
+
+static
+inline
+void*
+CompAlloc(const CompAllocator *alloc,
+          size_t               size)
+{
+  return (*alloc->ca_Alloc)(alloc->ca_UserData, size);
+}
+
+static
+inline
+void
+CompFree(const CompAllocator *alloc,
+         void                *ptr)
+{
+  if(ptr)
+    (*alloc->ca_Free)(alloc->ca_UserData, ptr);
+}
+#endif
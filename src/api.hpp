@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * Linkage of the codec's public functions, those declared in
+ * compress.hpp, decompress.hpp and alloc.hpp, which are what lib3ct
+ * exports. They have C linkage so the library can be used from C or
+ * through an FFI and its symbols don't depend on the C++ compiler that
+ * built it, and those headers only use C outside of __cplusplus. The
+ * library is built with hidden visibility so COMP_API marks the only
+ * symbols it exports.
+ */
+#ifdef __cplusplus
+#define COMP_EXTERN_C_BEGIN extern "C" {
+#define COMP_EXTERN_C_END   }
+#else
+#define COMP_EXTERN_C_BEGIN
+#define COMP_EXTERN_C_END
+#endif
+
+#if defined(_WIN32)
+#define COMP_API
+#else
+#define COMP_API __attribute__((visibility("default")))
+#endif
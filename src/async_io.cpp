@@ -0,0 +1,241 @@
+#include "async_io.hpp"
+
+#include "fmt.hpp"
+
+#include <errno.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+FilePrefetcher::FilePrefetcher(std::vector<fs::path> const &paths_,
+                               unsigned                     threads_,
+                               unsigned                     depth_,
+                               std::size_t                  max_size_)
+  : _paths(paths_),
+    _depth(depth_ ? depth_ : 1),
+    _max_size(max_size_),
+    _next_read(0),
+    _handed_out(0),
+    _in_flight(0),
+    _stop(false)
+{
+  for(unsigned i = 0; i < (threads_ ? threads_ : 1); i++)
+    _threads.emplace_back(&FilePrefetcher::run,this);
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _stop = true;
+  }
+  _space_cv.notify_all();
+
+  for(auto &t : _threads)
+    t.join();
+}
+
+bool
+FilePrefetcher::next(File &file_)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+
+  _ready_cv.wait(guard,[this]{ return (!_ready.empty() || (_handed_out == _paths.size())); });
+  if(_ready.empty())
+    return false;
+
+  file_ = std::move(_ready.front());
+  _ready.pop_front();
+  _handed_out++;
+
+  // Wake the other consumers so they see there is nothing left
+  if(_handed_out == _paths.size())
+    _ready_cv.notify_all();
+
+  return true;
+}
+
+void
+FilePrefetcher::release()
+{
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _in_flight--;
+  }
+  _space_cv.notify_one();
+}
+
+void
+FilePrefetcher::run()
+{
+  File file;
+
+  while(true)
+    {
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+
+        _space_cv.wait(guard,[this]{ return (_stop ||
+                                             (_next_read == _paths.size()) ||
+                                             (_in_flight < _depth)); });
+        if(_stop || (_next_read == _paths.size()))
+          return;
+
+        file = File();
+        file.index = _next_read++;
+        _in_flight++;
+      }
+
+      load(file);
+
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _ready.push_back(std::move(file));
+      }
+      _ready_cv.notify_one();
+    }
+}
+
+void
+FilePrefetcher::load(File &file_)
+{
+  FILE *f;
+  std::size_t size;
+  std::error_code ec;
+  fs::path const &path = _paths[file_.index];
+
+  if(!fs::is_regular_file(path,ec))
+    {
+      file_.error = fmt::format("ERROR: {} is not a regular file",path);
+      return;
+    }
+
+  size = fs::file_size(path,ec);
+  if(ec)
+    {
+      file_.error = fmt::format("ERROR: failed to stat {} - {}",path,ec.message());
+      return;
+    }
+
+  if(size > _max_size)
+    {
+      file_.streamed = true;
+      return;
+    }
+
+  f = fopen(path.string().c_str(),"rb");
+  if(f == NULL)
+    {
+      file_.error = fmt::format("ERROR: failed to open {} - {}",path,strerror(errno));
+      return;
+    }
+
+  file_.data.resize(size);
+  if(fread(file_.data.data(),1,size,f) != size)
+    file_.error = fmt::format("ERROR: failed to read {} - {}",path,strerror(errno));
+
+  fclose(f);
+}
+
+FileWriter::FileWriter(unsigned        threads_,
+                       unsigned        depth_,
+                       DoneFunc const &done_)
+  : _depth(depth_ ? depth_ : 1),
+    _done(done_),
+    _pending(0),
+    _closing(false)
+{
+  for(unsigned i = 0; i < (threads_ ? threads_ : 1); i++)
+    _threads.emplace_back(&FileWriter::run,this);
+}
+
+FileWriter::~FileWriter()
+{
+  finish();
+}
+
+void
+FileWriter::submit(std::size_t             index_,
+                   fs::path const         &path_,
+                   std::vector<uint32_t> &&words_)
+{
+  {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    _space_cv.wait(guard,[this]{ return (_pending < _depth); });
+    _queue.push_back(Job{index_,path_,std::move(words_)});
+    _pending++;
+  }
+  _queue_cv.notify_one();
+}
+
+void
+FileWriter::finish()
+{
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _closing = true;
+  }
+  _queue_cv.notify_all();
+
+  for(auto &t : _threads)
+    {
+      if(t.joinable())
+        t.join();
+    }
+}
+
+void
+FileWriter::run()
+{
+  Job job;
+
+  while(true)
+    {
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+
+        _queue_cv.wait(guard,[this]{ return (_closing || !_queue.empty()); });
+        if(_queue.empty())
+          return;
+
+        job = std::move(_queue.front());
+        _queue.pop_front();
+      }
+
+      write(job);
+
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pending--;
+      }
+      _space_cv.notify_one();
+    }
+}
+
+void
+FileWriter::write(Job const &job_)
+{
+  FILE *f;
+  std::size_t size;
+  std::string error;
+
+  size = (job_.words.size() * sizeof(uint32_t));
+
+  f = fopen(job_.path.string().c_str(),"wb");
+  if(f == NULL)
+    {
+      error = fmt::format("ERROR: failed to open {} - {}",job_.path,strerror(errno));
+    }
+  else
+    {
+      if(fwrite(job_.words.data(),1,size,f) != size)
+        error = fmt::format("ERROR: failed to write {} - {}",job_.path,strerror(errno));
+      if((fclose(f) != 0) && error.empty())
+        error = fmt::format("ERROR: failed to write {} - {}",job_.path,strerror(errno));
+    }
+
+  _done(job_.index,error);
+}
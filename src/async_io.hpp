@@ -0,0 +1,117 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Whole file reads and writes on dedicated I/O threads so the threads
+ * doing the compression never wait on the disk.
+ *
+ * FilePrefetcher reads the given files in order, at most depth of
+ * them ahead of the consumers. next() hands out files as they finish
+ * loading, which may be slightly out of order; release() must be
+ * called once a file's data is no longer needed to make room for the
+ * next one. Files larger than max_size aren't read, they are handed
+ * out with streamed set so the consumer can stream them itself. A
+ * read error is reported in the file's error string.
+ *
+ * FileWriter writes buffers submitted by the consumers and calls done
+ * for each once it is on disk, with an empty error on success. At
+ * most depth buffers are queued; submit() blocks while it is full.
+ * finish() waits for everything queued to be written.
+ */
+class FilePrefetcher
+{
+public:
+  struct File
+  {
+    std::size_t          index    = 0;
+    bool                 streamed = false;
+    std::vector<uint8_t> data;
+    std::string          error;
+  };
+
+public:
+  FilePrefetcher(std::vector<std::filesystem::path> const &paths,
+                 unsigned                                  threads,
+                 unsigned                                  depth,
+                 std::size_t                               max_size);
+  ~FilePrefetcher();
+
+  FilePrefetcher(const FilePrefetcher&) = delete;
+  FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+public:
+  bool next(File &file);
+  void release();
+
+private:
+  void run();
+  void load(File &file);
+
+private:
+  std::vector<std::filesystem::path> const &_paths;
+  unsigned                                  _depth;
+  std::size_t                               _max_size;
+  std::size_t                               _next_read;
+  std::size_t                               _handed_out;
+  unsigned                                  _in_flight;
+  bool                                      _stop;
+  std::deque<File>                          _ready;
+  std::mutex                                _lock;
+  std::condition_variable                   _ready_cv;
+  std::condition_variable                   _space_cv;
+  std::vector<std::thread>                  _threads;
+};
+
+class FileWriter
+{
+public:
+  typedef std::function<void(std::size_t index, std::string const &error)> DoneFunc;
+
+public:
+  FileWriter(unsigned        threads,
+             unsigned        depth,
+             DoneFunc const &done);
+  ~FileWriter();
+
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+public:
+  void submit(std::size_t                   index,
+              std::filesystem::path const  &path,
+              std::vector<uint32_t>       &&words);
+  void finish();
+
+private:
+  struct Job
+  {
+    std::size_t           index;
+    std::filesystem::path path;
+    std::vector<uint32_t> words;
+  };
+
+private:
+  void run();
+  void write(Job const &job);
+
+private:
+  unsigned                 _depth;
+  DoneFunc                 _done;
+  unsigned                 _pending;
+  bool                     _closing;
+  std::deque<Job>          _queue;
+  std::mutex               _lock;
+  std::condition_variable  _queue_cv;
+  std::condition_variable  _space_cv;
+  std::vector<std::thread> _threads;
+};
@@ -0,0 +1,79 @@
+#include "buffered_writer.hpp"
+
+#include "fmt.hpp"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+
+BufferedWriter::BufferedWriter(FILE        *f_,
+                               std::size_t  bufsize_)
+  : _f(f_),
+    _buf(std::max(bufsize_,sizeof(uint32_t))),
+    _len(0),
+    _written(0)
+{
+}
+
+BufferedWriter::~BufferedWriter()
+{
+  if(_len)
+    fwrite(_buf.data(),1,_len,_f);
+}
+
+void
+BufferedWriter::write(const void  *data_,
+                      std::size_t  size_)
+{
+  const uint8_t *data = (const uint8_t*)data_;
+
+  _written += size_;
+  if(size_ >= _buf.size())
+    {
+      flush();
+      if(fwrite(data,1,size_,_f) != size_)
+        throw fmt::exception("ERROR: failed to write - {}",strerror(errno));
+      return;
+    }
+
+  if((_len + size_) > _buf.size())
+    flush();
+
+  memcpy(&_buf[_len],data,size_);
+  _len += size_;
+}
+
+void
+BufferedWriter::flush()
+{
+  if(_len == 0)
+    return;
+
+  if(fwrite(_buf.data(),1,_len,_f) != _len)
+    throw fmt::exception("ERROR: failed to write - {}",strerror(errno));
+
+  _len = 0;
+}
+
+void
+BufferedWriter::write_word(void     *bw_,
+                           uint32_t  word_)
+{
+  BufferedWriter *bw = (BufferedWriter*)bw_;
+
+  if((bw->_len + sizeof(word_)) > bw->_buf.size())
+    bw->flush();
+
+  memcpy(&bw->_buf[bw->_len],&word_,sizeof(word_));
+  bw->_len     += sizeof(word_);
+  bw->_written += sizeof(word_);
+}
+
+void
+BufferedWriter::write_span(void           *bw_,
+                           const uint32_t *words_,
+                           std::size_t     num_words_)
+{
+  ((BufferedWriter*)bw_)->write(words_,num_words_ * sizeof(uint32_t));
+}
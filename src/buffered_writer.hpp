@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*
+ * Accumulates output in memory and hands it to stdio in large blocks
+ * rather than one fwrite() per word. write_word() and write_span()
+ * match the CompFunc and CompSpanFunc signatures so a BufferedWriter
+ * can be passed directly as the userdata of a compressor or
+ * decompressor.
+ */
+class BufferedWriter
+{
+public:
+  BufferedWriter(FILE        *f,
+                 std::size_t  bufsize);
+  ~BufferedWriter();
+
+public:
+  void write(const void  *data,
+             std::size_t  size);
+  void flush();
+
+  // Total bytes written so far, including those still buffered
+  std::size_t written() const { return _written; }
+
+public:
+  static void write_word(void     *bw,
+                         uint32_t  word);
+  static void write_span(void           *bw,
+                         const uint32_t *words,
+                         std::size_t     num_words);
+
+private:
+  FILE                 *_f;
+  std::vector<uint8_t>  _buf;
+  std::size_t           _len;
+  std::size_t           _written;
+};
@@ -20,6 +20,7 @@
 
 #include "endian.hpp"
 
+#include <cstddef>
 #include <cstdint>
 #include <type_traits>
 
@@ -82,6 +83,23 @@ byteswap(const uint32_t v_)
           ((v_ & UINT32_C(0xFF000000)) >> 24));
 }
 
+static
+inline
+uint64_t
+byteswap(const uint64_t v_)
+{
+  return (((uint64_t)byteswap((uint32_t)(v_ & UINT64_C(0xFFFFFFFF))) << 32) |
+          ((uint64_t)byteswap((uint32_t)(v_ >> 32))));
+}
+
+static
+inline
+int64_t
+byteswap(const int64_t v_)
+{
+  return (int64_t)byteswap((uint64_t)v_);
+}
+
 template<typename T>
 static
 inline
@@ -121,3 +139,19 @@ byteswap_if_big_endian(const T v_)
 {
   *v_ = byteswap_if_big_endian(*v_);
 }
+
+/* A whole span in place. The loop is left simple for the compiler to
+ * turn into vector shuffles instead of one swap per word.
+ */
+static
+inline
+void
+byteswap_span_if_little_endian(uint32_t          *words_,
+                               const std::size_t  count_)
+{
+  if(!is_little_endian())
+    return;
+
+  for(std::size_t i = 0; i < count_; i++)
+    words_[i] = byteswap(words_[i]);
+}
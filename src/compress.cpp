@@ -1,12 +1,21 @@
+#include "alloc.hpp"
 #include "byteswap.hpp"
+#include "compress.hpp"
 #include "errors.hpp"
 #include "lzss.h"
+#include "lzss.hpp"
 #include "types.hpp"
 
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
 
 /*****************************************************************************/
 
@@ -26,42 +35,135 @@
 /*****************************************************************************/
 
 /*
- * The tree[] structure contains the binary tree of all of the strings in the
- * window sorted in order.
+ * The SDK's format. The binary tree match finder, the encode loop and
+ * the bit stream come from the generic codec in lzss.hpp; the hash
+ * chain and optimal parser below are written for these widths only.
  */
-struct CompNode
+typedef Lzss<INDEX_BIT_COUNT,LENGTH_BIT_COUNT,BREAK_EVEN> Sdk;
+
+static_assert(Sdk::WindowSize == WINDOW_SIZE, "lzss.h and Sdk disagree");
+static_assert(Sdk::LookAheadSize == LOOK_AHEAD_SIZE, "lzss.h and Sdk disagree");
+static_assert(Sdk::TreeRoot == TREE_ROOT, "lzss.h and Sdk disagree");
+static_assert(Sdk::DictionarySize == COMP_DICTIONARY_SIZE, "types.hpp and Sdk disagree");
+
+/*
+ * The hash chain match finder used by the faster compression levels.
+ * hc_Head[] holds the most recent window position whose first
+ * HASH_STRING_LEN bytes hash to a given value and hc_Prev[] links each
+ * position to the previous one with the same hash. Stale links are
+ * never removed; the search simply stops once the distances stop
+ * increasing or leave the usable part of the window.
+ */
+#define HASH_BITS        12
+#define HASH_SIZE        (1 << HASH_BITS)
+#define HASH_STRING_LEN  3
+#define MAX_DISTANCE     (WINDOW_SIZE - LOOK_AHEAD_SIZE)
+#define FAST_CHAIN_DEPTH 16
+#define LAZY_CHAIN_DEPTH 32
+
+struct HashChain
 {
-  uint32_t cn_Parent;
-  uint32_t cn_LeftChild;
-  uint32_t cn_RightChild;
+  uint16_t hc_Head[HASH_SIZE];
+  uint16_t hc_Prev[WINDOW_SIZE];
 };
 
-typedef void (*CompFuncClone)(void *userData, uint32_t word);
+/*
+ * State for the optimal parser. Input is collected into op_Buffer
+ * behind up to WINDOW_SIZE bytes of history from the previous block.
+ * Once OPT_BLOCK_SIZE new bytes are available the longest match at
+ * every position is found and a shortest path over the token costs
+ * picks the cheapest sequence of literals and phrases for the block.
+ * The last OPT_LOOK_AHEAD bytes of a block are parsed but not emitted;
+ * they are carried over to the next block so that the parse doesn't
+ * have to end on a block boundary.
+ */
+#define OPT_BLOCK_SIZE   (64 * 1024)
+#define OPT_LOOK_AHEAD   (4 * 1024)
+#define OPT_BUFFER_SIZE  (WINDOW_SIZE + OPT_BLOCK_SIZE)
+#define LITERAL_BITS     (1 + 8)
+#define PHRASE_BITS      (1 + INDEX_BIT_COUNT + LENGTH_BIT_COUNT)
 
-typedef struct CompressBitStream
+struct OptimalParser
 {
-  CompFuncClone  bs_OutputWord;
-  void          *bs_UserData;
-  uint32_t       bs_BitsLeft;
-  uint32_t       bs_BitBuffer;
-} CompressBitStream;
+  uint64_t  op_Base;
+  uint32_t  op_History;
+  uint32_t  op_Length;
+  int32_t   op_Head[HASH_SIZE];
+  int32_t   op_Prev[OPT_BUFFER_SIZE];
+  uint32_t  op_Cost[OPT_BLOCK_SIZE + 1];
+  uint16_t  op_Dist[OPT_BLOCK_SIZE];
+  uint8_t   op_Len[OPT_BLOCK_SIZE];
+  uint8_t   op_Choice[OPT_BLOCK_SIZE];
+  uint8_t   op_Buffer[OPT_BUFFER_SIZE];
+};
+
+/*
+ * State for the pipelined mode, see SetCompressorPipelined(). The
+ * thread feeding the compressor finds the tokens and a second thread
+ * packs them into words and hands those to the output callback. Each
+ * token is passed as the arguments WriteBits() would have been given:
+ * the flag bit in bit 31, the number of code bits in bits 24 to 30
+ * and the code below them.
+ *
+ * The ring has a single producer and a single consumer so each side
+ * only writes its own index. The producer publishes PIPE_BATCH_SIZE
+ * tokens at a time, and at the end of each feed. Either side sleeps
+ * only when the ring is empty or full. It sets its cp_*Waiting flag
+ * under cp_Lock before checking the ring one last time. The other
+ * side checks that flag after moving its index, so one of the two
+ * always sees the other's update.
+ *
+ * An exception thrown by the output callback is kept in cp_Error. The
+ * packer then discards tokens until stopped, and the feeding thread
+ * rethrows the exception.
+ */
+#define PIPE_RING_SIZE  (64 * 1024)
+#define PIPE_BATCH_SIZE 1024
 
+struct CompPipeline
+{
+  uint32_t                cp_Ring[PIPE_RING_SIZE];
+  alignas(64)
+  std::atomic<uint32_t>   cp_Head;
+  alignas(64)
+  std::atomic<uint32_t>   cp_Tail;
+  uint32_t                cp_Next;
+  uint32_t                cp_Limit;
+  std::atomic<bool>       cp_ProducerWaiting;
+  std::atomic<bool>       cp_ConsumerWaiting;
+  std::atomic<bool>       cp_Stop;
+  std::atomic<bool>       cp_Failed;
+  std::mutex              cp_Lock;
+  std::condition_variable cp_Wake;
+  std::exception_ptr      cp_Error;
+  std::thread             cp_Thread;
+};
 
 /*****************************************************************************/
 
 
 typedef struct Compressor
 {
-  unsigned char      ch_Window[WINDOW_SIZE];
-  CompNode           ch_Tree[WINDOW_SIZE + 1];
-  int32_t            ch_LookAhead;
-  int32_t            ch_MatchLen;
-  uint32_t           ch_MatchPos;
-  uint32_t           ch_CurrentPos;
-  uint32_t           ch_ReplaceCnt;
+  unsigned char      ch_Window[Sdk::WindowMirrorSize];
+  union
+  {
+    Sdk::Tree        ch_Tree;
+    HashChain        ch_Hash;
+  };
+  int32_t            ch_Level;
+  uint32_t           ch_ChainDepth;
+  uint32_t           ch_DictSize;
+  Sdk::EncodeState   ch_State;
   CompressBitStream  ch_BitStream;
-  bool               ch_SecondPass;
+  OptimalParser     *ch_Optimal;
+  CompPipeline      *ch_Pipeline;
+  CompressorStats   *ch_Stats;
+  uint64_t           ch_Fed;
+  bool               ch_Piping;
+  bool               ch_Finished;
   bool               ch_AllocatedStructure;
+  CompAllocator      ch_Allocator;
+  void              *ch_PipelineBlock;
   void              *ch_Cookie;
 } Compressor;
 
@@ -72,220 +174,448 @@ typedef void *Decompressor;
 
 /*****************************************************************************/
 
-/* This is where most of the encoder's work is done. This routine is
- * responsible for adding the new node to the binary tree. It also has to
- * find the best match among all the existing nodes in the tree, and return
- * that to the calling routine. To make matters even more complicated, if
- * the newNode has a duplicate in the tree, the oldNode is deleted, for
- * reasons of efficiency.
- */
-
 static
+inline
 uint32_t
-AddString(CompNode      *tree,
-          unsigned char *window,
-          uint32_t       newNode,
-          uint32_t      *matchPos)
-{
-  uint32_t  i;
-  uint32_t  testNode;
-  uint32_t  parentNode;
-  int32_t   delta;
-  uint32_t  matchLen;
-  CompNode *node;
-  CompNode *parent;
-  CompNode *test;
+HashString(const unsigned char *window,
+           uint32_t             pos)
+{
+  uint32_t v;
+
+  v = ((window[pos] << 16) |
+       (window[pos + 1] << 8) |
+       (window[pos + 2]));
+
+  return ((v * UINT32_C(2654435761)) >> (32 - HASH_BITS));
+}
 
+/* The hash chain equivalent of Sdk::add_string(). The new node is linked
+ * into the chain for its hash and at most maxDepth earlier positions
+ * on that chain are compared against it. Unlike the tree, nothing has
+ * to be deleted when a position falls out of the window.
+ */
+static
+uint32_t
+AddStringHash(HashChain     *hc,
+              unsigned char *window,
+              uint32_t       newNode,
+              uint32_t      *matchPos,
+              uint32_t       maxDepth,
+              uint32_t      *visited)
+{
+  uint32_t i;
+  uint32_t h;
+  uint32_t testNode;
+  uint32_t dist;
+  uint32_t lastDist;
+  uint32_t matchLen;
+  uint32_t nodes;
+
+  *visited = 0;
   if(newNode == END_OF_STREAM)
     return (0);
 
-  testNode = tree[TREE_ROOT].cn_RightChild;
-  node     = &tree[newNode];
-  matchLen = 0;
+  h        = HashString(window, newNode);
+  testNode = hc->hc_Head[h];
+
+  hc->hc_Prev[newNode] = testNode;
+  hc->hc_Head[h]       = newNode;
 
-  while(true)
+  matchLen = 0;
+  lastDist = 0;
+  nodes    = 0;
+  while(maxDepth-- && (testNode != UNUSED))
     {
-      for(i = 0; i < LOOK_AHEAD_SIZE; i++)
+      nodes++;
+      dist = MOD_WINDOW(newNode - testNode);
+      if((dist <= lastDist) || (dist > MAX_DISTANCE))
+        break;
+      lastDist = dist;
+
+      /* Cheap rejection of candidates that can't beat the current match */
+      if(window[newNode + matchLen] != window[testNode + matchLen])
         {
-          delta = window[MOD_WINDOW(newNode + i)] - window[MOD_WINDOW(testNode + i)];
-          if(delta)
-            break;
+          testNode = hc->hc_Prev[testNode];
+          continue;
         }
 
-      test = &tree[testNode];
+      i = Sdk::match_length(&window[newNode], &window[testNode]);
 
-      if(i >= matchLen)
+      if(i > matchLen)
         {
           matchLen  = i;
           *matchPos = testNode;
           if(matchLen >= LOOK_AHEAD_SIZE)
-            {
-              parentNode = test->cn_Parent;
-              parent = &tree[parentNode];
+            break;
+        }
 
-              if(parent->cn_LeftChild == testNode)
-                parent->cn_LeftChild = newNode;
-              else
-                parent->cn_RightChild = newNode;
+      testNode = hc->hc_Prev[testNode];
+    }
 
-              *node                               = *test;
-              tree[node->cn_LeftChild].cn_Parent  = newNode;
-              tree[node->cn_RightChild].cn_Parent = newNode;
-              test->cn_Parent                     = UNUSED;
+  *visited = nodes;
+  return (matchLen);
+}
 
-              return (matchLen);
-            }
-        }
+/* Route the match finding calls to the engine selected by the
+ * compression level. The binary tree is the SDK's engine and the only
+ * one whose output is byte identical to comp3do.
+ */
+static
+inline
+uint32_t
+FindMatch(Compressor *comp,
+          uint32_t    newNode,
+          uint32_t   *matchPos)
+{
+  uint32_t matchLen;
+  uint32_t visited;
 
-      if(delta >= 0)
-        {
-          if(test->cn_RightChild == UNUSED)
-            {
-              test->cn_RightChild = newNode;
-              node->cn_Parent     = testNode;
-              node->cn_LeftChild  = UNUSED;
-              node->cn_RightChild = UNUSED;
-              return (matchLen);
-            }
-          testNode = test->cn_RightChild;
-        }
-      else
-        {
-          if(test->cn_LeftChild == UNUSED)
-            {
-              test->cn_LeftChild  = newNode;
-              node->cn_Parent     = testNode;
-              node->cn_LeftChild  = UNUSED;
-              node->cn_RightChild = UNUSED;
-              return (matchLen);
-            }
-          testNode = test->cn_LeftChild;
-        }
+  if(comp->ch_Level == COMP_LEVEL_SDK)
+    matchLen = Sdk::add_string(&comp->ch_Tree, comp->ch_Window, newNode, matchPos,
+                               &visited);
+  else
+    matchLen = AddStringHash(&comp->ch_Hash, comp->ch_Window, newNode, matchPos,
+                             comp->ch_ChainDepth, &visited);
+
+  if(comp->ch_Stats)
+    {
+      comp->ch_Stats->cs_Searches++;
+      comp->ch_Stats->cs_NodesVisited += visited;
     }
+
+  return (matchLen);
+}
+
+static
+inline
+void
+RemoveString(Compressor *comp,
+             uint32_t    node)
+{
+  if(comp->ch_Level != COMP_LEVEL_SDK)
+    return;
+
+  if(Sdk::delete_string(&comp->ch_Tree, node) && comp->ch_Stats)
+    comp->ch_Stats->cs_Deletions++;
+}
+
+static
+inline
+uint32_t
+OffsetBucket(uint32_t dist)
+{
+  uint32_t bucket;
+
+  for(bucket = 0; dist >>= 1; bucket++)
+    ;
+
+  return (bucket);
 }
 
+/*****************************************************************************/
+
+
 static
 void
-InitBitStream(CompressBitStream *bs,
-              CompFuncClone      cf,
-              void              *userData)
+PipeWake(CompPipeline      *cp,
+         std::atomic<bool> &waiting)
 {
-  bs->bs_OutputWord = cf;
-  bs->bs_UserData   = userData;
-  bs->bs_BitsLeft   = 32;
-  bs->bs_BitBuffer  = 0;
+  if(waiting.load())
+    {
+      std::lock_guard<std::mutex> guard(cp->cp_Lock);
+      cp->cp_Wake.notify_all();
+    }
 }
 
 static
 void
-CleanupBitStream(CompressBitStream *bs)
+PipePublish(CompPipeline *cp)
 {
-  if(bs->bs_BitsLeft != 32)
-    (*bs->bs_OutputWord)(bs->bs_UserData,
-                         ::byteswap_if_little_endian(bs->bs_BitBuffer));
+  cp->cp_Tail.store(cp->cp_Next);
+  PipeWake(cp, cp->cp_ConsumerWaiting);
 }
 
-/* This routine outputs a single header bit, followed by numBits of code */
 static
 void
-WriteBits(CompressBitStream *bs,
-          uint32_t           headBit,
-          uint32_t           code,
-          uint32_t           numBits)
+PipeWaitForSpace(CompPipeline *cp)
 {
-  bs->bs_BitsLeft--;
-  bs->bs_BitBuffer |= (headBit << bs->bs_BitsLeft);
+  PipePublish(cp);
 
-  if(numBits >= bs->bs_BitsLeft)
-    {
-      numBits         -= bs->bs_BitsLeft;
-      (*bs->bs_OutputWord)(bs->bs_UserData,
-                           byteswap_if_little_endian(((code >> numBits) | bs->bs_BitBuffer)));
-      bs->bs_BitsLeft  = 32 - numBits;
+  std::unique_lock<std::mutex> lock(cp->cp_Lock);
 
-      if(!numBits)
-        bs->bs_BitBuffer = 0;
-      else
-        bs->bs_BitBuffer = (code << bs->bs_BitsLeft);
-    }
-  else
+  cp->cp_ProducerWaiting.store(true);
+  while((cp->cp_Next - cp->cp_Head.load()) == PIPE_RING_SIZE)
+    cp->cp_Wake.wait(lock);
+  cp->cp_ProducerWaiting.store(false);
+
+  cp->cp_Limit = (cp->cp_Head.load() + PIPE_RING_SIZE);
+}
+
+static
+inline
+void
+PipePush(CompPipeline *cp,
+         uint32_t      token)
+{
+  if(cp->cp_Next == cp->cp_Limit)
     {
-      bs->bs_BitsLeft  -= numBits;
-      bs->bs_BitBuffer |= (code << bs->bs_BitsLeft);
+      cp->cp_Limit = (cp->cp_Head.load(std::memory_order_acquire) + PIPE_RING_SIZE);
+      if(cp->cp_Next == cp->cp_Limit)
+        PipeWaitForSpace(cp);
     }
+
+  cp->cp_Ring[cp->cp_Next++ & (PIPE_RING_SIZE - 1)] = token;
+
+  if(!(cp->cp_Next & (PIPE_BATCH_SIZE - 1)))
+    PipePublish(cp);
 }
 
-/* This routine performs a classic binary tree deletion.
- * If the node to be deleted has a null link in either direction, we
- * just pull the non-null link up one to replace the existing link.
- * If both links exist, we instead delete the next link in order, which
- * is guaranteed to have a null link, then replace the node to be deleted
- * with the next link.
- */
+/* The packer. Whatever is complete is delivered before it sleeps. */
 static
 void
-DeleteString(CompNode *tree,
-             uint32_t  node)
+PipeRun(Compressor *comp)
 {
-  uint32_t parent;
-  uint32_t newNode;
-  uint32_t next;
+  uint32_t           head;
+  uint32_t           tail;
+  uint32_t           token;
+  CompPipeline      *cp;
+  CompressBitStream *bs;
+
+  cp   = comp->ch_Pipeline;
+  bs   = &comp->ch_BitStream;
+  head = cp->cp_Head.load();
 
-  parent = tree[node].cn_Parent;
-  if(parent != UNUSED)
+  for(;;)
     {
-      if(tree[node].cn_LeftChild == UNUSED)
+      tail = cp->cp_Tail.load(std::memory_order_acquire);
+      if(head == tail)
         {
-          newNode                 = tree[node].cn_RightChild;
-          tree[newNode].cn_Parent = parent;
-        }
-      else if(tree[node].cn_RightChild == UNUSED)
-        {
-          newNode                 = tree[node].cn_LeftChild;
-          tree[newNode].cn_Parent = parent;
+          if(!cp->cp_Failed.load())
+            {
+              try
+                {
+                  FlushBitStream(bs);
+                }
+              catch(...)
+                {
+                  cp->cp_Error = std::current_exception();
+                  cp->cp_Failed.store(true);
+                }
+            }
+
+          std::unique_lock<std::mutex> lock(cp->cp_Lock);
+
+          cp->cp_ConsumerWaiting.store(true);
+          while((cp->cp_Tail.load() == head) && !cp->cp_Stop.load())
+            cp->cp_Wake.wait(lock);
+          cp->cp_ConsumerWaiting.store(false);
+
+          if(cp->cp_Tail.load() == head)
+            break;
+          continue;
         }
-      else
+
+      if(!cp->cp_Failed.load())
         {
-          newNode = tree[node].cn_LeftChild;
-          next    = tree[newNode].cn_RightChild;
-          if(next != UNUSED)
+          try
             {
-              do
+              for(; head != tail; head++)
                 {
-                  newNode = next;
-                  next    = tree[newNode].cn_RightChild;
+                  token = cp->cp_Ring[head & (PIPE_RING_SIZE - 1)];
+                  WriteBits(bs, (token >> 31), (token & 0xFFFFFF), ((token >> 24) & 0x7F));
                 }
-              while(next != UNUSED);
-
-              tree[tree[newNode].cn_Parent].cn_RightChild = UNUSED;
-              tree[newNode].cn_Parent                     = tree[node].cn_Parent;
-              tree[newNode].cn_LeftChild                  = tree[node].cn_LeftChild;
-              tree[newNode].cn_RightChild                 = tree[node].cn_RightChild;
-              tree[tree[newNode].cn_LeftChild].cn_Parent  = newNode;
-              tree[tree[newNode].cn_RightChild].cn_Parent = newNode;
             }
-          else
+          catch(...)
             {
-              tree[newNode].cn_Parent                     = parent;
-              tree[newNode].cn_RightChild                 = tree[node].cn_RightChild;
-              tree[tree[newNode].cn_RightChild].cn_Parent = newNode;
+              cp->cp_Error = std::current_exception();
+              cp->cp_Failed.store(true);
             }
         }
 
-      if(tree[parent].cn_LeftChild == node)
-        tree[parent].cn_LeftChild = newNode;
-      else
-        tree[parent].cn_RightChild = newNode;
+      /* Sequentially consistent, as cp_Tail's store in PipePublish(),
+       * so the load of cp_ProducerWaiting can't pass it
+       */
+      head = tail;
+      cp->cp_Head.store(head);
+      PipeWake(cp, cp->cp_ProducerWaiting);
+    }
+}
+
+/* Falls back to packing on the calling thread if no thread can be had */
+static
+void
+PipeStart(Compressor *comp)
+{
+  CompPipeline *cp;
+
+  cp = comp->ch_Pipeline;
+  cp->cp_Head.store(0);
+  cp->cp_Tail.store(0);
+  cp->cp_Next  = 0;
+  cp->cp_Limit = PIPE_RING_SIZE;
+  cp->cp_ProducerWaiting.store(false);
+  cp->cp_ConsumerWaiting.store(false);
+  cp->cp_Stop.store(false);
+  cp->cp_Failed.store(false);
+  cp->cp_Error = nullptr;
+
+  try
+    {
+      cp->cp_Thread = std::thread(PipeRun, comp);
+      comp->ch_Piping = true;
+    }
+  catch(const std::system_error &)
+    {
+      comp->ch_Piping = false;
+    }
+}
+
+/* Waits for every queued token to be packed and delivered and
+ * returns any exception the output callback threw.
+ */
+static
+std::exception_ptr
+PipeStop(Compressor *comp)
+{
+  CompPipeline       *cp;
+  std::exception_ptr  error;
+
+  cp = comp->ch_Pipeline;
+
+  PipePublish(cp);
+  {
+    std::lock_guard<std::mutex> guard(cp->cp_Lock);
+    cp->cp_Stop.store(true);
+    cp->cp_Wake.notify_all();
+  }
+  cp->cp_Thread.join();
+  comp->ch_Piping = false;
+
+  error = cp->cp_Error;
+  cp->cp_Error = nullptr;
+
+  return error;
+}
+
+/* Every token goes through here, to the bit stream or the packer */
+static
+inline
+void
+EmitBits(Compressor *comp,
+         uint32_t    headBit,
+         uint32_t    code,
+         uint32_t    numBits)
+{
+  if(comp->ch_Piping)
+    PipePush(comp->ch_Pipeline, ((headBit << 31) | (numBits << 24) | code));
+  else
+    WriteBits(&comp->ch_BitStream, headBit, code, numBits);
+}
+
+static
+inline
+void
+CountLiteral(CompressorStats *stats)
+{
+  if(stats)
+    stats->cs_Literals++;
+}
+
+/* A distance of 0 is a full window back */
+static
+inline
+void
+CountPhrase(CompressorStats *stats,
+            uint32_t         len,
+            uint32_t         dist)
+{
+  if(!stats)
+    return;
+
+  stats->cs_Phrases++;
+  stats->cs_PhraseLengths[len]++;
+  stats->cs_PhraseOffsets[OffsetBucket(dist ? dist : WINDOW_SIZE)]++;
+}
 
-      tree[node].cn_Parent = UNUSED;
+/* Position 1 is made the root of the tree when the compressor is
+ * created. The hash chain needs the first bytes of the string to be
+ * present so it is linked in once the look ahead buffer is loaded.
+ * So are the strings of a preset dictionary, oldest first, as the
+ * last of them run on into the look ahead. Position 0 is skipped as
+ * its index is the end of stream marker.
+ */
+static
+void
+StartMatchFinder(Compressor *comp)
+{
+  uint32_t matchPos;
+  uint32_t visited;
+  uint32_t node;
+  uint32_t i;
+
+  for(i = comp->ch_DictSize; i > 1; i--)
+    {
+      node = MOD_WINDOW(1 - i);
+      if(comp->ch_Level == COMP_LEVEL_SDK)
+        Sdk::add_string(&comp->ch_Tree, comp->ch_Window, node, &matchPos, &visited);
+      else
+        AddStringHash(&comp->ch_Hash, comp->ch_Window, node, &matchPos, 0, &visited);
     }
+
+  if(comp->ch_Level != COMP_LEVEL_SDK)
+    AddStringHash(&comp->ch_Hash, comp->ch_Window, 1, &matchPos, 0, &visited);
 }
 
+/* The Coder handed to Sdk::encode() and Sdk::flush() */
+struct CompCoder
+{
+  Compressor *cc_Comp;
+
+  void
+  start()
+  {
+    StartMatchFinder(cc_Comp);
+  }
+
+  uint32_t
+  find(uint32_t  node,
+       uint32_t *matchPos)
+  {
+    return FindMatch(cc_Comp, node, matchPos);
+  }
+
+  void
+  remove(uint32_t node)
+  {
+    RemoveString(cc_Comp, node);
+  }
+
+  void
+  literal(uint32_t c)
+  {
+    EmitBits(cc_Comp, 1, c, 8);
+    CountLiteral(cc_Comp->ch_Stats);
+  }
+
+  void
+  phrase(uint32_t matchPos,
+         uint32_t matchLen,
+         uint32_t dist)
+  {
+    EmitBits(cc_Comp, 0, Sdk::phrase_code(matchPos, matchLen),
+             INDEX_BIT_COUNT + LENGTH_BIT_COUNT);
+    CountPhrase(cc_Comp->ch_Stats, matchLen, dist);
+  }
+};
+
+static
 int
-CreateCompressor(Compressor **comp,
-                 CompFunc     cf,
-                 void        *workbuf_,
-                 void        *userdata_)
+internalCreateCompressor(Compressor          **comp,
+                         CompFunc              cf,
+                         CompSpanFunc          sf,
+                         void                 *workbuf_,
+                         void                 *userdata_,
+                         const CompAllocator  *alloc)
 {
   bool  allocated;
   void *buffer;
@@ -296,7 +626,7 @@ CreateCompressor(Compressor **comp,
 
   *comp = NULL;
 
-  if(!cf)
+  if(!cf && !sf)
     return COMP_ERR_BADPTR;
 
   buffer   = workbuf_;
@@ -305,7 +635,7 @@ CreateCompressor(Compressor **comp,
   allocated = false;
   if(!buffer)
     {
-      buffer = malloc(sizeof(Compressor));
+      buffer = CompAlloc(alloc, sizeof(Compressor));
       if(!buffer)
         return COMP_ERR_NOMEM;
 
@@ -313,81 +643,603 @@ CreateCompressor(Compressor **comp,
     }
 
   (*comp)                        = (Compressor*)buffer;
-  (*comp)->ch_LookAhead          = 1;
-  (*comp)->ch_CurrentPos         = 1;
-  (*comp)->ch_MatchPos           = 0;
-  (*comp)->ch_MatchLen           = 0;
-  (*comp)->ch_ReplaceCnt         = 0;
-  (*comp)->ch_SecondPass         = false;
+  (*comp)->ch_Fed                = 0;
+  (*comp)->ch_Finished           = false;
+  (*comp)->ch_Level              = COMP_LEVEL_SDK;
+  (*comp)->ch_ChainDepth         = 0;
+  (*comp)->ch_DictSize           = 0;
+  (*comp)->ch_Optimal            = NULL;
+  (*comp)->ch_Pipeline           = NULL;
+  (*comp)->ch_Piping             = false;
+  (*comp)->ch_Stats              = NULL;
   (*comp)->ch_Cookie             = *comp;
   (*comp)->ch_AllocatedStructure = allocated;
+  (*comp)->ch_Allocator          = *alloc;
+  (*comp)->ch_PipelineBlock      = NULL;
 
-  InitBitStream(&(*comp)->ch_BitStream,cf,userData);
+  Sdk::init_encode(&(*comp)->ch_State);
+  InitBitStream(&(*comp)->ch_BitStream,cf,sf,userData);
 
   /* To make the tree usable, everything must be set to UNUSED, and a
    * single phrase has to be added to the tree so it has a root node.
    */
-  memset((*comp)->ch_Tree, UNUSED, sizeof((*comp)->ch_Tree));
-  (*comp)->ch_Tree[TREE_ROOT].cn_RightChild = 1;
-  (*comp)->ch_Tree[1].cn_Parent             = TREE_ROOT;
+  Sdk::init_tree(&(*comp)->ch_Tree, WINDOW_SIZE + 1);
+
+  /* The flush encodes two literals from past the end of the input, as
+   * the SDK's does, and short inputs compare against unwritten bytes.
+   * A zeroed window keeps the output independent of what a reused work
+   * buffer held before; it is also what comp3do sees in fresh memory.
+   */
+  memset((*comp)->ch_Window, 0, sizeof((*comp)->ch_Window));
+
+  return (0);
+}
+
+int
+CreateCompressor(Compressor **comp,
+                 CompFunc     cf,
+                 void        *workbuf_,
+                 void        *userdata_)
+{
+  CompAllocator alloc;
+
+  if(!cf)
+    return COMP_ERR_BADPTR;
+
+  alloc = CurrentCompAllocator();
+
+  return internalCreateCompressor(comp,cf,NULL,workbuf_,userdata_,&alloc);
+}
+
+/* Like CreateCompressor() but output is delivered in spans of words */
+int
+CreateCompressorSpan(Compressor   **comp,
+                     CompSpanFunc   sf,
+                     void          *workbuf_,
+                     void          *userdata_)
+{
+  CompAllocator alloc;
+
+  if(!sf)
+    return COMP_ERR_BADPTR;
+
+  alloc = CurrentCompAllocator();
+
+  return internalCreateCompressor(comp,NULL,sf,workbuf_,userdata_,&alloc);
+}
+
+int
+SetCompressorLevel(Compressor *comp,
+                   int32_t     level)
+{
+  OptimalParser *op;
+
+  if(!comp || (comp->ch_Cookie != comp))
+    return (COMP_ERR_BADPTR);
+
+  /* The match finder can only be swapped before any data is fed */
+  op = comp->ch_Optimal;
+  if((comp->ch_State.es_LookAhead != 1) || comp->ch_State.es_SecondPass || comp->ch_Finished)
+    return (COMP_ERR_BADTAG);
+  if((op && (op->op_Base || op->op_Length)) || comp->ch_DictSize)
+    return (COMP_ERR_BADTAG);
+
+  switch(level)
+    {
+    case COMP_LEVEL_SDK:
+      Sdk::init_tree(&comp->ch_Tree, WINDOW_SIZE + 1);
+      comp->ch_ChainDepth = 0;
+      break;
+    case COMP_LEVEL_LAZY:
+      memset(&comp->ch_Hash, UNUSED, sizeof(comp->ch_Hash));
+      comp->ch_ChainDepth = LAZY_CHAIN_DEPTH;
+      break;
+    case COMP_LEVEL_FAST:
+      memset(&comp->ch_Hash, UNUSED, sizeof(comp->ch_Hash));
+      comp->ch_ChainDepth = FAST_CHAIN_DEPTH;
+      break;
+    case COMP_LEVEL_OPTIMAL:
+      if(!op)
+        {
+          op = (OptimalParser*)CompAlloc(&comp->ch_Allocator, sizeof(OptimalParser));
+          if(!op)
+            return (COMP_ERR_NOMEM);
+        }
+      op->op_Base      = 0;
+      op->op_History   = 0;
+      op->op_Length    = 0;
+      comp->ch_Optimal = op;
+      break;
+    default:
+      return (COMP_ERR_BADTAG);
+    }
+
+  if((level != COMP_LEVEL_OPTIMAL) && op)
+    {
+      CompFree(&comp->ch_Allocator, op);
+      comp->ch_Optimal = NULL;
+    }
+
+  comp->ch_Level = level;
 
   return (0);
 }
 
+/* Preset the window with the bytes the stream is expected to repeat.
+ * Like the level it can only be set before any data is fed, and the
+ * level can't be changed afterwards. The optimal parser takes the
+ * dictionary as the history of its first block; the other levels
+ * link it into their match finder once the look ahead is loaded. A
+ * reset discards it.
+ */
+int
+SetCompressorDictionary(Compressor *comp,
+                        const void *dict,
+                        uint32_t    numDictBytes)
+{
+  OptimalParser *op;
+
+  if(!comp || (comp->ch_Cookie != comp))
+    return (COMP_ERR_BADPTR);
+
+  if(numDictBytes && !dict)
+    return (COMP_ERR_BADPTR);
+
+  op = comp->ch_Optimal;
+  if((comp->ch_State.es_LookAhead != 1) || comp->ch_State.es_SecondPass || comp->ch_Finished)
+    return (COMP_ERR_BADTAG);
+  if((op && (op->op_Base || op->op_Length)) || comp->ch_DictSize)
+    return (COMP_ERR_BADTAG);
+
+  if(!numDictBytes)
+    return (0);
+
+  comp->ch_DictSize = Sdk::load_dictionary(comp->ch_Window, true, (const uint8_t*)dict,
+                                           numDictBytes);
+
+  if(comp->ch_Level == COMP_LEVEL_OPTIMAL)
+    {
+      /* Buffer offset j is window position op_Base + j + 1 */
+      memcpy(op->op_Buffer,
+             &((const uint8_t*)dict)[numDictBytes - comp->ch_DictSize],
+             comp->ch_DictSize);
+      op->op_Base    = (0 - (uint64_t)comp->ch_DictSize);
+      op->op_History = comp->ch_DictSize;
+      op->op_Length  = comp->ch_DictSize;
+    }
+
+  return (0);
+}
+
+/* Attach counters to the compressor. They are cleared here and left
+ * attached until the compressor is deleted. Pass NULL to detach.
+ */
+int
+SetCompressorStats(Compressor      *comp,
+                   CompressorStats *stats)
+{
+  if(!comp || (comp->ch_Cookie != comp))
+    return (COMP_ERR_BADPTR);
+
+  if(stats)
+    memset(stats, 0, sizeof(CompressorStats));
+
+  comp->ch_Stats = stats;
+
+  return (0);
+}
+
+static
+void*
+AlignUp(void   *ptr,
+        size_t  align)
+{
+  return (void*)(((uintptr_t)ptr + (align - 1)) & ~(uintptr_t)(align - 1));
+}
+
 static
 void
-FlushCompressor(Compressor *comp)
+FreePipeline(Compressor *comp)
+{
+  if(!comp->ch_Pipeline)
+    return;
+
+  comp->ch_Pipeline->~CompPipeline();
+  CompFree(&comp->ch_Allocator, comp->ch_PipelineBlock);
+  comp->ch_Pipeline      = NULL;
+  comp->ch_PipelineBlock = NULL;
+}
+
+/* Like the level this can only be changed before any data is fed.
+ * The packer thread is started by the first feed of each stream and
+ * stopped when it is finished or reset.
+ */
+int
+SetCompressorPipelined(Compressor *comp,
+                       int32_t     pipelined)
+{
+  void          *block;
+  OptimalParser *op;
+
+  if(!comp || (comp->ch_Cookie != comp))
+    return (COMP_ERR_BADPTR);
+
+  op = comp->ch_Optimal;
+  if((comp->ch_State.es_LookAhead != 1) || comp->ch_State.es_SecondPass || comp->ch_Finished)
+    return (COMP_ERR_BADTAG);
+  if((op && (op->op_Length > op->op_History)) || comp->ch_Piping)
+    return (COMP_ERR_BADTAG);
+
+  if(!pipelined)
+    {
+      FreePipeline(comp);
+      return (0);
+    }
+
+  if(!comp->ch_Pipeline)
+    {
+      /* The hooks needn't align to the cache lines the indexes are on */
+      block = CompAlloc(&comp->ch_Allocator, (sizeof(CompPipeline) + alignof(CompPipeline)));
+      if(!block)
+        return (COMP_ERR_NOMEM);
+
+      comp->ch_PipelineBlock = block;
+      comp->ch_Pipeline      = new (AlignUp(block, alignof(CompPipeline))) CompPipeline;
+    }
+
+  return (0);
+}
+
+static
+inline
+uint32_t
+HashBytes(const uint8_t *p)
 {
-  int32_t            lookAhead;
-  uint32_t           currentPos;
-  uint32_t           replaceCnt;
-  int32_t            matchLen;
+  uint32_t v;
+
+  v = ((p[0] << 16) | (p[1] << 8) | p[2]);
+
+  return ((v * UINT32_C(2654435761)) >> (32 - HASH_BITS));
+}
+
+/* Find the longest match for every position of the pending block,
+ * then walk backwards computing the cheapest encoding of each suffix
+ * of the block. Since any prefix of a match is also a match, the
+ * longest match at a position is enough to consider every phrase
+ * length available there. Unless this is the final block, emission
+ * stops OPT_LOOK_AHEAD bytes short of the end of the block.
+ */
+static
+void
+ParseOptimalBlock(Compressor *comp,
+                  bool        final)
+{
+  OptimalParser     *op;
+  uint8_t           *buf;
+  uint32_t           len;
+  uint32_t           start;
+  uint32_t           end;
+  uint32_t           keep;
+  uint32_t           i;
+  uint32_t           h;
+  uint32_t           l;
+  uint32_t           limit;
+  uint32_t           best;
+  uint32_t           cost;
   uint32_t           matchPos;
-  CompNode          *tree;
-  unsigned char     *window;
-  CompressBitStream *bs;
-  uint32_t           temp;
+  uint64_t           visited;
+  int32_t            j;
+  int32_t            bestPos;
+  CompressorStats   *stats;
+
+  op    = comp->ch_Optimal;
+  stats = comp->ch_Stats;
+  buf   = op->op_Buffer;
+  len   = op->op_Length;
+  start = op->op_History;
+
+  for(i = 0; i < HASH_SIZE; i++)
+    op->op_Head[i] = -1;
+
+  visited = 0;
+  for(i = 0; (i + HASH_STRING_LEN) <= len; i++)
+    {
+      h = HashBytes(&buf[i]);
+
+      if(i >= start)
+        {
+          limit = len - i;
+          if(limit > LOOK_AHEAD_SIZE)
+            limit = LOOK_AHEAD_SIZE;
 
-  tree         = comp->ch_Tree;
-  window       = comp->ch_Window;
-  bs           = &comp->ch_BitStream;
-  lookAhead    = comp->ch_LookAhead;
-  currentPos   = comp->ch_CurrentPos;
-  matchLen     = comp->ch_MatchLen;
-  matchPos     = comp->ch_MatchPos;
-  replaceCnt   = comp->ch_ReplaceCnt;
+          best    = 0;
+          bestPos = 0;
+          for(j = op->op_Head[h]; (j >= 0) && ((i - j) <= MAX_DISTANCE); j = op->op_Prev[j])
+            {
+              visited++;
 
-  if(comp->ch_SecondPass)
-    goto newData;
+              /* Window slot 0 doubles as the end of stream marker */
+              if(MOD_WINDOW(op->op_Base + j + 1) == END_OF_STREAM)
+                continue;
+              if(buf[j + best] != buf[i + best])
+                continue;
+
+              for(l = 0; (l < limit) && (buf[j + l] == buf[i + l]); l++)
+                ;
+
+              if(l > best)
+                {
+                  best    = l;
+                  bestPos = j;
+                  if(best == limit)
+                    break;
+                }
+            }
+
+          op->op_Len[i - start]  = best;
+          op->op_Dist[i - start] = (i - bestPos);
+        }
 
-  while(lookAhead >= 0)
+      op->op_Prev[i] = op->op_Head[h];
+      op->op_Head[h] = i;
+    }
+
+  for(; i < len; i++)
+    if(i >= start)
+      op->op_Len[i - start] = 0;
+
+  if(stats)
+    {
+      stats->cs_Searches     += (len - start);
+      stats->cs_NodesVisited += visited;
+    }
+
+  len -= start;
+  op->op_Cost[len] = 0;
+  for(i = len; i-- > 0; )
     {
-      if(matchLen > lookAhead)
-        matchLen = lookAhead;
+      op->op_Cost[i]   = LITERAL_BITS + op->op_Cost[i + 1];
+      op->op_Choice[i] = 1;
 
-      if(matchLen <= BREAK_EVEN)
+      for(l = (BREAK_EVEN + 1); l <= op->op_Len[i]; l++)
         {
-          WriteBits(bs, 1, (uint32_t) window[currentPos], 8);
-          replaceCnt = 1;
+          cost = PHRASE_BITS + op->op_Cost[i + l];
+          if(cost <= op->op_Cost[i])
+            {
+              op->op_Cost[i]   = cost;
+              op->op_Choice[i] = l;
+            }
+        }
+    }
+
+  end = len;
+  if(!final && (end > OPT_LOOK_AHEAD))
+    end -= OPT_LOOK_AHEAD;
+
+  for(i = 0; i < end; )
+    {
+      if(op->op_Choice[i] == 1)
+        {
+          EmitBits(comp, 1, (uint32_t) buf[start + i], 8);
+          CountLiteral(stats);
+          i++;
         }
       else
         {
-          temp = (matchPos << LENGTH_BIT_COUNT) | (matchLen - (BREAK_EVEN + 1));
-          WriteBits(bs, 0, temp, INDEX_BIT_COUNT + LENGTH_BIT_COUNT);
-          replaceCnt = matchLen;
+          l        = op->op_Choice[i];
+          matchPos = MOD_WINDOW(op->op_Base + start + i - op->op_Dist[i] + 1);
+          EmitBits(comp, 0, (matchPos << LENGTH_BIT_COUNT) | (l - (BREAK_EVEN + 1)),
+                    INDEX_BIT_COUNT + LENGTH_BIT_COUNT);
+          CountPhrase(stats, l, op->op_Dist[i]);
+          i += l;
         }
+    }
 
-      while(replaceCnt--)
-        {
-          DeleteString(tree, MOD_WINDOW(currentPos + LOOK_AHEAD_SIZE));
-          lookAhead--;
-        newData:
-          currentPos = MOD_WINDOW(currentPos + 1);
+  /* Keep the window behind the last emitted token as history for the
+   * next block along with anything that wasn't emitted.
+   */
+  len += start;
+  end  = (start + i);
+  l    = (end < WINDOW_SIZE) ? end : WINDOW_SIZE;
+  keep = (len - end);
+  memmove(buf, &buf[end - l], l + keep);
+
+  op->op_Base   += (end - l);
+  op->op_History = l;
+  op->op_Length  = l + keep;
+}
+
+static
+int
+FeedOptimal(Compressor    *comp,
+            const uint8_t *src,
+            uint32_t       numDataBytes)
+{
+  OptimalParser *op;
+  uint32_t       n;
+
+  op = comp->ch_Optimal;
+  while(numDataBytes)
+    {
+      n = ((op->op_History + OPT_BLOCK_SIZE) - op->op_Length);
+      if(n > numDataBytes)
+        n = numDataBytes;
+
+      memcpy(&op->op_Buffer[op->op_Length], src, n);
+      op->op_Length += n;
+      src           += n;
+      numDataBytes  -= n;
+
+      if(op->op_Length == (op->op_History + OPT_BLOCK_SIZE))
+        ParseOptimalBlock(comp, false);
+    }
+
+  return (0);
+}
 
-          if(lookAhead)
-            matchLen = AddString(tree, window, currentPos, &matchPos);
+/* Encode whatever is left and pad with two literals. The decoder stops
+ * after the token that pulls in the final word of the stream, so the
+ * padding guarantees every real token starts before that word. The
+ * SDK's flush leaves similar slack. The parser is kept for reuse by
+ * ResetCompressor() and freed along with the compressor.
+ */
+static
+void
+FlushOptimal(Compressor *comp)
+{
+  OptimalParser *op;
+
+  op = comp->ch_Optimal;
+  if(op->op_Length > op->op_History)
+    ParseOptimalBlock(comp, true);
+
+  EmitBits(comp, 1, 0, 8);
+  EmitBits(comp, 1, 0, 8);
+  CountLiteral(comp->ch_Stats);
+  CountLiteral(comp->ch_Stats);
+}
+
+static
+void
+FlushCompressor(Compressor *comp)
+{
+  CompCoder coder = {comp};
+
+  if(comp->ch_Level == COMP_LEVEL_LAZY)
+    Sdk::flush<true>(coder, &comp->ch_State, comp->ch_Window);
+  else
+    Sdk::flush(coder, &comp->ch_State, comp->ch_Window);
+}
+
+/* Encode whatever is pending and terminate the stream */
+static
+void
+FinishStream(Compressor *comp)
+{
+  std::exception_ptr error;
+
+  if(comp->ch_Level == COMP_LEVEL_OPTIMAL)
+    FlushOptimal(comp);
+  else
+    FlushCompressor(comp);
+  EmitBits(comp, 0, END_OF_STREAM, INDEX_BIT_COUNT);
+  if(comp->ch_Piping)
+    {
+      /* As in FeedCompressorBytes() the stream can't be continued */
+      error = PipeStop(comp);
+      if(error)
+        {
+          comp->ch_Finished = true;
+          std::rethrow_exception(error);
         }
     }
+  CleanupBitStream(&comp->ch_BitStream);
+
+  if(comp->ch_Stats)
+    comp->ch_Stats->cs_WordsWritten += comp->ch_BitStream.bs_WordsWritten;
+
+  comp->ch_Finished = true;
+}
+
+int
+FinishCompressor(Compressor *comp)
+{
+  if(!comp || (comp->ch_Cookie != comp))
+    return (COMP_ERR_BADPTR);
+
+  if(!comp->ch_Finished)
+    FinishStream(comp);
+
+  return (0);
+}
+
+/* Prepare the compressor for a new stream without reallocating it.
+ * Anything not yet finished is discarded. The level and attached
+ * stats are kept. Only the part of the tree that the previous stream
+ * could have touched is cleared so resetting after a short stream is
+ * much cheaper than creating a new compressor.
+ */
+static
+int
+internalResetCompressor(Compressor   *comp,
+                        CompFunc      cf,
+                        CompSpanFunc  sf,
+                        void         *userData)
+{
+  uint64_t       dirty;
+  OptimalParser *op;
+
+  if(!comp || (comp->ch_Cookie != comp))
+    return (COMP_ERR_BADPTR);
+
+  if(!cf && !sf)
+    return (COMP_ERR_BADPTR);
+
+  /* Tokens already queued are still delivered to the old output */
+  if(comp->ch_Piping)
+    PipeStop(comp);
+
+  /* As in internalCreateCompressor() so a reset matches a new compressor */
+  memset(comp->ch_Window, 0, sizeof(comp->ch_Window));
+
+  switch(comp->ch_Level)
+    {
+    case COMP_LEVEL_SDK:
+      /* Nodes past the input are never linked in, unless they held
+       * a dictionary. Node 0 (UNUSED) collects stray parent links so
+       * it is always cleared.
+       */
+      dirty = (comp->ch_Fed + LOOK_AHEAD_SIZE + 2);
+      if((dirty > (WINDOW_SIZE + 1)) || comp->ch_DictSize)
+        dirty = (WINDOW_SIZE + 1);
+      Sdk::init_tree(&comp->ch_Tree, dirty);
+      break;
+    case COMP_LEVEL_FAST:
+    case COMP_LEVEL_LAZY:
+      /* Chains are only ever entered through hc_Head[] and every
+       * position is relinked as it is added, so stale hc_Prev[]
+       * entries are unreachable.
+       */
+      memset(comp->ch_Hash.hc_Head, UNUSED, sizeof(comp->ch_Hash.hc_Head));
+      break;
+    case COMP_LEVEL_OPTIMAL:
+      op = comp->ch_Optimal;
+      op->op_Base    = 0;
+      op->op_History = 0;
+      op->op_Length  = 0;
+      break;
+    }
+
+  comp->ch_Fed      = 0;
+  comp->ch_DictSize = 0;
+  comp->ch_Finished = false;
+  Sdk::init_encode(&comp->ch_State);
+
+  InitBitStream(&comp->ch_BitStream,cf,sf,userData);
+
+  return (0);
+}
+
+int
+ResetCompressor(Compressor *comp,
+                CompFunc    cf,
+                void       *userData)
+{
+  if(!cf)
+    return (COMP_ERR_BADPTR);
+
+  return internalResetCompressor(comp,cf,NULL,userData);
+}
+
+int
+ResetCompressorSpan(Compressor   *comp,
+                    CompSpanFunc  sf,
+                    void         *userData)
+{
+  if(!sf)
+    return (COMP_ERR_BADPTR);
+
+  return internalResetCompressor(comp,NULL,sf,userData);
 }
 
 int
@@ -398,12 +1250,16 @@ DeleteCompressor(Compressor *comp)
 
   comp->ch_Cookie = NULL;
 
-  FlushCompressor(comp);
-  WriteBits(&comp->ch_BitStream, 0, END_OF_STREAM, INDEX_BIT_COUNT);
-  CleanupBitStream(&comp->ch_BitStream);
+  if(!comp->ch_Finished)
+    FinishStream(comp);
+
+  CompFree(&comp->ch_Allocator, comp->ch_Optimal);
+  comp->ch_Optimal = NULL;
+
+  FreePipeline(comp);
 
   if(comp->ch_AllocatedStructure)
-    free(comp);
+    CompFree(&comp->ch_Allocator, comp);
 
   return (0);
 }
@@ -416,105 +1272,84 @@ DeleteCompressor(Compressor *comp)
  * sent out, another loop has to run. The second loop reads in new
  * characters, deletes the strings that are overwritten by the new
  * character, then adds the strings that are created by the new
- * character.
+ * character. Both loops are Sdk::encode(); the compressor supplies
+ * the match finder for its level, the bit stream and the stats.
  */
 
+static
 int
-FeedCompressor(Compressor *comp,
-               void       *data,
-               uint32_t    numDataWords)
+internalFeedCompressor(Compressor    *comp,
+                       const uint8_t *src,
+                       uint32_t       numDataBytes)
 {
-  int32_t            lookAhead;
-  uint32_t           currentPos;
-  uint32_t           replaceCnt;
-  int32_t            matchLen;
-  uint32_t           matchPos;
-  uint8_t           *src;
-  CompNode          *tree;
-  unsigned char     *window;
-  CompressBitStream *bs;
-  uint32_t           numDataBytes;
-  uint32_t           temp;
+  CompCoder coder = {comp};
+
+  comp->ch_Fed += numDataBytes;
+
+  if(comp->ch_Level == COMP_LEVEL_OPTIMAL)
+    return FeedOptimal(comp, src, numDataBytes);
+
+  if(comp->ch_Level == COMP_LEVEL_LAZY)
+    Sdk::encode<true>(coder, &comp->ch_State, comp->ch_Window, src, numDataBytes);
+  else
+    Sdk::encode(coder, &comp->ch_State, comp->ch_Window, src, numDataBytes);
+
+  return (0);
+}
+
+/* The bit stream is flushed before returning so every complete word
+ * of output for the data fed so far has been delivered, unless
+ * pipelined, where the tokens are only handed to the packer.
+ */
+int
+FeedCompressorBytes(Compressor *comp,
+                    const void *data,
+                    size_t      numDataBytes)
+{
+  const uint8_t *src;
+  uint32_t       n;
 
   if(!comp || (comp->ch_Cookie != comp))
     return (COMP_ERR_BADPTR);
 
-  tree         = comp->ch_Tree;
-  window       = comp->ch_Window;
-  bs           = &comp->ch_BitStream;
-  lookAhead    = comp->ch_LookAhead;
-  currentPos   = comp->ch_CurrentPos;
-  matchLen     = comp->ch_MatchLen;
-  matchPos     = comp->ch_MatchPos;
-  replaceCnt   = comp->ch_ReplaceCnt;
-  numDataBytes = numDataWords * sizeof(uint32_t);
-  src          = (uint8_t*)data;
-
   if(!numDataBytes)
     return (0);
 
-  if(comp->ch_SecondPass)
-    goto newData;
+  if(comp->ch_Finished)
+    return (COMP_ERR_BADTAG);
 
-  while(lookAhead <= LOOK_AHEAD_SIZE)
-    {
-      if(!numDataBytes)
-        {
-          comp->ch_LookAhead = lookAhead;
-          return (0);
-        }
+  if(comp->ch_Pipeline && !comp->ch_Piping)
+    PipeStart(comp);
 
-      window[lookAhead++] = *src++;
-      numDataBytes--;
+  src = (const uint8_t*)data;
+  while(numDataBytes)
+    {
+      n = ((numDataBytes > (1UL << 30)) ? (1UL << 30) : numDataBytes);
+      internalFeedCompressor(comp, src, n);
+      src          += n;
+      numDataBytes -= n;
     }
 
-  lookAhead--;
-  while(true)
+  if(!comp->ch_Piping)
+    FlushBitStream(&comp->ch_BitStream);
+  else if(comp->ch_Pipeline->cp_Failed.load())
     {
-      if(matchLen > lookAhead)
-        matchLen = lookAhead;
-
-      if(matchLen <= BREAK_EVEN)
-        {
-          WriteBits(bs, 1, (uint32_t) window[currentPos], 8);
-          replaceCnt = 1;
-        }
-      else
-        {
-          temp = (matchPos << LENGTH_BIT_COUNT) | (matchLen - (BREAK_EVEN + 1));
-          WriteBits(bs, 0, temp, INDEX_BIT_COUNT + LENGTH_BIT_COUNT);
-          replaceCnt = matchLen;
-        }
-
-      while(replaceCnt--)
-        {
-          DeleteString(tree, MOD_WINDOW(currentPos + LOOK_AHEAD_SIZE));
-
-          if(!numDataBytes)
-            {
-              /* We ran out of data. Save all the state, and exit. If
-               * we are called with more data, we'll jump right back in
-               * this loop, and continue processing
-               */
-
-              comp->ch_LookAhead  = lookAhead;
-              comp->ch_CurrentPos = currentPos;
-              comp->ch_MatchLen   = matchLen;
-              comp->ch_MatchPos   = matchPos;
-              comp->ch_ReplaceCnt = replaceCnt;
-              comp->ch_SecondPass = true;
-              return (0);
-            }
-        newData:
-          window[MOD_WINDOW(currentPos + LOOK_AHEAD_SIZE)] = *src++;
-          numDataBytes--;
+      /* The bit stream is left inconsistent so nothing more is written */
+      comp->ch_Finished = true;
+      std::rethrow_exception(PipeStop(comp));
+    }
+  else
+    PipePublish(comp->ch_Pipeline);
 
-          currentPos = MOD_WINDOW(currentPos + 1);
+  return (0);
+}
 
-          if(lookAhead)
-            matchLen = AddString(tree, window, currentPos, &matchPos);
-        }
-    }
+int
+FeedCompressor(Compressor *comp,
+               void       *data,
+               uint32_t    numDataWords)
+{
+  return FeedCompressorBytes(comp, data, (size_t)numDataWords * sizeof(uint32_t));
 }
 
 struct Context
@@ -526,13 +1361,21 @@ struct Context
 
 static
 void
-PutWord(Context  *ctx_,
-        uint32_t  word_)
+PutSpan(Context        *ctx_,
+        const uint32_t *words_,
+        size_t          numWords_)
 {
-  if(ctx_->dest >= ctx_->max)
-    ctx_->overflow = true;
-  else
-    *ctx_->dest++ = word_;
+  size_t avail;
+
+  avail = (ctx_->max - ctx_->dest);
+  if(numWords_ > avail)
+    {
+      ctx_->overflow = true;
+      numWords_      = avail;
+    }
+
+  memcpy(ctx_->dest,words_,numWords_ * sizeof(uint32_t));
+  ctx_->dest += numWords_;
 }
 
 int32_t
@@ -541,6 +1384,70 @@ GetCompressorWorkBufferSize()
   return sizeof(Compressor);
 }
 
+/* Total memory used by a compressor at the given level, including the
+ * work buffer and anything the level allocates on top of it.
+ */
+int32_t
+GetCompressorLevelMemorySize(int32_t level)
+{
+  switch(level)
+    {
+    case COMP_LEVEL_SDK:
+    case COMP_LEVEL_FAST:
+    case COMP_LEVEL_LAZY:
+      return sizeof(Compressor);
+    case COMP_LEVEL_OPTIMAL:
+      return (sizeof(Compressor) + sizeof(OptimalParser));
+    }
+
+  return COMP_ERR_BADTAG;
+}
+
+/* What SetCompressorPipelined() allocates on top of the level's
+ * memory, with the slack it uses to align the ring's indexes.
+ */
+int32_t
+GetCompressorPipelineMemorySize(void)
+{
+  return (sizeof(CompPipeline) + alignof(CompPipeline));
+}
+
+/* Every byte a 9 bit literal, plus up to three literals the flush
+ * encodes past the end of the input and the end of stream marker.
+ * Phrases are always cheaper than the literals they replace so no
+ * level can exceed this.
+ */
+uint32_t
+GetCompressedSizeBound(uint32_t numDataWords)
+{
+  uint64_t bits;
+  uint64_t words;
+
+  bits  = (((uint64_t)numDataWords * sizeof(uint32_t) * LITERAL_BITS) +
+           (3 * LITERAL_BITS) + (1 + INDEX_BIT_COUNT));
+  words = ((bits + 31) / 32);
+
+  return ((words > UINT32_MAX) ? UINT32_MAX : (uint32_t)words);
+}
+
+/* Each thread keeps one compressor around for SimpleCompress() so
+ * that repeated calls only pay for a reset rather than an allocation
+ * and a full tree initialisation. It outlives any allocation hooks the
+ * thread sets so is always allocated with malloc().
+ */
+struct CompressorCache
+{
+  Compressor *cc_Compressor = NULL;
+
+  ~CompressorCache()
+  {
+    if(cc_Compressor)
+      DeleteCompressor(cc_Compressor);
+  }
+};
+
+static thread_local CompressorCache t_CompressorCache;
+
 int
 SimpleCompress(void     *source_,
                uint32_t  sourceWords_,
@@ -550,18 +1457,25 @@ SimpleCompress(void     *source_,
   int err;
   Compressor *comp;
   Context ctx;
+  CompAllocator alloc;
 
   ctx.dest = (uint32_t*)result_;
   ctx.max  = (uint32_t*)((uint64_t)result_ + resultWords_ * sizeof(uint32_t));
   ctx.overflow = false;
 
-  err = CreateCompressor(&comp,(CompFunc)PutWord,NULL,(void*)&ctx);
+  alloc = DefaultCompAllocator();
+  comp  = t_CompressorCache.cc_Compressor;
+  if(comp)
+    err = ResetCompressorSpan(comp,(CompSpanFunc)PutSpan,(void*)&ctx);
+  else
+    err = internalCreateCompressor(&t_CompressorCache.cc_Compressor,NULL,(CompSpanFunc)PutSpan,NULL,(void*)&ctx,&alloc);
   if(err < 0)
     return err;
+  comp = t_CompressorCache.cc_Compressor;
 
   FeedCompressor(comp,source_,sourceWords_);
 
-  err = DeleteCompressor(comp);
+  err = FinishCompressor(comp);
   if(err == 0)
     {
       if(ctx.overflow)
@@ -572,3 +1486,85 @@ SimpleCompress(void     *source_,
 
   return err;
 }
+
+/* Compressibility probe, see EstimateCompressedSize(). Samples are
+ * compressed as independent streams so each starts with an empty
+ * window; blocks are large enough that this costs little.
+ */
+#define PROBE_BLOCK_SIZE (16 * 1024)
+
+static
+void
+CountSpan(void           *count_,
+          const uint32_t *words_,
+          size_t          numWords_)
+{
+  *(uint64_t*)count_ += numWords_;
+}
+
+int
+EstimateCompressedSize(const void *data_,
+                       size_t      numDataBytes_,
+                       size_t      sampleBytes_,
+                       uint64_t   *size_)
+{
+  int err;
+  size_t i;
+  size_t len;
+  size_t blocks;
+  size_t stride;
+  uint64_t words;
+  Compressor *comp;
+  const uint8_t *src;
+
+  if(!size_ || (!data_ && numDataBytes_))
+    return (COMP_ERR_BADPTR);
+
+  *size_ = 0;
+  if(!numDataBytes_)
+    return (0);
+
+  words = 0;
+  err = CreateCompressorSpan(&comp,CountSpan,NULL,(void*)&words);
+  if(err < 0)
+    return err;
+
+  err = SetCompressorLevel(comp,COMP_LEVEL_FAST);
+  if(err < 0)
+    {
+      DeleteCompressor(comp);
+      return err;
+    }
+
+  src = (const uint8_t*)data_;
+  if(sampleBytes_ >= numDataBytes_)
+    {
+      FeedCompressorBytes(comp,src,numDataBytes_);
+      DeleteCompressor(comp);
+      *size_ = (words * sizeof(uint32_t));
+      return (0);
+    }
+
+  blocks = (sampleBytes_ / PROBE_BLOCK_SIZE);
+  if(blocks == 0)
+    blocks = 1;
+  stride = (numDataBytes_ / blocks);
+  len    = ((stride < PROBE_BLOCK_SIZE) ? stride : PROBE_BLOCK_SIZE);
+
+  /* Reset only between blocks so deleting the compressor, once the
+   * last is finished, doesn't count the terminator of an empty stream
+   */
+  for(i = 0; i < blocks; i++)
+    {
+      if(i)
+        ResetCompressorSpan(comp,CountSpan,(void*)&words);
+      FeedCompressorBytes(comp,&src[i * stride],len);
+      FinishCompressor(comp);
+    }
+
+  DeleteCompressor(comp);
+
+  *size_ = (uint64_t)(((double)(words * sizeof(uint32_t)) / (blocks * len)) * numDataBytes_);
+
+  return (0);
+}
@@ -1,15 +1,120 @@
 #pragma once
 
+#include "alloc.hpp"
+#include "api.hpp"
 #include "errors.hpp"
 #include "types.hpp"
 
-#include <cstdint>
+#include <stddef.h>
+#include <stdint.h>
+
+COMP_EXTERN_C_BEGIN
 
 typedef struct Compressor Compressor;
 
-int CreateCompressor(Compressor **comp, CompFunc cf, void *workbuf, void *userdata);
-int DeleteCompressor(Compressor *comp);
-int FeedCompressor(Compressor *comp, void *data, uint32_t numDataWords);
-int32_t GetCompressorWorkBufferSize();
+/*
+ * Compression levels. COMP_LEVEL_SDK uses the SDK's binary tree match
+ * finder and produces output identical to comp3do. COMP_LEVEL_FAST
+ * uses a depth limited hash chain which is quicker but finds fewer
+ * matches. COMP_LEVEL_LAZY searches deeper hash chains and defers
+ * each match by one byte, taking a literal instead when the match at
+ * the next byte is longer; it gets most of the gain of
+ * COMP_LEVEL_OPTIMAL in a fraction of the time. COMP_LEVEL_OPTIMAL
+ * buffers the input and picks the cheapest sequence of literals and
+ * phrases, trading speed and memory for the smallest output. All
+ * levels produce valid 3DO LZSS streams.
+ */
+#define COMP_LEVEL_SDK     0
+#define COMP_LEVEL_FAST    1
+#define COMP_LEVEL_OPTIMAL 2
+#define COMP_LEVEL_LAZY    3
+
+/*
+ * Optional counters filled in while compressing. Attach with
+ * SetCompressorStats(); when none are attached the only cost is a
+ * pointer test per token. cs_WordsWritten is updated when the
+ * compressor is deleted.
+ */
+typedef struct CompressorStats
+{
+  uint64_t cs_Literals;
+  uint64_t cs_Phrases;
+  uint64_t cs_PhraseLengths[STATS_LENGTH_COUNT];
+  uint64_t cs_PhraseOffsets[STATS_OFFSET_COUNT];
+  uint64_t cs_Searches;
+  uint64_t cs_NodesVisited;
+  uint64_t cs_Deletions;
+  uint64_t cs_WordsWritten;
+} CompressorStats;
+
+/*
+ * A compressor can be reused for many streams. FinishCompressor()
+ * terminates the current stream as DeleteCompressor() would but keeps
+ * the context; ResetCompressor() then starts a new stream, optionally
+ * to a different output, reinitialising only what the last stream
+ * touched. SimpleCompress() keeps one such context per thread.
+ *
+ * The *Span variants deliver output through a CompSpanFunc, up to a
+ * few hundred words per call, instead of one call per word.
+ * FeedCompressorBytes() accepts any number of bytes per call; the
+ * stream is still decoded in whole words so a total that isn't a
+ * multiple of 4 should be zero padded by the caller on the last feed.
+ */
+COMP_API int CreateCompressor(Compressor **comp, CompFunc cf, void *workbuf, void *userdata);
+COMP_API int CreateCompressorSpan(Compressor **comp, CompSpanFunc sf, void *workbuf, void *userdata);
+COMP_API int DeleteCompressor(Compressor *comp);
+COMP_API int FinishCompressor(Compressor *comp);
+COMP_API int ResetCompressor(Compressor *comp, CompFunc cf, void *userdata);
+COMP_API int ResetCompressorSpan(Compressor *comp, CompSpanFunc sf, void *userdata);
+COMP_API int FeedCompressor(Compressor *comp, void *data, uint32_t numDataWords);
+COMP_API int FeedCompressorBytes(Compressor *comp, const void *data, size_t numDataBytes);
+COMP_API int SetCompressorLevel(Compressor *comp, int32_t level);
+COMP_API int SetCompressorStats(Compressor *comp, CompressorStats *stats);
+COMP_API int32_t GetCompressorWorkBufferSize(void);
+COMP_API int32_t GetCompressorLevelMemorySize(int32_t level);
+
+/*
+ * SetCompressorPipelined() splits the work over two threads: the one
+ * feeding finds the matches and a second packs them into words for
+ * the output function. Like the level it must be set before the first
+ * feed. The output is identical but is delivered from the packer
+ * thread and may lag behind the feeds; FinishCompressor(),
+ * ResetCompressor*() and DeleteCompressor() wait for all of it. An
+ * exception thrown by the output function is rethrown from the next
+ * feed or finish, after which the stream can only be reset.
+ * GetCompressorPipelineMemorySize() is the memory it allocates.
+ */
+COMP_API int SetCompressorPipelined(Compressor *comp, int32_t pipelined);
+COMP_API int32_t GetCompressorPipelineMemorySize(void);
+
+/*
+ * A preset dictionary seeds the window with data the input is likely
+ * to repeat, such as a previous revision of a file or headers shared
+ * by many small files. SetCompressorDictionary() must be called after
+ * SetCompressorLevel() and before the first feed. Only the last
+ * COMP_DICTIONARY_SIZE bytes are used. The stream can then only be
+ * decoded by a decompressor given the same dictionary with
+ * SetDecompressorDictionary(); SimpleDecompress() and the SDK can't.
+ */
+COMP_API int SetCompressorDictionary(Compressor *comp, const void *dict, uint32_t numDictBytes);
+
+/*
+ * Cheap estimate of the compressed size of a buffer, for skipping
+ * inputs that won't shrink. Up to sampleBytes of the input, taken as
+ * evenly spaced blocks, are compressed at COMP_LEVEL_FAST and the
+ * result is scaled to the whole input. If sampleBytes covers the input
+ * it is all compressed and the size is that of a COMP_LEVEL_FAST
+ * stream. COMP_LEVEL_SDK output is usually a little smaller.
+ */
+COMP_API int EstimateCompressedSize(const void *data, size_t numDataBytes, size_t sampleBytes, uint64_t *size);
+
+/*
+ * The most words any level can produce for numDataWords of input, for
+ * sizing the result of SimpleCompress() or a compressor's output. The
+ * worst case is 9/8 of the input plus the terminator.
+ */
+COMP_API uint32_t GetCompressedSizeBound(uint32_t numDataWords);
+
+COMP_API int SimpleCompress(void *source, uint32_t sourceWords, void *result, uint32_t resultWords);
 
-int SimpleCompress(void *source, uint32_t sourceWords, void *result, uint32_t resultWords);
+COMP_EXTERN_C_END
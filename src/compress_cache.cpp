@@ -0,0 +1,276 @@
+#include "compress_cache.hpp"
+
+#include "fmt.hpp"
+#include "sha256.hpp"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace l
+{
+  struct CacheEntry
+  {
+    fs::file_time_type mtime;
+    uint64_t           size;
+    fs::path           path;
+  };
+}
+
+CompressCache::CompressCache(fs::path const    &dirpath_,
+                             uint64_t           max_size_,
+                             std::string const &salt_)
+  : _dirpath(dirpath_),
+    _max_size(max_size_),
+    _salt(salt_),
+    _hits(0),
+    _misses(0),
+    _stores(0),
+    _evictions(0),
+    _temp_id(0),
+    _entries(0),
+    _size(0)
+{
+  std::error_code ec;
+
+  fs::create_directories(_dirpath,ec);
+  if(!fs::is_directory(_dirpath))
+    throw fmt::exception("ERROR: unable to create cache directory {}",_dirpath);
+}
+
+std::string
+CompressCache::key(fs::path const &src_filepath_) const
+{
+  FILE *f;
+  std::size_t n;
+  Sha256 sha;
+  std::unique_ptr<uint8_t[]> buf;
+  static constexpr std::size_t BUF_SIZE = (1024 * 1024);
+
+  f = fopen(src_filepath_.string().c_str(),"rb");
+  if(f == NULL)
+    throw fmt::exception("ERROR: failed to open {} - {}",src_filepath_,strerror(errno));
+
+  buf.reset(new uint8_t[BUF_SIZE]);
+  while((n = fread(buf.get(),1,BUF_SIZE,f)) > 0)
+    sha.update(buf.get(),n);
+
+  if(ferror(f))
+    {
+      fclose(f);
+      throw fmt::exception("ERROR: failed to read {} - {}",src_filepath_,strerror(errno));
+    }
+  fclose(f);
+
+  sha.update(_salt.data(),_salt.size());
+
+  return Sha256::hex(sha.digest());
+}
+
+std::string
+CompressCache::key(const void  *data_,
+                   std::size_t  size_) const
+{
+  Sha256 sha;
+
+  sha.update(data_,size_);
+  sha.update(_salt.data(),_salt.size());
+
+  return Sha256::hex(sha.digest());
+}
+
+fs::path
+CompressCache::entry_path(std::string const &key_) const
+{
+  return (_dirpath / key_.substr(0,2) / key_);
+}
+
+// Unique across threads and across processes sharing the directory
+fs::path
+CompressCache::temp_path(fs::path const &entry_)
+{
+  fs::path path;
+
+  path  = entry_;
+  path += fmt::format(".tmp.{}.{}",getpid(),_temp_id++);
+
+  return path;
+}
+
+void
+CompressCache::commit(fs::path const &temp_,
+                      fs::path const &entry_)
+{
+  std::error_code ec;
+
+  fs::rename(temp_,entry_,ec);
+  if(ec)
+    {
+      fs::remove(temp_,ec);
+      return;
+    }
+
+  _stores++;
+}
+
+bool
+CompressCache::fetch(std::string const &key_,
+                     fs::path const    &dst_filepath_,
+                     std::size_t       *size_)
+{
+  fs::path entry;
+  std::error_code ec;
+
+  entry = entry_path(key_);
+
+  *size_ = fs::file_size(entry,ec);
+  if(ec)
+    {
+      _misses++;
+      return false;
+    }
+
+  fs::copy_file(entry,dst_filepath_,fs::copy_options::overwrite_existing,ec);
+  if(ec)
+    throw fmt::exception("ERROR: failed to copy {} to {} - {}",
+                         entry,
+                         dst_filepath_,
+                         ec.message());
+
+  // Mark it recently used for trim()
+  fs::last_write_time(entry,fs::file_time_type::clock::now(),ec);
+
+  _hits++;
+
+  return true;
+}
+
+// A cache that can't be written to only costs the next run a miss so
+// failures here are not reported.
+void
+CompressCache::store(std::string const &key_,
+                     fs::path const    &src_filepath_)
+{
+  fs::path temp;
+  fs::path entry;
+  std::error_code ec;
+
+  entry = entry_path(key_);
+  fs::create_directories(entry.parent_path(),ec);
+
+  temp = temp_path(entry);
+  fs::copy_file(src_filepath_,temp,ec);
+  if(ec)
+    {
+      fs::remove(temp,ec);
+      return;
+    }
+
+  commit(temp,entry);
+}
+
+void
+CompressCache::store(std::string const &key_,
+                     const void        *data_,
+                     std::size_t        size_)
+{
+  FILE *f;
+  bool ok;
+  fs::path temp;
+  fs::path entry;
+  std::error_code ec;
+
+  entry = entry_path(key_);
+  fs::create_directories(entry.parent_path(),ec);
+
+  temp = temp_path(entry);
+  f = fopen(temp.string().c_str(),"wb");
+  if(f == NULL)
+    return;
+
+  ok = (fwrite(data_,1,size_,f) == size_);
+  ok = ((fclose(f) == 0) && ok);
+  if(!ok)
+    {
+      fs::remove(temp,ec);
+      return;
+    }
+
+  commit(temp,entry);
+}
+
+void
+CompressCache::trim()
+{
+  uint64_t total;
+  std::error_code ec;
+  std::vector<l::CacheEntry> entries;
+
+  total = 0;
+  for(auto it = fs::recursive_directory_iterator(_dirpath,ec);
+      !ec && (it != fs::recursive_directory_iterator());
+      it.increment(ec))
+    {
+      l::CacheEntry e;
+
+      if(!it->is_regular_file(ec))
+        continue;
+
+      e.path  = it->path();
+      e.size  = it->file_size(ec);
+      e.mtime = it->last_write_time(ec);
+      if(ec)
+        continue;
+
+      total += e.size;
+      entries.emplace_back(std::move(e));
+    }
+
+  std::sort(entries.begin(),entries.end(),
+            [](l::CacheEntry const &a_, l::CacheEntry const &b_)
+            {
+              return (a_.mtime < b_.mtime);
+            });
+
+  _entries = entries.size();
+  for(auto const &e : entries)
+    {
+      if(total <= _max_size)
+        break;
+      if(!fs::remove(e.path,ec))
+        continue;
+      total -= e.size;
+      _entries--;
+      _evictions++;
+    }
+
+  _size = total;
+}
+
+CompressCache::Stats
+CompressCache::stats() const
+{
+  Stats s;
+
+  s.hits      = _hits;
+  s.misses    = _misses;
+  s.stores    = _stores;
+  s.evictions = _evictions;
+  s.entries   = _entries;
+  s.size      = _size;
+
+  return s;
+}
+
+fs::path const &
+CompressCache::dirpath() const
+{
+  return _dirpath;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/*
+ * Content addressed store of compressor output, so unchanged inputs
+ * are copied from a previous run rather than compressed again.
+ *
+ * Entries are named by the SHA-256 of the input followed by a salt
+ * describing everything else that affects the output (codec version,
+ * level, ...) and live in DIR/xx/ where xx is the first byte of the
+ * name. They are written to a temporary name and renamed into place
+ * so concurrent runs sharing a cache never see a partial entry. A hit
+ * updates the entry's modification time, which makes trim() evict
+ * the least recently used entries first until the cache fits in
+ * max_size.
+ *
+ * All members may be called from several threads at once.
+ */
+class CompressCache
+{
+public:
+  struct Stats
+  {
+    uint64_t    hits      = 0;
+    uint64_t    misses    = 0;
+    uint64_t    stores    = 0;
+    uint64_t    evictions = 0;
+    std::size_t entries   = 0;
+    uint64_t    size      = 0;
+  };
+
+public:
+  CompressCache(std::filesystem::path const &dirpath,
+                uint64_t                     max_size,
+                std::string const           &salt);
+
+  CompressCache(const CompressCache&) = delete;
+  CompressCache& operator=(const CompressCache&) = delete;
+
+public:
+  std::string key(std::filesystem::path const &src_filepath) const;
+  std::string key(const void  *data,
+                  std::size_t  size) const;
+
+  // Copies the entry to dst_filepath and sets size to its size if
+  // there is one. Counts a hit or a miss.
+  bool fetch(std::string const           &key,
+             std::filesystem::path const &dst_filepath,
+             std::size_t                 *size);
+
+  void store(std::string const           &key,
+             std::filesystem::path const &src_filepath);
+  void store(std::string const &key,
+             const void        *data,
+             std::size_t        size);
+
+  void  trim();
+  Stats stats() const;
+
+  std::filesystem::path const &dirpath() const;
+
+private:
+  std::filesystem::path entry_path(std::string const &key) const;
+  std::filesystem::path temp_path(std::filesystem::path const &entry);
+  void                  commit(std::filesystem::path const &temp,
+                               std::filesystem::path const &entry);
+
+private:
+  std::filesystem::path _dirpath;
+  uint64_t              _max_size;
+  std::string           _salt;
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+  std::atomic<uint64_t> _stores;
+  std::atomic<uint64_t> _evictions;
+  std::atomic<uint64_t> _temp_id;
+  std::size_t           _entries;
+  uint64_t              _size;
+};
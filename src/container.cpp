@@ -0,0 +1,443 @@
+#include "container.hpp"
+
+#include "byteswap.hpp"
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "fmt.hpp"
+#include "mapped_file.hpp"
+#include "verifier.hpp"
+#include "work_pool.hpp"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace l
+{
+  struct Entry
+  {
+    uint64_t offset;
+    uint32_t words;
+    uint32_t bytes;
+  };
+
+  template<typename T>
+  static
+  void
+  put(uint8_t *&p_,
+      T         v_)
+  {
+    v_ = ::byteswap_if_little_endian(v_);
+    memcpy(p_,&v_,sizeof(v_));
+    p_ += sizeof(v_);
+  }
+
+  template<typename T>
+  static
+  T
+  get(const uint8_t *&p_)
+  {
+    T v;
+
+    memcpy(&v,p_,sizeof(v));
+    p_ += sizeof(v);
+
+    return ::byteswap_if_little_endian(v);
+  }
+
+  static
+  void
+  write(FILE        *f_,
+        const void  *data_,
+        std::size_t  size_)
+  {
+    if(fwrite(data_,1,size_,f_) != size_)
+      throw fmt::exception("ERROR: failed to write - {}",strerror(errno));
+  }
+
+  static
+  void
+  push_span(void           *words_,
+            const uint32_t *span_,
+            std::size_t     num_words_)
+  {
+    std::vector<uint32_t> *words = (std::vector<uint32_t>*)words_;
+
+    words->insert(words->end(),span_,span_ + num_words_);
+  }
+
+  static
+  void
+  add_stats(CompressorStats       &dst_,
+            CompressorStats const &src_)
+  {
+    dst_.cs_Literals     += src_.cs_Literals;
+    dst_.cs_Phrases      += src_.cs_Phrases;
+    dst_.cs_Searches     += src_.cs_Searches;
+    dst_.cs_NodesVisited += src_.cs_NodesVisited;
+    dst_.cs_Deletions    += src_.cs_Deletions;
+    dst_.cs_WordsWritten += src_.cs_WordsWritten;
+    for(int i = 0; i < STATS_LENGTH_COUNT; i++)
+      dst_.cs_PhraseLengths[i] += src_.cs_PhraseLengths[i];
+    for(int i = 0; i < STATS_OFFSET_COUNT; i++)
+      dst_.cs_PhraseOffsets[i] += src_.cs_PhraseOffsets[i];
+  }
+
+  static
+  void
+  compress_segment(const uint8_t         *src_,
+                   std::size_t            size_,
+                   int32_t                level_,
+                   void                  *workbuf_,
+                   CompressorStats       *stats_,
+                   bool                   verify_,
+                   std::vector<uint32_t> &out_)
+  {
+    int rv;
+    void *userdata;
+    Compressor *comp;
+    CompSpanFunc sf;
+    std::unique_ptr<Verifier> verifier;
+    static const uint8_t zeros[sizeof(uint32_t)] = {0};
+
+    sf       = (CompSpanFunc)l::push_span;
+    userdata = (void*)&out_;
+    if(verify_)
+      {
+        verifier.reset(new Verifier(sf,userdata,src_,size_));
+        sf       = Verifier::write_span;
+        userdata = (void*)verifier.get();
+      }
+
+    rv = CreateCompressorSpan(&comp,sf,workbuf_,userdata);
+    if(rv < 0)
+      throw std::runtime_error("CreateCompressor failed");
+
+    rv = SetCompressorLevel(comp,level_);
+    if(rv < 0)
+      throw std::runtime_error("SetCompressorLevel failed");
+
+    if(stats_)
+      SetCompressorStats(comp,stats_);
+
+    FeedCompressorBytes(comp,src_,size_);
+
+    // A trailing partial word is zero padded
+    if(size_ & 0x3)
+      FeedCompressorBytes(comp,zeros,sizeof(uint32_t) - (size_ & 0x3));
+
+    DeleteCompressor(comp);
+    if(verifier)
+      verifier->finish();
+  }
+
+  static
+  Container::Info
+  read_index(const uint8_t      *src_,
+             std::size_t         src_size_,
+             std::vector<Entry> &entries_)
+  {
+    const uint8_t *p;
+    uint64_t index_offset;
+    uint64_t total;
+    uint32_t count;
+    Container::Info info;
+
+    if(src_size_ < (CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE))
+      throw std::runtime_error("ERROR: container is truncated");
+
+    p = src_;
+    if(l::get<uint32_t>(p) != CONTAINER_MAGIC)
+      throw std::runtime_error("ERROR: not a 3ct container");
+    if(l::get<uint32_t>(p) != CONTAINER_VERSION)
+      throw std::runtime_error("ERROR: unsupported container version");
+    info.segment_size = l::get<uint32_t>(p);
+
+    p = &src_[src_size_ - CONTAINER_TRAILER_SIZE];
+    index_offset = l::get<uint64_t>(p);
+    total        = l::get<uint64_t>(p);
+    count        = l::get<uint32_t>(p);
+    if(l::get<uint32_t>(p) != CONTAINER_INDEX_MAGIC)
+      throw std::runtime_error("ERROR: container index is missing");
+
+    if((info.segment_size == 0) ||
+       (index_offset < CONTAINER_HEADER_SIZE) ||
+       (index_offset + ((uint64_t)count * CONTAINER_ENTRY_SIZE) + CONTAINER_TRAILER_SIZE != src_size_) ||
+       (total > (uint64_t)count * info.segment_size))
+      throw std::runtime_error("ERROR: container index is corrupt");
+
+    info.segments = count;
+    info.size     = total;
+
+    entries_.resize(count);
+    p = &src_[index_offset];
+    for(auto &e : entries_)
+      {
+        e.offset = l::get<uint64_t>(p);
+        e.words  = l::get<uint32_t>(p);
+        e.bytes  = l::get<uint32_t>(p);
+        if((e.offset & 0x3) ||
+           (e.offset + ((uint64_t)e.words * sizeof(uint32_t)) > index_offset) ||
+           (e.bytes > info.segment_size))
+          throw std::runtime_error("ERROR: container index is corrupt");
+      }
+
+    return info;
+  }
+}
+
+bool
+Container::is_container(const uint8_t *data_,
+                        std::size_t    size_)
+{
+  const uint8_t *p;
+
+  if(size_ < (CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE))
+    return false;
+
+  p = data_;
+  if(l::get<uint32_t>(p) != CONTAINER_MAGIC)
+    return false;
+
+  p = &data_[size_ - sizeof(uint32_t)];
+
+  return (l::get<uint32_t>(p) == CONTAINER_INDEX_MAGIC);
+}
+
+Container::Info
+Container::compress(const uint8_t   *src_,
+                    std::size_t      src_size_,
+                    const fs::path  &dst_filepath_,
+                    std::size_t      segment_size_,
+                    int32_t          level_,
+                    unsigned         jobs_,
+                    CompressorStats *stats_,
+                    bool             verify_)
+{
+  FILE *dst;
+  uint8_t *p;
+  uint64_t offset;
+  std::size_t next;
+  std::mutex lock;
+  std::vector<bool> done;
+  std::vector<l::Entry> entries;
+  std::vector<uint8_t> buf;
+  std::vector<std::vector<uint32_t>> outs;
+  std::vector<std::unique_ptr<uint8_t[]>> workbufs;
+  Container::Info info;
+
+  if(stats_)
+    memset(stats_,0,sizeof(CompressorStats));
+
+  if(segment_size_ < CONTAINER_MIN_SEGMENT)
+    throw fmt::exception("ERROR: segment size must be at least {} bytes",CONTAINER_MIN_SEGMENT);
+
+  // Segments start on a word boundary so that only the last one can
+  // end in a partial, zero padded word.
+  segment_size_ = ((segment_size_ + 3) & ~(std::size_t)3);
+  if(segment_size_ > UINT32_MAX)
+    throw std::runtime_error("ERROR: segment size must be less than 4GiB");
+
+  info.segment_size = segment_size_;
+  info.segments     = ((src_size_ + segment_size_ - 1) / segment_size_);
+
+  dst = fopen(dst_filepath_.string().c_str(),"wb");
+  if(dst == NULL)
+    throw fmt::exception("ERROR: failed to open {} - {}",dst_filepath_,strerror(errno));
+
+  try
+    {
+      buf.resize(CONTAINER_HEADER_SIZE);
+      p = buf.data();
+      l::put<uint32_t>(p,CONTAINER_MAGIC);
+      l::put<uint32_t>(p,CONTAINER_VERSION);
+      l::put<uint32_t>(p,segment_size_);
+      l::put<uint32_t>(p,0);
+      l::write(dst,buf.data(),buf.size());
+
+      WorkPool pool(jobs_ ? jobs_ : WorkPool::default_threads());
+      for(unsigned i = 0; i < pool.size(); i++)
+        workbufs.emplace_back(new uint8_t[GetCompressorWorkBufferSize()]);
+
+      // Segments are written in order as soon as every earlier one is
+      // done so at most a few compressed segments are held in memory.
+      outs.resize(info.segments);
+      done.resize(info.segments,false);
+      entries.resize(info.segments);
+      offset = CONTAINER_HEADER_SIZE;
+      next   = 0;
+      pool.run(info.segments,
+               [&](std::size_t task_,
+                   unsigned    worker_)
+               {
+                 std::size_t start = (task_ * segment_size_);
+                 std::size_t size  = std::min(segment_size_,src_size_ - start);
+                 CompressorStats stats;
+
+                 l::compress_segment(&src_[start],
+                                     size,
+                                     level_,
+                                     workbufs[worker_].get(),
+                                     (stats_ ? &stats : NULL),
+                                     verify_,
+                                     outs[task_]);
+
+                 std::lock_guard<std::mutex> guard(lock);
+                 if(stats_)
+                   l::add_stats(*stats_,stats);
+                 entries[task_].bytes = size;
+                 done[task_] = true;
+                 while((next < done.size()) && done[next])
+                   {
+                     std::vector<uint32_t> &out = outs[next];
+
+                     l::write(dst,out.data(),out.size() * sizeof(uint32_t));
+                     entries[next].offset = offset;
+                     entries[next].words  = out.size();
+                     offset += (out.size() * sizeof(uint32_t));
+                     std::vector<uint32_t>().swap(out);
+                     next++;
+                   }
+               });
+
+      buf.resize((entries.size() * CONTAINER_ENTRY_SIZE) + CONTAINER_TRAILER_SIZE);
+      p = buf.data();
+      for(auto const &e : entries)
+        {
+          l::put<uint64_t>(p,e.offset);
+          l::put<uint32_t>(p,e.words);
+          l::put<uint32_t>(p,e.bytes);
+        }
+      l::put<uint64_t>(p,offset);
+      l::put<uint64_t>(p,src_size_);
+      l::put<uint32_t>(p,info.segments);
+      l::put<uint32_t>(p,CONTAINER_INDEX_MAGIC);
+      l::write(dst,buf.data(),buf.size());
+    }
+  catch(...)
+    {
+      fclose(dst);
+      throw;
+    }
+
+  info.size = (offset + buf.size());
+  if(fclose(dst) != 0)
+    throw fmt::exception("ERROR: failed to close {} - {}",dst_filepath_,strerror(errno));
+
+  return info;
+}
+
+Container::Info
+Container::decompress(const uint8_t  *src_,
+                      std::size_t     src_size_,
+                      const fs::path &dst_filepath_,
+                      unsigned        jobs_)
+{
+  MappedFile dst;
+  std::vector<l::Entry> entries;
+  Container::Info info;
+
+  info = l::read_index(src_,src_size_,entries);
+
+  // The output is sized up front and each segment decodes straight
+  // into its slot. Only a segment ending in a partial word goes
+  // through a bounce buffer.
+  dst.create(dst_filepath_,info.size);
+
+  WorkPool pool(jobs_ ? jobs_ : WorkPool::default_threads());
+  pool.run(entries.size(),
+           [&](std::size_t task_,
+               unsigned    worker_)
+           {
+             int rv;
+             uint8_t *out;
+             uint32_t words;
+             std::size_t start;
+             std::vector<uint32_t> tmp;
+             l::Entry const &e = entries[task_];
+
+             start = (task_ * info.segment_size);
+             if((start + e.bytes) > info.size)
+               throw fmt::exception("ERROR: container segment {} is corrupt",task_);
+
+             out   = (dst.data() + start);
+             words = ((e.bytes + 3) / sizeof(uint32_t));
+             if(e.bytes & 0x3)
+               {
+                 tmp.resize(words);
+                 rv = SimpleDecompress((void*)&src_[e.offset],e.words,tmp.data(),words);
+               }
+             else
+               {
+                 rv = SimpleDecompress((void*)&src_[e.offset],e.words,out,words);
+               }
+
+             if(rv != (int)words)
+               throw fmt::exception("ERROR: container segment {} is corrupt",task_);
+             if(!tmp.empty())
+               memcpy(out,tmp.data(),e.bytes);
+           });
+
+  dst.close(info.size);
+
+  return info;
+}
+
+std::size_t
+Container::decompress_range(const uint8_t *src_,
+                            std::size_t    src_size_,
+                            uint64_t       offset_,
+                            uint64_t       length_,
+                            FILE          *dst_)
+{
+  int rv;
+  uint32_t words;
+  uint64_t end;
+  uint64_t start;
+  uint64_t skip;
+  uint64_t take;
+  std::size_t written;
+  std::vector<uint32_t> buf;
+  std::vector<l::Entry> entries;
+  Container::Info info;
+
+  info = l::read_index(src_,src_size_,entries);
+  if(offset_ > info.size)
+    throw fmt::exception("ERROR: range offset {} is past the end of the data ({} bytes)",
+                         offset_,
+                         info.size);
+
+  end = offset_ + std::min<uint64_t>(length_,info.size - offset_);
+
+  written = 0;
+  buf.resize((info.segment_size + 3) / sizeof(uint32_t));
+  for(std::size_t i = (offset_ / info.segment_size); i < entries.size(); i++)
+    {
+      l::Entry const &e = entries[i];
+
+      start = ((uint64_t)i * info.segment_size);
+      if(start >= end)
+        break;
+      if((start + e.bytes) > info.size)
+        throw fmt::exception("ERROR: container segment {} is corrupt",i);
+
+      words = ((e.bytes + 3) / sizeof(uint32_t));
+      rv = SimpleDecompress((void*)&src_[e.offset],e.words,buf.data(),words);
+      if(rv != (int)words)
+        throw fmt::exception("ERROR: container segment {} is corrupt",i);
+
+      skip = ((offset_ > start) ? (offset_ - start) : 0);
+      take = (std::min<uint64_t>(end - start,e.bytes) - skip);
+      l::write(dst_,(const uint8_t*)buf.data() + skip,take);
+      written += take;
+    }
+
+  return written;
+}
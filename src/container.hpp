@@ -0,0 +1,76 @@
+#pragma once
+
+#include "compress.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+/*
+ * Segmented container used by `compress --split`.
+ *
+ * The input is cut into fixed size segments which are compressed
+ * independently, each with a fresh window, so both compression and
+ * decompression can run one segment per core. All fields are big
+ * endian like the 3DO bitstream itself.
+ *
+ *   header   : magic '3CTC', version, segment size, reserved (u32 each)
+ *   segments : one complete word aligned 3DO stream per segment
+ *   index    : per segment u64 offset, u32 size in words,
+ *              u32 uncompressed size in bytes
+ *   trailer  : u64 index offset, u64 uncompressed size,
+ *              u32 segment count, magic '3CTI'
+ *
+ * The index also gives random access: decompress_range() decodes
+ * only the segments covering the requested bytes.
+ *
+ * A raw stream always starts with a literal, whose flag bit is the
+ * high bit of the first byte, so the header magic can never be
+ * mistaken for compressed data.
+ *
+ * Segments are at least a window long. Smaller ones would cost more
+ * in index entries and lost matches than they could save.
+ */
+#define CONTAINER_MAGIC         UINT32_C(0x33435443)
+#define CONTAINER_INDEX_MAGIC   UINT32_C(0x33435449)
+#define CONTAINER_VERSION       1
+#define CONTAINER_HEADER_SIZE   16
+#define CONTAINER_ENTRY_SIZE    16
+#define CONTAINER_TRAILER_SIZE  24
+#define CONTAINER_MIN_SEGMENT   4096
+
+namespace Container
+{
+  struct Info
+  {
+    std::size_t segment_size = 0;
+    std::size_t segments     = 0;
+    std::size_t size         = 0;
+  };
+
+  bool is_container(const uint8_t *data,
+                    std::size_t    size);
+
+  Info compress(const uint8_t               *src,
+                std::size_t                  src_size,
+                const std::filesystem::path &dst_filepath,
+                std::size_t                  segment_size,
+                int32_t                      level,
+                unsigned                     jobs,
+                CompressorStats             *stats  = NULL,
+                bool                         verify = false);
+
+  Info decompress(const uint8_t               *src,
+                  std::size_t                  src_size,
+                  const std::filesystem::path &dst_filepath,
+                  unsigned                     jobs);
+
+  // Writes up to length bytes of the uncompressed data starting at
+  // offset to dst and returns the number written
+  std::size_t decompress_range(const uint8_t *src,
+                               std::size_t    src_size,
+                               uint64_t       offset,
+                               uint64_t       length,
+                               FILE          *dst);
+}
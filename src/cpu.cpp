@@ -0,0 +1,68 @@
+#include "cpu.hpp"
+
+#include <atomic>
+
+static
+int
+detect_level(void)
+{
+#if CPU_MULTIVERSION
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2") &&
+     __builtin_cpu_supports("bmi") &&
+     __builtin_cpu_supports("bmi2"))
+    return CPU_LEVEL_AVX2;
+#endif
+
+  return CPU_LEVEL_BASELINE;
+}
+
+/* -1 until first used. Threads racing to set it all store the same. */
+static std::atomic<int> g_level{-1};
+
+int
+cpu_level_supported(void)
+{
+  static const int supported = detect_level();
+
+  return supported;
+}
+
+int
+cpu_level(void)
+{
+  int level;
+
+  level = g_level.load(std::memory_order_relaxed);
+  if(level < 0)
+    {
+      level = cpu_level_supported();
+      g_level.store(level,std::memory_order_relaxed);
+    }
+
+  return level;
+}
+
+int
+cpu_set_level(int level_)
+{
+  if((level_ < CPU_LEVEL_BASELINE) || (level_ > cpu_level_supported()))
+    return cpu_level();
+
+  g_level.store(level_,std::memory_order_relaxed);
+
+  return level_;
+}
+
+const char*
+cpu_level_name(int level_)
+{
+  switch(level_)
+    {
+    case CPU_LEVEL_AVX2:
+      return "avx2";
+    default:
+      return "baseline";
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * The release binaries are built for each platform's baseline, so on
+ * x86 the decode loops are also compiled for AVX2 with BMI1 and BMI2
+ * and used when the running CPU has them. The source is the same; the
+ * gain is in the bit buffer, where BMI2's flagless variable shifts
+ * shorten the dependency chain from one token to the next. The CPU is
+ * examined once. Other architectures only have the baseline, which on
+ * aarch64 already includes NEON.
+ */
+#define CPU_LEVEL_BASELINE 0
+#define CPU_LEVEL_AVX2     1
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_MULTIVERSION 1
+#define CPU_TARGET_AVX2  __attribute__((target("avx2,bmi,bmi2"),flatten))
+#else
+#define CPU_MULTIVERSION 0
+#endif
+
+/* The level dispatch picks */
+int         cpu_level(void);
+/* The best level this CPU supports */
+int         cpu_level_supported(void);
+/* Dispatch to level_ instead, if supported. Returns the level in use. */
+int         cpu_set_level(int level_);
+const char *cpu_level_name(int level_);
+
+/*
+ * Defines NAME, with the given return type, parameter list and
+ * arguments to pass on, calling the build of KERNEL for cpu_level().
+ * KERNEL should be inline so the baseline build of it is inlined into
+ * NAME and the AVX2 build, along with everything it calls, into
+ * NAME_avx2.
+ */
+#if CPU_MULTIVERSION
+#define CPU_DISPATCH(RET,NAME,KERNEL,PARAMS,ARGS)       \
+  static CPU_TARGET_AVX2 RET NAME##_avx2 PARAMS         \
+  { return KERNEL ARGS; }                               \
+  static RET NAME PARAMS                                \
+  {                                                     \
+    if(cpu_level() == CPU_LEVEL_AVX2)                   \
+      return NAME##_avx2 ARGS;                          \
+    return KERNEL ARGS;                                 \
+  }
+#else
+#define CPU_DISPATCH(RET,NAME,KERNEL,PARAMS,ARGS)       \
+  static RET NAME PARAMS                                \
+  { return KERNEL ARGS; }
+#endif
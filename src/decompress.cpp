@@ -1,11 +1,15 @@
-#include "byteswap.hpp"
+#include "alloc.hpp"
+#include "cpu.hpp"
+#include "decompress.hpp"
 #include "errors.hpp"
 #include "lzss.h"
+#include "lzss.hpp"
 #include "types.hpp"
 
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 /*****************************************************************************/
 
@@ -20,204 +24,238 @@
 /*****************************************************************************/
 
 
-typedef struct DecompressBitStream
-{
-  uint32_t *bs_Data;
-  uint32_t  bs_NumDataWords;
-  uint32_t  bs_BitsLeft;
-  uint32_t  bs_BitBuffer;
-  bool      bs_Error;
-} DecompressBitStream;
-
-
-/*****************************************************************************/
+typedef Lzss<INDEX_BIT_COUNT,LENGTH_BIT_COUNT,BREAK_EVEN> Sdk;
 
+static_assert(Sdk::WindowSize == WINDOW_SIZE, "lzss.h and Sdk disagree");
+static_assert(Sdk::DictionarySize == COMP_DICTIONARY_SIZE, "types.hpp and Sdk disagree");
 
-typedef void (*CompFuncClone)(void *userData, uint32_t word);
-
+/* Output is batched in dh_Span[] like the compressor's. The decoder
+ * writes bytes straight into it, which leaves them in the stream's
+ * big endian word order without packing or swapping each word.
+ * dh_SpanBytes counts them, including those of a partial last word.
+ */
 typedef struct Decompressor
 {
   CompFuncClone        dh_OutputWord;
+  CompSpanFunc         dh_OutputSpan;
   void                *dh_UserData;
-  uint32_t             dh_WordBuffer;
-  uint32_t             dh_BytesLeft;
   uint32_t             dh_Pos;
   unsigned char        dh_Window[WINDOW_SIZE];
   DecompressBitStream  dh_BitStream;
+  DecompressorStats   *dh_Stats;
+  int                  dh_Result;
+  bool                 dh_Finished;
+  bool                 dh_Strict;
+  bool                 dh_EndOfStream;
+  uint64_t             dh_Limit;
+  uint64_t             dh_Written;
+  uint32_t             dh_History;
+  uint64_t             dh_WordsFed;
   bool                 dh_AllocatedStructure;
+  CompAllocator        dh_Allocator;
   void                *dh_Cookie;
+  uint32_t             dh_SpanBytes;
+  uint32_t             dh_Span[SPAN_WORDS];
 } Decompressor;
 
 
 /*****************************************************************************/
 
 
-static void InitBitStream(DecompressBitStream *bs)
+/* Deliver the complete words. The bytes of a partial word are kept
+ * at the start of the span for the next feed to complete.
+ */
+static
+void
+FlushOutput(Decompressor *decomp)
 {
-  bs->bs_BitsLeft  = 0;
-  bs->bs_BitBuffer = 0;
-  bs->bs_Error     = false;
-}
+  uint32_t i;
+  uint32_t numWords;
+  uint32_t partial;
 
+  numWords = (decomp->dh_SpanBytes / sizeof(uint32_t));
+  partial  = (decomp->dh_SpanBytes % sizeof(uint32_t));
+  if (!numWords)
+    return;
 
-/*****************************************************************************/
-
+  if (decomp->dh_OutputSpan)
+    (*decomp->dh_OutputSpan)(decomp->dh_UserData, decomp->dh_Span, numWords);
+  else
+    for (i = 0; i < numWords; i++)
+      (*decomp->dh_OutputWord)(decomp->dh_UserData, decomp->dh_Span[i]);
 
-static void FeedBitStream(DecompressBitStream *bs, const void *data, uint32_t numDataWords)
-{
-  bs->bs_Data         = (uint32_t *)data;
-  bs->bs_NumDataWords = numDataWords;
+  if (partial)
+    memcpy(decomp->dh_Span, &decomp->dh_Span[numWords], partial);
+  decomp->dh_SpanBytes = partial;
 }
 
 
 /*****************************************************************************/
 
 
-static uint32_t ReadBits(DecompressBitStream *bs, uint32_t numBits)
+static
+inline
+uint32_t
+OffsetBucket(uint32_t dist)
 {
-  uint32_t result;
+  uint32_t bucket;
 
-  result = 0;
+  for(bucket = 0; dist >>= 1; bucket++)
+    ;
 
-  if (numBits > bs->bs_BitsLeft)
-    {
-      if (bs->bs_BitsLeft)
-        {
-          result = (bs->bs_BitBuffer << (numBits - bs->bs_BitsLeft)) & ((1 << numBits) - 1);
-          numBits -= bs->bs_BitsLeft;
-        }
-
-      if (!bs->bs_NumDataWords)
-        {
-          bs->bs_Error = true;
-          return (0);
-        }
-
-      bs->bs_NumDataWords--;
-      bs->bs_BitBuffer = ::byteswap_if_little_endian(*bs->bs_Data++);
-      bs->bs_BitsLeft  = 32;
-    }
-
-  bs->bs_BitsLeft -= numBits;
-  result |= (bs->bs_BitBuffer >> bs->bs_BitsLeft) & ((1 << numBits) - 1);
-
-  return (result);
+  return (bucket);
 }
 
 
 /*****************************************************************************/
 
 
+/* The Sink handed to Sdk::decode(). Output bytes go to the span and
+ * the stats are counted as tokens are decoded. The span's length is
+ * kept here while decoding and written back after.
+ */
+struct DecompSink
+{
+  Decompressor      *ds_Decomp;
+  DecompressorStats *ds_Stats;
+  uint8_t           *ds_Span;
+  uint32_t           ds_SpanBytes;
+
+  void
+  put(uint32_t c)
+  {
+    ds_Span[ds_SpanBytes++] = (uint8_t)c;
+    if (ds_SpanBytes == sizeof(ds_Decomp->dh_Span))
+      {
+        ds_Decomp->dh_SpanBytes = ds_SpanBytes;
+        FlushOutput(ds_Decomp);
+        ds_SpanBytes = 0;
+      }
+  }
+
+  void
+  literal()
+  {
+    if (ds_Stats)
+      ds_Stats->ds_Literals++;
+  }
+
+  void
+  phrase(uint32_t len,
+         uint32_t dist)
+  {
+    if (!ds_Stats)
+      return;
+
+    ds_Stats->ds_Phrases++;
+    ds_Stats->ds_PhraseLengths[len]++;
+    ds_Stats->ds_PhraseOffsets[OffsetBucket(dist ? dist : WINDOW_SIZE)]++;
+  }
+};
+
+
 /* All this decompression routine has to do is read in flag bits, decide
  * whether to read in a character or an index/length pair, and take the
- * appropriate action.
+ * appropriate action. That loop is Sdk::decode(), or Sdk::decode_strict()
+ * in strict mode, where the first bad token fails the stream and
+ * anything fed after it is ignored. Both return 1 at the end of
+ * stream marker. Decode() runs the build of them for this CPU, see
+ * cpu.hpp.
  */
 
+static
+inline
+int
+DecodeKernel(Decompressor        *decomp,
+             DecompSink          &sink,
+             DecompressBitStream *bs)
+{
+  if (decomp->dh_Strict)
+    return Sdk::decode_strict(sink, bs, decomp->dh_Window, &decomp->dh_Pos,
+                              &decomp->dh_Written, decomp->dh_History,
+                              decomp->dh_Limit);
+
+  return (Sdk::decode(sink, bs, decomp->dh_Window, &decomp->dh_Pos) ? 1 : 0);
+}
+
+CPU_DISPATCH(int, Decode, DecodeKernel,
+             (Decompressor *decomp, DecompSink &sink, DecompressBitStream *bs),
+             (decomp, sink, bs))
+
 static
 int
 internalFeedDecompressor(Decompressor *decomp,
                          void         *data,
                          uint32_t      numDataWords)
 {
-  uint32_t       i;
-  uint32_t       pos;
-  uint32_t       c;
-  uint32_t       matchLen;
-  uint32_t       matchPos;
-  DecompressBitStream     *bs;
-  uint32_t       wordBuffer;
-  uint32_t       bytesLeft;
-  CompFunc       cf;
-  unsigned char *window;
-  void          *userData;
+  int                  rv;
+  DecompSink           sink;
+  DecompressBitStream *bs;
+
+  if (decomp->dh_Result < 0)
+    return (decomp->dh_Result);
+
+  /* Whatever follows the end of stream marker, in the feed it was in
+   * or a later one, is left undecoded so the output doesn't depend on
+   * how the input was split. It is only kept for FinishStream() to
+   * report COMP_ERR_DATAREMAINS.
+   */
+  if (decomp->dh_EndOfStream)
+    {
+      if (numDataWords)
+        FeedBitStream(&decomp->dh_BitStream, data, numDataWords);
+      decomp->dh_WordsFed += numDataWords;
+      return (0);
+    }
 
-  cf         = decomp->dh_OutputWord;
-  wordBuffer = decomp->dh_WordBuffer;
-  bytesLeft  = decomp->dh_BytesLeft;
-  window     = decomp->dh_Window;
-  userData   = decomp->dh_UserData;
-  bs         = &decomp->dh_BitStream;
-  pos        = decomp->dh_Pos;
+  sink.ds_Decomp     = decomp;
+  sink.ds_Stats      = decomp->dh_Stats;
+  sink.ds_Span       = (uint8_t*)decomp->dh_Span;
+  sink.ds_SpanBytes  = decomp->dh_SpanBytes;
+  bs                 = &decomp->dh_BitStream;
 
   FeedBitStream(bs, data, numDataWords);
+  decomp->dh_WordsFed += numDataWords;
 
-  while (bs->bs_NumDataWords)
-    {
-      if (ReadBits(bs,1))
-        {
-          c = ReadBits(bs, 8);
-          if (bytesLeft == 0)
-            {
-              (*cf)(userData,::byteswap_if_little_endian(wordBuffer));
-              wordBuffer = c;
-              bytesLeft  = 3;
-            }
-          else
-            {
-              wordBuffer = (wordBuffer << 8) | c;
-              bytesLeft--;
-            }
-
-          window[pos] = (unsigned char) c;
-          pos = MOD_WINDOW(pos + 1);
-        }
-      else
-        {
-          matchPos = ReadBits(bs, INDEX_BIT_COUNT);
-          if (matchPos == END_OF_STREAM)
-            break;
-
-          matchLen = ReadBits(bs, LENGTH_BIT_COUNT) + BREAK_EVEN;
-
-          for (i = matchPos; i <= matchLen + matchPos; i++)
-            {
-              c = window[MOD_WINDOW(i)];
-
-              if (bytesLeft == 0)
-                {
-                  (*cf)(userData,::byteswap_if_little_endian(wordBuffer));
-                  wordBuffer = c;
-                  bytesLeft  = 3;
-                }
-              else
-                {
-                  wordBuffer = (wordBuffer << 8) | c;
-                  bytesLeft--;
-                }
-
-              window[pos] = (unsigned char) c;
-              pos = MOD_WINDOW(pos + 1);
-            }
-        }
-    }
+  rv = Decode(decomp, sink, bs);
+  if (rv > 0)
+    decomp->dh_EndOfStream = true;
+  if (rv < 0)
+    decomp->dh_Result = rv;
 
-  decomp->dh_BytesLeft  = bytesLeft;
-  decomp->dh_WordBuffer = wordBuffer;
-  decomp->dh_Pos        = pos;
+  decomp->dh_SpanBytes = sink.ds_SpanBytes;
 
-  return (0);
+  FlushOutput(decomp);
+
+  if (sink.ds_Stats)
+    sink.ds_Stats->ds_WordsRead += (numDataWords - bs->bs_NumDataWords);
+
+  return ((rv < 0) ? rv : 0);
 }
 
 
 /*****************************************************************************/
 
 
+static
 int
-CreateDecompressor(Decompressor **decomp,
-                   CompFunc cf,
-                   void *workbuf_,
-                   void *userdata_)
+internalCreateDecompressor(Decompressor **decomp,
+                           CompFunc       cf,
+                           CompSpanFunc   sf,
+                           void          *workbuf_,
+                           void          *userdata_)
 {
-  bool    allocated;
-  void   *buffer;
-  void   *userData;
+  bool           allocated;
+  void          *buffer;
+  void          *userData;
+  CompAllocator  alloc;
 
   if (!decomp)
     return COMP_ERR_BADPTR;
 
   *decomp = NULL;
 
-  if(!cf)
+  if(!cf && !sf)
     return (COMP_ERR_BADPTR);
 
   buffer   = NULL;
@@ -225,49 +263,97 @@ CreateDecompressor(Decompressor **decomp,
 
   buffer = workbuf_;
   userData = userdata_;
+  alloc = CurrentCompAllocator();
 
   allocated = false;
   if (!buffer)
     {
-      buffer = calloc(1,sizeof(Decompressor));
+      buffer = CompAlloc(&alloc,sizeof(Decompressor));
       if (!buffer)
         return COMP_ERR_NOMEM;
 
+      memset(buffer,0,sizeof(Decompressor));
+
       allocated = true;
     }
 
   (*decomp)                        = (Decompressor *)buffer;
   (*decomp)->dh_OutputWord         = cf;
+  (*decomp)->dh_OutputSpan         = sf;
+  (*decomp)->dh_SpanBytes          = 0;
   (*decomp)->dh_UserData           = userData;
-  (*decomp)->dh_WordBuffer         = 0;
-  (*decomp)->dh_BytesLeft          = 4;
   (*decomp)->dh_Pos                = 1;
+  (*decomp)->dh_Stats              = NULL;
+  (*decomp)->dh_Result             = 0;
+  (*decomp)->dh_Finished           = false;
+  (*decomp)->dh_Strict             = false;
+  (*decomp)->dh_EndOfStream        = false;
+  (*decomp)->dh_Limit              = 0;
+  (*decomp)->dh_Written            = 0;
+  (*decomp)->dh_History            = 0;
+  (*decomp)->dh_WordsFed           = 0;
   (*decomp)->dh_Cookie             = *decomp;
   (*decomp)->dh_AllocatedStructure = allocated;
+  (*decomp)->dh_Allocator          = alloc;
   InitBitStream(&(*decomp)->dh_BitStream);
 
   return (0);
 }
 
 
-/*****************************************************************************/
+int
+CreateDecompressor(Decompressor **decomp,
+                   CompFunc cf,
+                   void *workbuf_,
+                   void *userdata_)
+{
+  if (!cf)
+    return (COMP_ERR_BADPTR);
+
+  return (internalCreateDecompressor(decomp, cf, NULL, workbuf_, userdata_));
+}
 
 
+/* Like CreateDecompressor() but output is delivered in spans of words */
 int
-DeleteDecompressor(Decompressor *decomp)
+CreateDecompressorSpan(Decompressor **decomp,
+                       CompSpanFunc   sf,
+                       void          *workbuf_,
+                       void          *userdata_)
 {
-  int result;
-
-  if (!decomp || (decomp->dh_Cookie != decomp))
+  if (!sf)
     return (COMP_ERR_BADPTR);
 
-  decomp->dh_Cookie = NULL;
+  return (internalCreateDecompressor(decomp, NULL, sf, workbuf_, userdata_));
+}
+
+
+/*****************************************************************************/
+
+
+/* Output any pending complete words and work out how the stream ended */
+static
+int
+FinishStream(Decompressor *decomp)
+{
+  int                result;
+  uint32_t           i;
+  uint64_t           bytes;
+  DecompressorStats *stats;
 
   result = 0;
 
-  if (decomp->dh_BytesLeft == 0)
-    (*decomp->dh_OutputWord)(decomp->dh_UserData,
-                             ::byteswap_if_little_endian(decomp->dh_WordBuffer));
+  FlushOutput(decomp);
+
+  /* Only complete words are ever output */
+  stats = decomp->dh_Stats;
+  if (stats)
+    {
+      bytes = stats->ds_Literals;
+      for (i = 0; i < STATS_LENGTH_COUNT; i++)
+        bytes += (i * stats->ds_PhraseLengths[i]);
+      stats->ds_WordsWritten = (bytes / sizeof(uint32_t));
+    }
 
   if (decomp->dh_BitStream.bs_NumDataWords)
     result = COMP_ERR_DATAREMAINS;
@@ -275,8 +361,124 @@ DeleteDecompressor(Decompressor *decomp)
   if (decomp->dh_BitStream.bs_Error)
     result = COMP_ERR_DATAMISSING;
 
+  /* In strict mode a stream must end with the marker and the first
+   * failure is the one reported
+   */
+  if (decomp->dh_Strict && !decomp->dh_EndOfStream && !result &&
+      !Sdk::buffered_end_of_stream(&decomp->dh_BitStream))
+    result = COMP_ERR_DATAMISSING;
+
+  if (decomp->dh_Result < 0)
+    result = decomp->dh_Result;
+
+  decomp->dh_Result   = result;
+  decomp->dh_Finished = true;
+
+  return (result);
+}
+
+
+/*****************************************************************************/
+
+
+/* Finish the current stream, returning what DeleteDecompressor() would */
+int
+FinishDecompressor(Decompressor *decomp)
+{
+  if (!decomp || (decomp->dh_Cookie != decomp))
+    return (COMP_ERR_BADPTR);
+
+  if (decomp->dh_Finished)
+    return (decomp->dh_Result);
+
+  return (FinishStream(decomp));
+}
+
+
+/*****************************************************************************/
+
+
+/* Prepare the decompressor for a new stream without reallocating it.
+ * Anything not yet finished is discarded. The window is cleared so
+ * the new stream decodes exactly as it would with a freshly allocated
+ * decompressor. Attached stats and the strict mode settings are kept.
+ */
+static
+int
+internalResetDecompressor(Decompressor *decomp,
+                          CompFunc      cf,
+                          CompSpanFunc  sf,
+                          void         *userData)
+{
+  if (!decomp || (decomp->dh_Cookie != decomp))
+    return (COMP_ERR_BADPTR);
+
+  if (!cf && !sf)
+    return (COMP_ERR_BADPTR);
+
+  memset(decomp->dh_Window, 0, sizeof(decomp->dh_Window));
+
+  decomp->dh_OutputWord = cf;
+  decomp->dh_OutputSpan = sf;
+  decomp->dh_SpanBytes  = 0;
+  decomp->dh_UserData   = userData;
+  decomp->dh_Pos        = 1;
+  decomp->dh_Result     = 0;
+  decomp->dh_Finished   = false;
+  decomp->dh_EndOfStream = false;
+  decomp->dh_Written    = 0;
+  decomp->dh_History    = 0;
+  decomp->dh_WordsFed   = 0;
+  InitBitStream(&decomp->dh_BitStream);
+
+  return (0);
+}
+
+
+int
+ResetDecompressor(Decompressor *decomp,
+                  CompFunc      cf,
+                  void         *userData)
+{
+  if (!cf)
+    return (COMP_ERR_BADPTR);
+
+  return (internalResetDecompressor(decomp, cf, NULL, userData));
+}
+
+
+int
+ResetDecompressorSpan(Decompressor *decomp,
+                      CompSpanFunc  sf,
+                      void         *userData)
+{
+  if (!sf)
+    return (COMP_ERR_BADPTR);
+
+  return (internalResetDecompressor(decomp, NULL, sf, userData));
+}
+
+
+/*****************************************************************************/
+
+
+int
+DeleteDecompressor(Decompressor *decomp)
+{
+  int result;
+
+  if (!decomp || (decomp->dh_Cookie != decomp))
+    return (COMP_ERR_BADPTR);
+
+  decomp->dh_Cookie = NULL;
+
+  if (decomp->dh_Finished)
+    result = decomp->dh_Result;
+  else
+    result = FinishStream(decomp);
+
   if (decomp->dh_AllocatedStructure)
-    free(decomp);
+    CompFree(&decomp->dh_Allocator,decomp);
 
   return (result);
 }
@@ -290,6 +492,9 @@ int FeedDecompressor(Decompressor *decomp, void *data, uint32_t numDataWords)
   if (!decomp || (decomp->dh_Cookie != decomp))
     return (COMP_ERR_BADPTR);
 
+  if (decomp->dh_Finished)
+    return (COMP_ERR_BADTAG);
+
   return (internalFeedDecompressor(decomp, data, numDataWords));
 }
 
@@ -297,6 +502,95 @@ int FeedDecompressor(Decompressor *decomp, void *data, uint32_t numDataWords)
 /*****************************************************************************/
 
 
+/* Attach counters to the decompressor. They are cleared here and left
+ * attached until the decompressor is deleted. Pass NULL to detach.
+ */
+int
+SetDecompressorStats(Decompressor      *decomp,
+                     DecompressorStats *stats)
+{
+  if (!decomp || (decomp->dh_Cookie != decomp))
+    return (COMP_ERR_BADPTR);
+
+  if (stats)
+    memset(stats, 0, sizeof(DecompressorStats));
+
+  decomp->dh_Stats = stats;
+
+  return (0);
+}
+
+
+/* Preset the window as the compressor's was. Only valid before the
+ * first feed.
+ */
+int
+SetDecompressorDictionary(Decompressor *decomp,
+                          const void   *dict,
+                          uint32_t      numDictBytes)
+{
+  if (!decomp || (decomp->dh_Cookie != decomp))
+    return (COMP_ERR_BADPTR);
+
+  if (numDictBytes && !dict)
+    return (COMP_ERR_BADPTR);
+
+  if (decomp->dh_WordsFed || decomp->dh_Finished)
+    return (COMP_ERR_BADTAG);
+
+  decomp->dh_History = Sdk::load_dictionary(decomp->dh_Window, false, (const uint8_t*)dict, numDictBytes);
+
+  return (0);
+}
+
+
+/* Turn on strict mode, see decompress.hpp. Like the dictionary it
+ * must be set before the first feed so every byte written to the
+ * window is accounted for.
+ */
+int
+SetDecompressorStrict(Decompressor *decomp,
+                      uint64_t      maxOutputWords)
+{
+  if (!decomp || (decomp->dh_Cookie != decomp))
+    return (COMP_ERR_BADPTR);
+
+  if (decomp->dh_WordsFed || decomp->dh_Finished)
+    return (COMP_ERR_BADTAG);
+
+  decomp->dh_Strict = true;
+  decomp->dh_Limit  = 0;
+
+  /* The bytes past the last complete word are dropped, not output */
+  if (maxOutputWords)
+    decomp->dh_Limit = ((maxOutputWords * sizeof(uint32_t)) + (sizeof(uint32_t) - 1));
+
+  return (0);
+}
+
+
+/* The bit offset, from the start of the stream, of the next token to
+ * be decoded. After a strict mode failure that is the token at fault.
+ */
+int
+GetDecompressorPosition(Decompressor *decomp,
+                        uint64_t     *bitOffset)
+{
+  DecompressBitStream *bs;
+
+  if (!decomp || (decomp->dh_Cookie != decomp) || !bitOffset)
+    return (COMP_ERR_BADPTR);
+
+  bs = &decomp->dh_BitStream;
+  *bitOffset = (((decomp->dh_WordsFed - bs->bs_NumDataWords) * 32) - bs->bs_BitsLeft);
+
+  return (0);
+}
+
+
+/*****************************************************************************/
+
+
 int32_t
 GetDecompressorWorkBufferSize()
 {
@@ -304,54 +598,62 @@ GetDecompressorWorkBufferSize()
 }
 
 
-struct Context
+/*****************************************************************************/
+
+
+/* The flat buffer decoders, likewise built for each CPU level */
+CPU_DISPATCH(int, StrictDecode, Sdk::strict_decompress,
+             (const uint32_t *source, uint32_t sourceWords, uint8_t *result,
+              uint32_t resultWords, uint32_t *streamWords, uint64_t *errorBit),
+             (source, sourceWords, result, resultWords, streamWords, errorBit))
+
+CPU_DISPATCH(int, SimpleDecode, Sdk::simple_decompress,
+             (const uint32_t *source, uint32_t sourceWords, uint8_t *result,
+              uint32_t resultWords),
+             (source, sourceWords, result, resultWords))
+
+int32_t
+GetDecompressedSize(const void *source,
+                    uint32_t    sourceWords)
 {
-  uint32_t *dest;
-  uint32_t *max;
-  bool      overflow;
-};
+  if (!source && sourceWords)
+    return (COMP_ERR_BADPTR);
 
+  return (Sdk::decoded_size((const uint32_t*)source, sourceWords));
+}
 
-static
-void
-PutWord(Context  *ctx_,
-        uint32_t  word_)
+
+int
+StrictDecompress(const void *source,
+                 uint32_t    sourceWords,
+                 void       *result,
+                 uint32_t    resultWords,
+                 uint32_t   *streamWords,
+                 uint64_t   *errorBit)
 {
-  if(ctx_->dest >= ctx_->max)
-    ctx_->overflow = true;
-  else
-    *ctx_->dest++ = word_;
+  if ((!source && sourceWords) || (!result && resultWords))
+    return (COMP_ERR_BADPTR);
+
+  return (StrictDecode((const uint32_t*)source,
+                       sourceWords,
+                       (uint8_t*)result,
+                       resultWords,
+                       streamWords,
+                       errorBit));
 }
 
 
+/* SimpleDecompress() doesn't need the ring window or the per-word
+ * output callback so it takes the flat buffer path in lzss.hpp.
+ */
 int
 SimpleDecompress(void     *source_,
                  uint32_t  sourceWords_,
                  void     *result_,
                  uint32_t  resultWords_)
 {
-  Decompressor *decomp;
-  Context       ctx;
-  int           err;
-
-  ctx.dest     = (uint32_t*)result_;
-  ctx.max      = (uint32_t*)((uint64_t)result_ + resultWords_ * sizeof(uint32_t));
-  ctx.overflow = false;
-
-  err = CreateDecompressor(&decomp,(CompFunc)PutWord,NULL,&ctx);
-  if(err < 0)
-    return err;
-
-  FeedDecompressor(decomp,source_,sourceWords_);
-  err = DeleteDecompressor(decomp);
-
-  if (err == 0)
-    {
-      if (ctx.overflow)
-        err = COMP_ERR_OVERFLOW;
-      else
-        err = ((uint64_t)ctx.dest - (uint64_t)result_) / sizeof(uint32_t);
-    }
-
-  return err;
+  return SimpleDecode((const uint32_t*)source_,
+                      sourceWords_,
+                      (uint8_t*)result_,
+                      resultWords_);
 }
@@ -1,15 +1,88 @@
 #pragma once
 
+#include "alloc.hpp"
+#include "api.hpp"
 #include "errors.hpp"
 #include "types.hpp"
 
-#include <cstdint>
+#include <stdint.h>
+
+COMP_EXTERN_C_BEGIN
 
 typedef struct Decompressor Decompressor;
 
-int CreateDecompressor(Decompressor **decomp, CompFunc cf, void *workbuf, void *userdata);
-int DeleteDecompressor(Decompressor *decomp);
-int FeedDecompressor(Decompressor *decomp, void *data, uint32_t numDataWords);
-int32_t GetDecompressorWorkBufferSize();
+/*
+ * Optional counters filled in by the streaming decompressor. Attach
+ * with SetDecompressorStats(). SimpleDecompress() doesn't collect
+ * stats.
+ */
+typedef struct DecompressorStats
+{
+  uint64_t ds_Literals;
+  uint64_t ds_Phrases;
+  uint64_t ds_PhraseLengths[STATS_LENGTH_COUNT];
+  uint64_t ds_PhraseOffsets[STATS_OFFSET_COUNT];
+  uint64_t ds_WordsRead;
+  uint64_t ds_WordsWritten;
+} DecompressorStats;
+
+/*
+ * FinishDecompressor() ends the current stream and returns what
+ * DeleteDecompressor() would; ResetDecompressor() then starts a new
+ * stream on the same context. The *Span variants deliver output
+ * through a CompSpanFunc instead of one call per word.
+ *
+ * A stream compressed with a preset dictionary needs the same
+ * dictionary set with SetDecompressorDictionary() before the first
+ * feed. Like the window it is discarded by a reset.
+ *
+ * By default the decoder, like the SDK's, decodes whatever it is fed.
+ * SetDecompressorStrict(), called before the first feed, makes it stop
+ * at the first token that can't be part of a valid stream: a phrase
+ * reaching back before the start of the stream and any dictionary
+ * (COMP_ERR_BADREF) or output of more than maxOutputWords words, if not
+ * 0 (COMP_ERR_OVERFLOW). That feed and every later one returns the
+ * error, as do FinishDecompressor() and DeleteDecompressor(), which also
+ * return COMP_ERR_DATAMISSING for a stream without an end of stream
+ * marker. GetDecompressorPosition() then gives the bit offset of the
+ * token at fault.
+ */
+COMP_API int CreateDecompressor(Decompressor **decomp, CompFunc cf, void *workbuf, void *userdata);
+COMP_API int CreateDecompressorSpan(Decompressor **decomp, CompSpanFunc sf, void *workbuf, void *userdata);
+COMP_API int DeleteDecompressor(Decompressor *decomp);
+COMP_API int FinishDecompressor(Decompressor *decomp);
+COMP_API int ResetDecompressor(Decompressor *decomp, CompFunc cf, void *userdata);
+COMP_API int ResetDecompressorSpan(Decompressor *decomp, CompSpanFunc sf, void *userdata);
+COMP_API int FeedDecompressor(Decompressor *decomp, void *data, uint32_t numDataWords);
+COMP_API int SetDecompressorStats(Decompressor *decomp, DecompressorStats *stats);
+COMP_API int SetDecompressorDictionary(Decompressor *decomp, const void *dict, uint32_t numDictBytes);
+COMP_API int SetDecompressorStrict(Decompressor *decomp, uint64_t maxOutputWords);
+COMP_API int GetDecompressorPosition(Decompressor *decomp, uint64_t *bitOffset);
+COMP_API int32_t GetDecompressorWorkBufferSize(void);
+
+/*
+ * GetDecompressedSize() returns the number of words SimpleDecompress()
+ * will produce for a stream, or the error it will return, by walking
+ * the tokens without decoding them. It costs less than decompressing,
+ * much less for well compressed data, and lets the output be
+ * allocated exactly once.
+ */
+COMP_API int32_t GetDecompressedSize(const void *source, uint32_t sourceWords);
+
+COMP_API int SimpleDecompress(void *source, uint32_t sourceWords, void *result, uint32_t resultWords);
+
+/*
+ * StrictDecompress() is SimpleDecompress() for input that may not be a
+ * stream at all, such as candidate offsets in a disc image. Rather than
+ * decoding to the end of the input it fails at the first phrase
+ * reaching back before the start of the stream (COMP_ERR_BADREF), at
+ * the first token that would make the output more than resultWords
+ * (COMP_ERR_OVERFLOW) and when the input ends before the end of stream
+ * marker (COMP_ERR_DATAMISSING), setting *errorBit to the bit offset of
+ * the token at fault. Data after the marker is not an error; the words
+ * the stream occupied are returned in *streamWords. Either pointer may
+ * be NULL. Garbage usually fails within a few tokens.
+ */
+COMP_API int StrictDecompress(const void *source, uint32_t sourceWords, void *result, uint32_t resultWords, uint32_t *streamWords, uint64_t *errorBit);
 
-int SimpleDecompress(void *source, uint32_t sourceWords, void *result, uint32_t resultWords);
+COMP_EXTERN_C_END
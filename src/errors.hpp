@@ -6,3 +6,4 @@
 #define COMP_ERR_DATAREMAINS -4
 #define COMP_ERR_DATAMISSING -5
 #define COMP_ERR_OVERFLOW -6
+#define COMP_ERR_BADREF -7
@@ -0,0 +1,102 @@
+#include "json.hpp"
+
+#include "fmt.hpp"
+
+#include <cmath>
+
+JsonObject&
+JsonObject::add(std::string const &key_,
+                std::string const &value_)
+{
+  return add_raw(key_,JsonObject::quote(value_));
+}
+
+JsonObject&
+JsonObject::add(std::string const &key_,
+                const char        *value_)
+{
+  return add_raw(key_,JsonObject::quote(value_));
+}
+
+JsonObject&
+JsonObject::add(std::string const &key_,
+                bool               value_)
+{
+  return add_raw(key_,(value_ ? "true" : "false"));
+}
+
+JsonObject&
+JsonObject::add(std::string const &key_,
+                double             value_)
+{
+  if(!std::isfinite(value_))
+    return add_raw(key_,"null");
+
+  return add_raw(key_,fmt::format("{:.9g}",value_));
+}
+
+JsonObject&
+JsonObject::add(std::string const &key_,
+                JsonObject const  &value_)
+{
+  return add_raw(key_,value_.str());
+}
+
+JsonObject&
+JsonObject::add_raw(std::string const &key_,
+                    std::string const &json_)
+{
+  if(!_members.empty())
+    _members += ',';
+  _members += JsonObject::quote(key_);
+  _members += ':';
+  _members += json_;
+
+  return *this;
+}
+
+std::string
+JsonObject::str() const
+{
+  return ('{' + _members + '}');
+}
+
+// Bytes 0x80 and up are passed through, so UTF-8 stays UTF-8
+std::string
+JsonObject::quote(std::string const &s_)
+{
+  std::string rv;
+
+  rv.reserve(s_.size() + 2);
+  rv += '"';
+  for(unsigned char c : s_)
+    {
+      switch(c)
+        {
+        case '"':
+          rv += "\\\"";
+          break;
+        case '\\':
+          rv += "\\\\";
+          break;
+        case '\n':
+          rv += "\\n";
+          break;
+        case '\r':
+          rv += "\\r";
+          break;
+        case '\t':
+          rv += "\\t";
+          break;
+        default:
+          if(c < 0x20)
+            rv += fmt::format("\\u{:04x}",c);
+          else
+            rv += (char)c;
+          break;
+        }
+    }
+  rv += '"';
+
+  return rv;
+}
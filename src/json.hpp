@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+/*
+ * Builds a JSON object a member at a time, in the order added, for
+ * the machine readable reports. Strings are escaped, doubles are given
+ * to 9 significant digits or as null if they aren't finite and nested
+ * objects are added whole. str() is the object on a single line.
+ */
+class JsonObject
+{
+public:
+  JsonObject& add(std::string const &key, std::string const &value);
+  JsonObject& add(std::string const &key, const char *value);
+  JsonObject& add(std::string const &key, bool value);
+  JsonObject& add(std::string const &key, double value);
+  JsonObject& add(std::string const &key, JsonObject const &value);
+
+  template<typename T>
+  typename std::enable_if<std::is_integral<T>::value,JsonObject&>::type
+  add(std::string const &key_,
+      T                  value_)
+  {
+    if(std::is_signed<T>::value)
+      return add_raw(key_,std::to_string((int64_t)value_));
+    return add_raw(key_,std::to_string((uint64_t)value_));
+  }
+
+public:
+  bool        empty() const { return _members.empty(); }
+  std::string str() const;
+
+public:
+  static std::string quote(std::string const &s);
+
+private:
+  JsonObject& add_raw(std::string const &key, std::string const &json);
+
+private:
+  std::string _members;
+};
@@ -11,6 +11,10 @@
  * index used to flag the fact that the file has been completely encoded, and
  * there is no more data. MOD_WINDOW() is a macro used to perform arithmetic
  * on tree indices.
+ *
+ * These are the SDK's parameters. The codec itself is the Lzss<>
+ * template in lzss.hpp, which compress.cpp and decompress.cpp
+ * instantiate with them.
  */
 
 #define INDEX_BIT_COUNT  12
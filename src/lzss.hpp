@@ -0,0 +1,1627 @@
+#pragma once
+
+#include "byteswap.hpp"
+#include "errors.hpp"
+#include "types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * The LZSS codec parameterised over its field widths. A phrase is a 0
+ * flag bit, an IndexBits window position and a LengthBits length
+ * biased by BreakEvenBytes + 1; a literal is a 1 flag bit and 8 bits of
+ * data. Index 0 marks the end of the stream. Bits are packed MSB first
+ * into big endian 32 bit words.
+ *
+ * The 3DO SDK format is Lzss<12,4,2> (see lzss.h), which is what the
+ * Compressor and Decompressor APIs instantiate. Other widths get the
+ * same algorithms with every mask, shift and loop bound known at
+ * compile time. The match finder routines and the encode and decode
+ * loops are exposed so the C API can layer its levels and stats on
+ * top; Lzss<>::Encoder and Lzss<>::Decoder bundle them into a plain
+ * streaming codec and simple_decompress() decodes a whole buffer.
+ */
+
+
+/*****************************************************************************/
+
+
+typedef void (*CompFuncClone)(void *userData, uint32_t word);
+
+/*
+ * Completed words are collected in bs_Span[] and handed to the output
+ * callback when it fills up and at the end of every call into the
+ * compressor, either as one span or a word at a time. They are kept
+ * in host order and swapped to the stream's big endian order a span
+ * at a time just before they are handed over.
+ */
+#define SPAN_WORDS 256
+
+typedef struct CompressBitStream
+{
+  CompFuncClone  bs_OutputWord;
+  CompSpanFunc   bs_OutputSpan;
+  void          *bs_UserData;
+  uint32_t       bs_BitsLeft;
+  uint32_t       bs_BitBuffer;
+  uint64_t       bs_WordsWritten;
+  uint32_t       bs_SpanLen;
+  uint32_t       bs_Span[SPAN_WORDS];
+} CompressBitStream;
+
+typedef struct DecompressBitStream
+{
+  uint32_t *bs_Data;
+  uint32_t  bs_NumDataWords;
+  uint32_t  bs_BitsLeft;
+  uint32_t  bs_BitBuffer;
+  bool      bs_Error;
+} DecompressBitStream;
+
+
+/*****************************************************************************/
+
+
+static
+inline
+void
+InitBitStream(CompressBitStream *bs,
+              CompFuncClone      cf,
+              CompSpanFunc       sf,
+              void              *userData)
+{
+  bs->bs_OutputWord   = cf;
+  bs->bs_OutputSpan   = sf;
+  bs->bs_UserData     = userData;
+  bs->bs_BitsLeft     = 32;
+  bs->bs_BitBuffer    = 0;
+  bs->bs_WordsWritten = 0;
+  bs->bs_SpanLen      = 0;
+}
+
+static
+inline
+void
+FlushBitStream(CompressBitStream *bs)
+{
+  uint32_t i;
+
+  if(!bs->bs_SpanLen)
+    return;
+
+  ::byteswap_span_if_little_endian(bs->bs_Span, bs->bs_SpanLen);
+
+  if(bs->bs_OutputSpan)
+    (*bs->bs_OutputSpan)(bs->bs_UserData, bs->bs_Span, bs->bs_SpanLen);
+  else
+    for(i = 0; i < bs->bs_SpanLen; i++)
+      (*bs->bs_OutputWord)(bs->bs_UserData, bs->bs_Span[i]);
+
+  bs->bs_SpanLen = 0;
+}
+
+static
+inline
+void
+OutputWord(CompressBitStream *bs,
+           uint32_t           word)
+{
+  bs->bs_Span[bs->bs_SpanLen++] = word;
+  bs->bs_WordsWritten++;
+
+  if(bs->bs_SpanLen == SPAN_WORDS)
+    FlushBitStream(bs);
+}
+
+static
+inline
+void
+CleanupBitStream(CompressBitStream *bs)
+{
+  if(bs->bs_BitsLeft != 32)
+    OutputWord(bs, bs->bs_BitBuffer);
+
+  FlushBitStream(bs);
+}
+
+/* Write a flag bit followed by numBits (at most 31) bits of code */
+static
+inline
+void
+WriteBits(CompressBitStream *bs,
+          uint32_t           headBit,
+          uint32_t           code,
+          uint32_t           numBits)
+{
+  bs->bs_BitsLeft--;
+  bs->bs_BitBuffer |= (headBit << bs->bs_BitsLeft);
+
+  if(numBits >= bs->bs_BitsLeft)
+    {
+      numBits         -= bs->bs_BitsLeft;
+      OutputWord(bs, ((code >> numBits) | bs->bs_BitBuffer));
+      bs->bs_BitsLeft  = 32 - numBits;
+
+      if(!numBits)
+        bs->bs_BitBuffer = 0;
+      else
+        bs->bs_BitBuffer = (code << bs->bs_BitsLeft);
+    }
+  else
+    {
+      bs->bs_BitsLeft  -= numBits;
+      bs->bs_BitBuffer |= (code << bs->bs_BitsLeft);
+    }
+}
+
+static
+inline
+void
+InitBitStream(DecompressBitStream *bs)
+{
+  bs->bs_BitsLeft  = 0;
+  bs->bs_BitBuffer = 0;
+  bs->bs_Error     = false;
+}
+
+static
+inline
+void
+FeedBitStream(DecompressBitStream *bs,
+              const void          *data,
+              uint32_t             numDataWords)
+{
+  bs->bs_Data         = (uint32_t *)data;
+  bs->bs_NumDataWords = numDataWords;
+}
+
+/* Read numBits (at most 31) bits */
+static
+inline
+uint32_t
+ReadBits(DecompressBitStream *bs,
+         uint32_t             numBits)
+{
+  uint32_t result;
+
+  result = 0;
+
+  if(numBits > bs->bs_BitsLeft)
+    {
+      if(bs->bs_BitsLeft)
+        {
+          result = (bs->bs_BitBuffer << (numBits - bs->bs_BitsLeft)) & ((1 << numBits) - 1);
+          numBits -= bs->bs_BitsLeft;
+        }
+
+      if(!bs->bs_NumDataWords)
+        {
+          bs->bs_Error = true;
+          return (0);
+        }
+
+      bs->bs_NumDataWords--;
+      bs->bs_BitBuffer = ::byteswap_if_little_endian(*bs->bs_Data++);
+      bs->bs_BitsLeft  = 32;
+    }
+
+  bs->bs_BitsLeft -= numBits;
+  result |= (bs->bs_BitBuffer >> bs->bs_BitsLeft) & ((1 << numBits) - 1);
+
+  return (result);
+}
+
+
+/*****************************************************************************/
+
+
+template<uint32_t IndexBits, uint32_t LengthBits, uint32_t BreakEvenBytes>
+struct Lzss
+{
+  static_assert((IndexBits >= 4) && (IndexBits <= 16), "IndexBits must be 4 to 16");
+  static_assert((LengthBits >= 1) && (LengthBits <= 8), "LengthBits must be 1 to 8");
+  static_assert((IndexBits + LengthBits) >= 8, "a phrase must be at least as long as a literal");
+  static_assert(((1U << LengthBits) + BreakEvenBytes) < (1U << IndexBits),
+                "the longest phrase must be shorter than the window");
+
+  static constexpr uint32_t IndexBitCount    = IndexBits;
+  static constexpr uint32_t LengthBitCount   = LengthBits;
+  static constexpr uint32_t BreakEven        = BreakEvenBytes;
+  static constexpr uint32_t WindowSize       = (1U << IndexBits);
+  static constexpr uint32_t LookAheadSize    = ((1U << LengthBits) + BreakEvenBytes);
+  static constexpr uint32_t WindowMirrorSize = (WindowSize + LookAheadSize);
+  static constexpr uint32_t TreeRoot         = WindowSize;
+  static constexpr uint32_t Unused           = 0;
+  static constexpr uint32_t EndOfStream      = 0;
+  static constexpr uint32_t LiteralBits      = (1 + 8);
+  static constexpr uint32_t PhraseBits       = (1 + IndexBits + LengthBits);
+  static constexpr uint32_t DictionarySize   = (WindowSize - LookAheadSize);
+
+  static
+  constexpr
+  uint32_t
+  mod_window(uint32_t a_)
+  {
+    return (a_ & (WindowSize - 1));
+  }
+
+  /* The code written after a 0 flag bit for a phrase */
+  static
+  constexpr
+  uint32_t
+  phrase_code(uint32_t matchPos_,
+              uint32_t matchLen_)
+  {
+    return ((matchPos_ << LengthBits) | (matchLen_ - (BreakEven + 1)));
+  }
+
+
+  /***************************************************************************/
+
+
+  /*
+   * The binary tree of all of the strings in the window sorted in
+   * order. Node indices never exceed TreeRoot so they are stored in 16
+   * bits where they fit. The left and right links of a node, which are
+   * all the search reads, sit next to each other; the parent links are
+   * only needed when the tree is modified and are kept apart.
+   */
+  typedef std::conditional_t<(IndexBits < 16),uint16_t,uint32_t> Node;
+
+  enum { ChildLeft = 0, ChildRight = 1 };
+
+  struct Tree
+  {
+    Node t_Child[WindowSize + 1][2];
+    Node t_Parent[WindowSize + 1];
+  };
+
+  /* The window handed to the encoder routines is WindowMirrorSize
+   * bytes long. Its first LookAheadSize bytes are mirrored past the
+   * end so that a string starting anywhere in the window can be read
+   * without wrapping.
+   */
+  static
+  inline
+  void
+  put_window(unsigned char *window_,
+             uint32_t       pos_,
+             unsigned char  c_)
+  {
+    window_[pos_] = c_;
+    if(pos_ < LookAheadSize)
+      window_[pos_ + WindowSize] = c_;
+  }
+
+  /*
+   * A preset dictionary is history in front of the first byte of the
+   * stream, which is at position 1. At most DictionarySize bytes fit
+   * without being overwritten by the first look ahead; of a longer
+   * dictionary only the last DictionarySize bytes are kept. The
+   * encoder and decoder must load the same dictionary. Returns the
+   * number of bytes loaded, which end at position 0.
+   */
+  static
+  uint32_t
+  load_dictionary(unsigned char *window_,
+                  bool           mirror_,
+                  const uint8_t *dict_,
+                  uint32_t       size_)
+  {
+    uint32_t pos;
+
+    if(size_ > DictionarySize)
+      {
+        dict_ += (size_ - DictionarySize);
+        size_  = DictionarySize;
+      }
+
+    for(uint32_t i = 0; i < size_; i++)
+      {
+        pos = mod_window(1 - size_ + i);
+        if(mirror_)
+          put_window(window_, pos, dict_[i]);
+        else
+          window_[pos] = dict_[i];
+      }
+
+    return size_;
+  }
+
+  /* Number of leading bytes, up to LookAheadSize, that the strings at
+   * a and b have in common. The first 16 bytes are compared at once
+   * where SSE2 or NEON is available.
+   */
+  static
+  inline
+  uint32_t
+  match_length(const unsigned char *a_,
+               const unsigned char *b_)
+  {
+    uint32_t i;
+
+    i = 0;
+#if defined(__SSE2__)
+    if(LookAheadSize >= 16)
+      {
+        uint32_t mask;
+
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a_),
+                                                _mm_loadu_si128((const __m128i*)b_)));
+        mask ^= 0xFFFF;
+        if(mask)
+          return (__builtin_ctz(mask));
+        i = 16;
+      }
+#elif defined(__ARM_NEON)
+    if(LookAheadSize >= 16)
+      {
+        uint64_t mask;
+        uint8x16_t eq;
+
+        /* Narrow the byte compare to 4 bits per byte to get a scalar mask */
+        eq   = vceqq_u8(vld1q_u8(a_), vld1q_u8(b_));
+        mask = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if(mask)
+          return (__builtin_ctzll(mask) >> 2);
+        i = 16;
+      }
+#else
+    /* Without SIMD compare a word at a time. The lowest differing
+     * byte in memory is the first set bit in memory order of the xor.
+     */
+    for(; (i + sizeof(uint64_t)) <= LookAheadSize; i += sizeof(uint64_t))
+      {
+        uint64_t x;
+        uint64_t y;
+
+        memcpy(&x, &a_[i], sizeof(x));
+        memcpy(&y, &b_[i], sizeof(y));
+        x ^= y;
+        if(x)
+          return (i + ((is_little_endian() ? __builtin_ctzll(x) : __builtin_clzll(x)) >> 3));
+      }
+#endif
+
+    for(; i < LookAheadSize; i++)
+      {
+        if(a_[i] != b_[i])
+          break;
+      }
+
+    return (i);
+  }
+
+  /* Empty the first numNodes nodes and the root, then give the tree a
+   * root node by linking in a single phrase.
+   */
+  static
+  void
+  init_tree(Tree     *tree_,
+            uint32_t  numNodes_)
+  {
+    memset(tree_->t_Child, Unused, numNodes_ * sizeof(tree_->t_Child[0]));
+    memset(tree_->t_Parent, Unused, numNodes_ * sizeof(tree_->t_Parent[0]));
+    memset(tree_->t_Child[TreeRoot], Unused, sizeof(tree_->t_Child[0]));
+    tree_->t_Parent[TreeRoot]            = Unused;
+    tree_->t_Child[TreeRoot][ChildRight] = 1;
+    tree_->t_Parent[1]                   = TreeRoot;
+  }
+
+  /* This is where most of the encoder's work is done. This routine is
+   * responsible for adding the new node to the binary tree. It also has to
+   * find the best match among all the existing nodes in the tree, and return
+   * that to the calling routine. To make matters even more complicated, if
+   * the newNode has a duplicate in the tree, the oldNode is deleted, for
+   * reasons of efficiency.
+   */
+  static
+  uint32_t
+  add_string(Tree          *tree_,
+             unsigned char *window_,
+             uint32_t       newNode_,
+             uint32_t      *matchPos_,
+             uint32_t      *visited_)
+  {
+    uint32_t  i;
+    uint32_t  nodes;
+    uint32_t  testNode;
+    uint32_t  parentNode;
+    int32_t   delta;
+    uint32_t  matchLen;
+    Node    (*child)[2];
+    Node     *parent;
+
+    *visited_ = 0;
+    if(newNode_ == EndOfStream)
+      return (0);
+
+    child    = tree_->t_Child;
+    parent   = tree_->t_Parent;
+    testNode = child[TreeRoot][ChildRight];
+    matchLen = 0;
+    nodes    = 0;
+
+    while(true)
+      {
+        nodes++;
+        i     = match_length(&window_[newNode_], &window_[testNode]);
+        delta = ((i < LookAheadSize) ? (window_[newNode_ + i] - window_[testNode + i]) : 0);
+
+        if(i >= matchLen)
+          {
+            matchLen   = i;
+            *matchPos_ = testNode;
+            if(matchLen >= LookAheadSize)
+              {
+                parentNode = parent[testNode];
+
+                if(child[parentNode][ChildLeft] == testNode)
+                  child[parentNode][ChildLeft] = newNode_;
+                else
+                  child[parentNode][ChildRight] = newNode_;
+
+                child[newNode_][ChildLeft]         = child[testNode][ChildLeft];
+                child[newNode_][ChildRight]        = child[testNode][ChildRight];
+                parent[newNode_]                   = parentNode;
+                parent[child[newNode_][ChildLeft]]  = newNode_;
+                parent[child[newNode_][ChildRight]] = newNode_;
+                parent[testNode]                   = Unused;
+
+                *visited_ = nodes;
+                return (matchLen);
+              }
+          }
+
+        /* Two separate paths rather than indexing the links by the
+         * comparison result, which would make the load of the next node
+         * wait on the comparison instead of being speculated.
+         */
+        if(delta >= 0)
+          {
+            if(child[testNode][ChildRight] == Unused)
+              {
+                child[testNode][ChildRight] = newNode_;
+                parent[newNode_]            = testNode;
+                child[newNode_][ChildLeft]  = Unused;
+                child[newNode_][ChildRight] = Unused;
+                *visited_                   = nodes;
+                return (matchLen);
+              }
+            testNode = child[testNode][ChildRight];
+          }
+        else
+          {
+            if(child[testNode][ChildLeft] == Unused)
+              {
+                child[testNode][ChildLeft]  = newNode_;
+                parent[newNode_]            = testNode;
+                child[newNode_][ChildLeft]  = Unused;
+                child[newNode_][ChildRight] = Unused;
+                *visited_                   = nodes;
+                return (matchLen);
+              }
+            testNode = child[testNode][ChildLeft];
+          }
+      }
+  }
+
+  /* This routine performs a classic binary tree deletion.
+   * If the node to be deleted has a null link in either direction, we
+   * just pull the non-null link up one to replace the existing link.
+   * If both links exist, we instead delete the next link in order, which
+   * is guaranteed to have a null link, then replace the node to be deleted
+   * with the next link. Returns whether the node was in the tree.
+   */
+  static
+  bool
+  delete_string(Tree     *tree_,
+                uint32_t  node_)
+  {
+    uint32_t  parentNode;
+    uint32_t  newNode;
+    uint32_t  next;
+    Node    (*child)[2];
+    Node     *parent;
+
+    child      = tree_->t_Child;
+    parent     = tree_->t_Parent;
+    parentNode = parent[node_];
+    if(parentNode == Unused)
+      return false;
+
+    if(child[node_][ChildLeft] == Unused)
+      {
+        newNode         = child[node_][ChildRight];
+        parent[newNode] = parentNode;
+      }
+    else if(child[node_][ChildRight] == Unused)
+      {
+        newNode         = child[node_][ChildLeft];
+        parent[newNode] = parentNode;
+      }
+    else
+      {
+        newNode = child[node_][ChildLeft];
+        next    = child[newNode][ChildRight];
+        if(next != Unused)
+          {
+            do
+              {
+                newNode = next;
+                next    = child[newNode][ChildRight];
+              }
+            while(next != Unused);
+
+            child[parent[newNode]][ChildRight] = Unused;
+            parent[newNode]                    = parent[node_];
+            child[newNode][ChildLeft]          = child[node_][ChildLeft];
+            child[newNode][ChildRight]         = child[node_][ChildRight];
+            parent[child[newNode][ChildLeft]]  = newNode;
+            parent[child[newNode][ChildRight]] = newNode;
+          }
+        else
+          {
+            parent[newNode]                    = parentNode;
+            child[newNode][ChildRight]         = child[node_][ChildRight];
+            parent[child[newNode][ChildRight]] = newNode;
+          }
+      }
+
+    if(child[parentNode][ChildLeft] == node_)
+      child[parentNode][ChildLeft] = newNode;
+    else
+      child[parentNode][ChildRight] = newNode;
+
+    parent[node_] = Unused;
+
+    return true;
+  }
+
+
+  /***************************************************************************/
+
+
+  /*
+   * State of the encode loop between calls. The window starts to fill
+   * at position 1; once LookAheadSize bytes are buffered every new byte
+   * retires one position and feeds the match finder.
+   */
+  struct EncodeState
+  {
+    int32_t  es_LookAhead;
+    uint32_t es_CurrentPos;
+    int32_t  es_MatchLen;
+    uint32_t es_MatchPos;
+    uint32_t es_ReplaceCnt;
+    int32_t  es_PrevLen;
+    uint32_t es_PrevPos;
+    bool     es_SecondPass;
+  };
+
+  static
+  void
+  init_encode(EncodeState *es_)
+  {
+    es_->es_LookAhead  = 1;
+    es_->es_CurrentPos = 1;
+    es_->es_MatchLen   = 0;
+    es_->es_MatchPos   = 0;
+    es_->es_ReplaceCnt = 0;
+    es_->es_PrevLen    = 0;
+    es_->es_PrevPos    = 0;
+    es_->es_SecondPass = false;
+  }
+
+  /*
+   * Pick the token for currentPos and return how many positions it
+   * covers. The greedy parse takes the match found there. The lazy
+   * parse holds a match back for one position: if the match at the
+   * next position is strictly longer a literal is emitted instead and
+   * the longer match is held in turn, otherwise the held match is
+   * emitted from the previous position. prevLen is 0 when nothing is
+   * held. A match of the full look ahead can't be beaten and is
+   * emitted at once.
+   */
+  template<bool Lazy, typename Coder>
+  static
+  uint32_t
+  choose(Coder         &coder_,
+         unsigned char *window_,
+         uint32_t       currentPos_,
+         int32_t        matchLen_,
+         uint32_t       matchPos_,
+         int32_t       *prevLen_,
+         uint32_t      *prevPos_)
+  {
+    uint32_t pos;
+    uint32_t n;
+
+    if(Lazy && *prevLen_)
+      {
+        pos = mod_window(currentPos_ - 1);
+        if(matchLen_ > *prevLen_)
+          {
+            coder_.literal(window_[pos]);
+            *prevLen_ = matchLen_;
+            *prevPos_ = matchPos_;
+            return 1;
+          }
+
+        coder_.phrase(*prevPos_, *prevLen_, mod_window(pos - *prevPos_));
+        n = (*prevLen_ - 1);
+        *prevLen_ = 0;
+        return n;
+      }
+
+    if(matchLen_ <= (int32_t)BreakEven)
+      {
+        coder_.literal(window_[currentPos_]);
+        return 1;
+      }
+
+    if(Lazy && (matchLen_ < (int32_t)LookAheadSize))
+      {
+        *prevLen_ = matchLen_;
+        *prevPos_ = matchPos_;
+        return 1;
+      }
+
+    coder_.phrase(matchPos_, matchLen_, mod_window(currentPos_ - matchPos_));
+    return matchLen_;
+  }
+
+  /*
+   * The encode loop. Coder supplies the match finder and the output:
+   *
+   *   void     start()                            before the first search
+   *   uint32_t find(uint32_t node, uint32_t *pos)  add node, return match length
+   *   void     remove(uint32_t node)              node is leaving the window
+   *   void     literal(uint32_t c)
+   *   void     phrase(uint32_t pos, uint32_t len, uint32_t dist)
+   *
+   * dist is the phrase's distance modulo WindowSize, so 0 means
+   * WindowSize. Lazy selects the lazy parse of choose(); it makes the
+   * same calls to find() and remove() as the greedy parse.
+   */
+  template<bool Lazy = false, typename Coder>
+  static
+  void
+  encode(Coder         &coder_,
+         EncodeState   *es_,
+         unsigned char *window_,
+         const uint8_t *src_,
+         uint32_t       numDataBytes_)
+  {
+    int32_t  lookAhead;
+    uint32_t currentPos;
+    uint32_t replaceCnt;
+    int32_t  matchLen;
+    uint32_t matchPos;
+    int32_t  prevLen;
+    uint32_t prevPos;
+
+    lookAhead  = es_->es_LookAhead;
+    currentPos = es_->es_CurrentPos;
+    matchLen   = es_->es_MatchLen;
+    matchPos   = es_->es_MatchPos;
+    replaceCnt = es_->es_ReplaceCnt;
+    prevLen    = es_->es_PrevLen;
+    prevPos    = es_->es_PrevPos;
+
+    if(es_->es_SecondPass)
+      goto newData;
+
+    while(lookAhead <= (int32_t)LookAheadSize)
+      {
+        if(!numDataBytes_)
+          {
+            es_->es_LookAhead = lookAhead;
+            return;
+          }
+
+        put_window(window_, lookAhead++, *src_++);
+        numDataBytes_--;
+      }
+
+    coder_.start();
+
+    lookAhead--;
+    while(true)
+      {
+        if(matchLen > lookAhead)
+          matchLen = lookAhead;
+
+        replaceCnt = choose<Lazy>(coder_, window_, currentPos, matchLen, matchPos,
+                                  &prevLen, &prevPos);
+
+        while(replaceCnt--)
+          {
+            coder_.remove(mod_window(currentPos + LookAheadSize));
+
+            if(!numDataBytes_)
+              {
+                /* We ran out of data. Save all the state, and exit. If
+                 * we are called with more data, we'll jump right back in
+                 * this loop, and continue processing
+                 */
+
+                es_->es_LookAhead  = lookAhead;
+                es_->es_CurrentPos = currentPos;
+                es_->es_MatchLen   = matchLen;
+                es_->es_MatchPos   = matchPos;
+                es_->es_ReplaceCnt = replaceCnt;
+                es_->es_PrevLen    = prevLen;
+                es_->es_PrevPos    = prevPos;
+                es_->es_SecondPass = true;
+                return;
+              }
+          newData:
+            put_window(window_, mod_window(currentPos + LookAheadSize), *src_++);
+            numDataBytes_--;
+
+            currentPos = mod_window(currentPos + 1);
+
+            if(lookAhead)
+              matchLen = coder_.find(currentPos, &matchPos);
+          }
+      }
+  }
+
+  /* Encode whatever is still buffered at the end of the input. The end
+   * of stream marker is left to the caller. A match held by the lazy
+   * parse is always emitted before the loop ends as it needs at least
+   * BreakEven + 1 bytes of look ahead.
+   */
+  template<bool Lazy = false, typename Coder>
+  static
+  void
+  flush(Coder         &coder_,
+        EncodeState   *es_,
+        unsigned char *window_)
+  {
+    int32_t  lookAhead;
+    uint32_t currentPos;
+    uint32_t replaceCnt;
+    int32_t  matchLen;
+    uint32_t matchPos;
+    int32_t  prevLen;
+    uint32_t prevPos;
+
+    lookAhead  = es_->es_LookAhead;
+    currentPos = es_->es_CurrentPos;
+    matchLen   = es_->es_MatchLen;
+    matchPos   = es_->es_MatchPos;
+    replaceCnt = es_->es_ReplaceCnt;
+    prevLen    = es_->es_PrevLen;
+    prevPos    = es_->es_PrevPos;
+
+    if(es_->es_SecondPass)
+      goto newData;
+
+    coder_.start();
+
+    while(lookAhead >= 0)
+      {
+        if(matchLen > lookAhead)
+          matchLen = lookAhead;
+
+        replaceCnt = choose<Lazy>(coder_, window_, currentPos, matchLen, matchPos,
+                                  &prevLen, &prevPos);
+
+        while(replaceCnt--)
+          {
+            coder_.remove(mod_window(currentPos + LookAheadSize));
+            lookAhead--;
+          newData:
+            currentPos = mod_window(currentPos + 1);
+
+            if(lookAhead)
+              matchLen = coder_.find(currentPos, &matchPos);
+          }
+      }
+  }
+
+
+  /***************************************************************************/
+
+
+  /*
+   * The decode loop. Decodes tokens while words remain in the bit
+   * stream, stopping early at the end of stream marker, which it
+   * reports by returning true. Sink receives the output:
+   *
+   *   void put(uint32_t c)                    every output byte
+   *   void literal()
+   *   void phrase(uint32_t len, uint32_t dist)
+   *
+   * with dist as for encode(). The window is WindowSize bytes and
+   * *pos the position the next byte is stored at.
+   */
+  template<typename Sink>
+  static
+  bool
+  decode(Sink                &sink_,
+         DecompressBitStream *bs_,
+         unsigned char       *window_,
+         uint32_t            *pos_)
+  {
+    uint32_t i;
+    uint32_t c;
+    uint32_t pos;
+    uint32_t matchLen;
+    uint32_t matchPos;
+    bool     eos;
+
+    pos = *pos_;
+    eos = false;
+    while(bs_->bs_NumDataWords)
+      {
+        if(ReadBits(bs_, 1))
+          {
+            c = ReadBits(bs_, 8);
+            sink_.put(c);
+            sink_.literal();
+
+            window_[pos] = (unsigned char)c;
+            pos = mod_window(pos + 1);
+          }
+        else
+          {
+            matchPos = ReadBits(bs_, IndexBits);
+            if(matchPos == EndOfStream)
+              {
+                eos = true;
+                break;
+              }
+
+            matchLen = ReadBits(bs_, LengthBits) + BreakEven;
+            sink_.phrase(matchLen + 1, mod_window(pos - matchPos));
+
+            for(i = matchPos; i <= matchLen + matchPos; i++)
+              {
+                c = window_[mod_window(i)];
+                sink_.put(c);
+
+                window_[pos] = (unsigned char)c;
+                pos = mod_window(pos + 1);
+              }
+          }
+      }
+
+    *pos_ = pos;
+
+    return eos;
+  }
+
+  /*
+   * decode() for input that may not be a stream at all. Before a token
+   * is decoded it is checked against what has been written so far:
+   * *written_ bytes of output have been produced, history_ bytes of
+   * dictionary precede them and at most limit_ bytes (0 for no limit)
+   * may be produced in total. A phrase reaching back past all of that
+   * returns COMP_ERR_BADREF and one passing the limit COMP_ERR_OVERFLOW,
+   * with the bit stream left at the start of the token at fault so the
+   * caller can work out where it is. Otherwise returns 1 at the end of
+   * stream marker and 0 when the words run out.
+   */
+  template<typename Sink>
+  static
+  int
+  decode_strict(Sink                &sink_,
+                DecompressBitStream *bs_,
+                unsigned char       *window_,
+                uint32_t            *pos_,
+                uint64_t            *written_,
+                uint32_t             history_,
+                uint64_t             limit_)
+  {
+    uint32_t i;
+    uint32_t c;
+    uint32_t pos;
+    uint32_t dist;
+    uint32_t matchLen;
+    uint32_t matchPos;
+    uint64_t written;
+    int      rv;
+    DecompressBitStream token;
+
+    pos     = *pos_;
+    written = *written_;
+    rv      = 0;
+    while(bs_->bs_NumDataWords)
+      {
+        token = *bs_;
+        if(ReadBits(bs_, 1))
+          {
+            if(limit_ && (written + 1 > limit_))
+              {
+                *bs_ = token;
+                rv   = COMP_ERR_OVERFLOW;
+                break;
+              }
+
+            c = ReadBits(bs_, 8);
+            sink_.put(c);
+            sink_.literal();
+
+            window_[pos] = (unsigned char)c;
+            pos = mod_window(pos + 1);
+            written++;
+            continue;
+          }
+
+        matchPos = ReadBits(bs_, IndexBits);
+        if(matchPos == EndOfStream)
+          {
+            rv = 1;
+            break;
+          }
+
+        matchLen = ReadBits(bs_, LengthBits) + BreakEven;
+        dist     = mod_window(pos - matchPos);
+        if(dist == 0)
+          dist = WindowSize;
+
+        if(dist > (written + history_))
+          {
+            *bs_ = token;
+            rv   = COMP_ERR_BADREF;
+            break;
+          }
+
+        if(limit_ && (written + matchLen + 1 > limit_))
+          {
+            *bs_ = token;
+            rv   = COMP_ERR_OVERFLOW;
+            break;
+          }
+
+        sink_.phrase(matchLen + 1, mod_window(pos - matchPos));
+
+        for(i = matchPos; i <= matchLen + matchPos; i++)
+          {
+            c = window_[mod_window(i)];
+            sink_.put(c);
+
+            window_[pos] = (unsigned char)c;
+            pos = mod_window(pos + 1);
+          }
+        written += (matchLen + 1);
+      }
+
+    *pos_     = pos;
+    *written_ = written;
+
+    return rv;
+  }
+
+  /*
+   * Neither decode loop starts a token once the last word fed is
+   * buffered, which is where the end of stream marker and the flush's
+   * literals before it usually are. Returns whether the marker is
+   * among the tokens left in the buffer.
+   */
+  static
+  bool
+  buffered_end_of_stream(const DecompressBitStream *bs_)
+  {
+    uint32_t bitsLeft;
+
+    bitsLeft = bs_->bs_BitsLeft;
+    while(bitsLeft >= (1 + IndexBits))
+      {
+        if((bs_->bs_BitBuffer >> (bitsLeft - 1)) & 1)
+          {
+            if(bitsLeft < LiteralBits)
+              break;
+            bitsLeft -= LiteralBits;
+            continue;
+          }
+
+        if(((bs_->bs_BitBuffer >> (bitsLeft - (1 + IndexBits))) & ((1U << IndexBits) - 1)) == EndOfStream)
+          return true;
+
+        if(bitsLeft < PhraseBits)
+          break;
+        bitsLeft -= PhraseBits;
+      }
+
+    return false;
+  }
+
+  /* Decode a whole stream into a flat buffer, see SimpleDecompress().
+   * With the whole source and destination available up front there is
+   * no need for the ring window or the per-word output callback:
+   * output byte k lives at dest[k] and an index p refers to the byte at
+   * distance ((k - p) mod WindowSize) + 1 back, bytes before the start
+   * of the stream reading as zero just as they do from the zeroed
+   * window. Bits are taken from a 64-bit reservoir refilled a word at a
+   * time.
+   *
+   * The stopping rules are those of the streaming decoder: a token is
+   * only decoded if the word its first bit lives in has not been
+   * completely consumed yet, only complete words of output count, and
+   * output past the end of the destination is parsed but dropped.
+   * Bytes of the destination past the returned word count may have
+   * been written to.
+   */
+  static
+  int
+  simple_decompress(const uint32_t *source_,
+                    uint32_t        sourceWords_,
+                    uint8_t        *dest_,
+                    uint32_t        resultWords_)
+  {
+    static constexpr uint32_t CopySlack = 8;
+
+    uint64_t  bitBuffer;
+    uint64_t  bitPos;
+    uint64_t  lastTokenPos;
+    uint32_t  bitsLeft;
+    uint32_t  wordsLeft;
+    uint32_t  word;
+    uint32_t  token;
+    uint32_t  matchPos;
+    uint32_t  matchLen;
+    uint32_t  dist;
+    size_t    n;
+    size_t    cap;
+    size_t    i;
+    uint8_t  *dst;
+    uint8_t  *end;
+    bool      eos;
+
+    if(sourceWords_ == 0)
+      return 0;
+
+    bitBuffer    = 0;
+    bitsLeft     = 0;
+    bitPos       = 0;
+    lastTokenPos = ((uint64_t)(sourceWords_ - 1) * 32);
+    wordsLeft    = sourceWords_;
+    n            = 0;
+    cap          = ((size_t)resultWords_ * sizeof(uint32_t));
+    eos          = false;
+
+    while(bitPos <= lastTokenPos)
+      {
+        while((bitsLeft <= 32) && wordsLeft)
+          {
+            memcpy(&word,source_++,sizeof(word));
+            bitBuffer |= ((uint64_t)::byteswap_if_little_endian(word) << (32 - bitsLeft));
+            bitsLeft  += 32;
+            wordsLeft--;
+          }
+
+        /* Every token fits in the top PhraseBits bits */
+        token = (uint32_t)(bitBuffer >> (64 - PhraseBits));
+
+        if(token & (1U << (PhraseBits - 1)))
+          {
+            if(n < cap)
+              dest_[n] = (uint8_t)(token >> (PhraseBits - LiteralBits));
+            n++;
+
+            bitBuffer <<= LiteralBits;
+            bitsLeft   -= LiteralBits;
+            bitPos     += LiteralBits;
+            continue;
+          }
+
+        matchPos = (token >> LengthBits);
+        if(matchPos == EndOfStream)
+          {
+            bitPos += (1 + IndexBits);
+            eos = true;
+            break;
+          }
+
+        matchLen = (token & ((1U << LengthBits) - 1)) + BreakEven + 1;
+        dist     = mod_window((uint32_t)n - matchPos) + 1;
+
+        bitBuffer <<= PhraseBits;
+        bitsLeft   -= PhraseBits;
+        bitPos     += PhraseBits;
+
+        if((n >= dist) && ((n + matchLen + CopySlack) <= cap))
+          {
+            dst = &dest_[n];
+            end = &dst[matchLen];
+            n  += matchLen;
+
+            /* Chunks never overlap their own source when the distance is
+             * at least a chunk so copying forward keeps byte semantics.
+             */
+            if(dist >= CopySlack)
+              {
+                do
+                  {
+                    memcpy(dst,dst - dist,CopySlack);
+                    dst += CopySlack;
+                  }
+                while(dst < end);
+              }
+            else
+              {
+                do
+                  {
+                    *dst = *(dst - dist);
+                    dst++;
+                  }
+                while(dst < end);
+              }
+            continue;
+          }
+
+        for(i = 0; i < matchLen; i++, n++)
+          {
+            if(n < cap)
+              dest_[n] = ((n >= dist) ? dest_[n - dist] : 0);
+          }
+      }
+
+    /* Words left unread after the end of stream marker */
+    if(eos && (((bitPos + 31) / 32) < sourceWords_))
+      return COMP_ERR_DATAREMAINS;
+
+    if((n / sizeof(uint32_t)) > resultWords_)
+      return COMP_ERR_OVERFLOW;
+
+    return (int)(n / sizeof(uint32_t));
+  }
+
+  /*
+   * simple_decompress() for input that may not be a stream at all, see
+   * StrictDecompress(). Decoding stops at the first token that reaches
+   * back before the start of the stream (COMP_ERR_BADREF) or would make
+   * the output more than resultWords_ complete words
+   * (COMP_ERR_OVERFLOW), and running out of input before the end of
+   * stream marker is COMP_ERR_DATAMISSING. *errorBit_ is then the bit
+   * offset of the token at fault, or of the end of the input. Words
+   * after the marker are not an error; *streamWords_ is set to the
+   * number of words the stream occupied.
+   */
+  static
+  int
+  strict_decompress(const uint32_t *source_,
+                    uint32_t        sourceWords_,
+                    uint8_t        *dest_,
+                    uint32_t        resultWords_,
+                    uint32_t       *streamWords_,
+                    uint64_t       *errorBit_)
+  {
+    static constexpr uint32_t CopySlack = 8;
+
+    uint64_t  bitBuffer;
+    uint64_t  bitPos;
+    uint64_t  lastTokenPos;
+    uint32_t  bitsLeft;
+    uint32_t  wordsLeft;
+    uint32_t  word;
+    uint32_t  token;
+    uint32_t  matchPos;
+    uint32_t  matchLen;
+    uint32_t  dist;
+    size_t    n;
+    size_t    cap;
+    size_t    limit;
+    size_t    i;
+    uint8_t  *dst;
+    uint8_t  *end;
+    int       rv;
+
+    if(sourceWords_ == 0)
+      {
+        if(errorBit_)
+          *errorBit_ = 0;
+        return COMP_ERR_DATAMISSING;
+      }
+
+    bitBuffer    = 0;
+    bitsLeft     = 0;
+    bitPos       = 0;
+    lastTokenPos = ((uint64_t)(sourceWords_ - 1) * 32);
+    wordsLeft    = sourceWords_;
+    n            = 0;
+    cap          = ((size_t)resultWords_ * sizeof(uint32_t));
+    limit        = (cap + (sizeof(uint32_t) - 1));
+    rv           = COMP_ERR_DATAMISSING;
+
+    /* Up to 3 bytes past the last complete word are dropped, not an
+     * overflow, so limit is where the output stops fitting.
+     */
+    while(bitPos <= lastTokenPos)
+      {
+        while((bitsLeft <= 32) && wordsLeft)
+          {
+            memcpy(&word,source_++,sizeof(word));
+            bitBuffer |= ((uint64_t)::byteswap_if_little_endian(word) << (32 - bitsLeft));
+            bitsLeft  += 32;
+            wordsLeft--;
+          }
+
+        token = (uint32_t)(bitBuffer >> (64 - PhraseBits));
+
+        if(token & (1U << (PhraseBits - 1)))
+          {
+            if(n >= limit)
+              {
+                rv = COMP_ERR_OVERFLOW;
+                break;
+              }
+
+            if(n < cap)
+              dest_[n] = (uint8_t)(token >> (PhraseBits - LiteralBits));
+            n++;
+
+            bitBuffer <<= LiteralBits;
+            bitsLeft   -= LiteralBits;
+            bitPos     += LiteralBits;
+            continue;
+          }
+
+        matchPos = (token >> LengthBits);
+        if(matchPos == EndOfStream)
+          {
+            bitPos += (1 + IndexBits);
+            rv = 0;
+            break;
+          }
+
+        matchLen = (token & ((1U << LengthBits) - 1)) + BreakEven + 1;
+        dist     = mod_window((uint32_t)n - matchPos) + 1;
+
+        if(dist > n)
+          {
+            rv = COMP_ERR_BADREF;
+            break;
+          }
+
+        if((n + matchLen) > limit)
+          {
+            rv = COMP_ERR_OVERFLOW;
+            break;
+          }
+
+        bitBuffer <<= PhraseBits;
+        bitsLeft   -= PhraseBits;
+        bitPos     += PhraseBits;
+
+        if((n + matchLen + CopySlack) <= cap)
+          {
+            dst = &dest_[n];
+            end = &dst[matchLen];
+            n  += matchLen;
+
+            if(dist >= CopySlack)
+              {
+                do
+                  {
+                    memcpy(dst,dst - dist,CopySlack);
+                    dst += CopySlack;
+                  }
+                while(dst < end);
+              }
+            else
+              {
+                do
+                  {
+                    *dst = *(dst - dist);
+                    dst++;
+                  }
+                while(dst < end);
+              }
+            continue;
+          }
+
+        for(i = 0; i < matchLen; i++, n++)
+          {
+            if(n < cap)
+              dest_[n] = dest_[n - dist];
+          }
+      }
+
+    /* As in buffered_end_of_stream() the marker may be among the
+     * tokens in the last word
+     */
+    while((rv == COMP_ERR_DATAMISSING) && (bitsLeft >= (1 + IndexBits)))
+      {
+        token = (uint32_t)(bitBuffer >> (64 - (1 + IndexBits)));
+        if(token & (1U << IndexBits))
+          {
+            if(bitsLeft < LiteralBits)
+              break;
+            bitBuffer <<= LiteralBits;
+            bitsLeft   -= LiteralBits;
+            bitPos     += LiteralBits;
+            continue;
+          }
+
+        bitPos += (1 + IndexBits);
+        if(token == EndOfStream)
+          rv = 0;
+        if((token == EndOfStream) || (bitsLeft < PhraseBits))
+          break;
+        bitBuffer <<= PhraseBits;
+        bitsLeft   -= PhraseBits;
+        bitPos     += LengthBits;
+      }
+
+    if(rv == COMP_ERR_DATAMISSING)
+      bitPos = ((uint64_t)sourceWords_ * 32);
+
+    if(rv < 0)
+      {
+        if(errorBit_)
+          *errorBit_ = bitPos;
+        return rv;
+      }
+
+    if(streamWords_)
+      *streamWords_ = (uint32_t)((bitPos + 31) / 32);
+
+    return (int)(n / sizeof(uint32_t));
+  }
+
+  /*
+   * What simple_decompress() would return given enough room, found by
+   * walking the tokens with the same stopping rules without producing
+   * any output.
+   */
+  static
+  int
+  decoded_size(const uint32_t *source_,
+               uint32_t        sourceWords_)
+  {
+    uint64_t  bitBuffer;
+    uint64_t  bitPos;
+    uint64_t  lastTokenPos;
+    uint64_t  n;
+    uint32_t  bitsLeft;
+    uint32_t  wordsLeft;
+    uint32_t  word;
+    uint32_t  token;
+    bool      eos;
+
+    if(sourceWords_ == 0)
+      return 0;
+
+    bitBuffer    = 0;
+    bitsLeft     = 0;
+    bitPos       = 0;
+    lastTokenPos = ((uint64_t)(sourceWords_ - 1) * 32);
+    wordsLeft    = sourceWords_;
+    n            = 0;
+    eos          = false;
+
+    while(bitPos <= lastTokenPos)
+      {
+        while((bitsLeft <= 32) && wordsLeft)
+          {
+            memcpy(&word,source_++,sizeof(word));
+            bitBuffer |= ((uint64_t)::byteswap_if_little_endian(word) << (32 - bitsLeft));
+            bitsLeft  += 32;
+            wordsLeft--;
+          }
+
+        token = (uint32_t)(bitBuffer >> (64 - PhraseBits));
+
+        if(token & (1U << (PhraseBits - 1)))
+          {
+            n++;
+            bitBuffer <<= LiteralBits;
+            bitsLeft   -= LiteralBits;
+            bitPos     += LiteralBits;
+            continue;
+          }
+
+        if((token >> LengthBits) == EndOfStream)
+          {
+            bitPos += (1 + IndexBits);
+            eos = true;
+            break;
+          }
+
+        n += (token & ((1U << LengthBits) - 1)) + BreakEven + 1;
+        bitBuffer <<= PhraseBits;
+        bitsLeft   -= PhraseBits;
+        bitPos     += PhraseBits;
+      }
+
+    if(eos && (((bitPos + 31) / 32) < sourceWords_))
+      return COMP_ERR_DATAREMAINS;
+
+    return (int)(n / sizeof(uint32_t));
+  }
+
+
+  /***************************************************************************/
+
+
+  /*
+   * A plain streaming encoder using the binary tree match finder, the
+   * equivalent of a Compressor at COMP_LEVEL_SDK without stats. Input
+   * may be fed in any number of bytes; output is delivered through sf.
+   */
+  class Encoder
+  {
+  public:
+    Encoder(CompSpanFunc  sf_,
+            void         *userData_)
+    {
+      memset(_window,0,sizeof(_window));
+      init_tree(&_tree,WindowSize + 1);
+      init_encode(&_state);
+      InitBitStream(&_bs,NULL,sf_,userData_);
+    }
+
+  public:
+    void
+    feed(const void *data_,
+         size_t      numDataBytes_)
+    {
+      const uint8_t *src = (const uint8_t*)data_;
+      uint32_t n;
+
+      while(numDataBytes_)
+        {
+          n = ((numDataBytes_ > (1UL << 30)) ? (1UL << 30) : numDataBytes_);
+          encode(*this,&_state,_window,src,n);
+          src           += n;
+          numDataBytes_ -= n;
+        }
+
+      FlushBitStream(&_bs);
+    }
+
+    /* Returns the number of words written */
+    uint64_t
+    finish()
+    {
+      flush(*this,&_state,_window);
+      WriteBits(&_bs,0,EndOfStream,IndexBits);
+      CleanupBitStream(&_bs);
+
+      return _bs.bs_WordsWritten;
+    }
+
+  public:
+    void start() {}
+
+    uint32_t
+    find(uint32_t  node_,
+         uint32_t *matchPos_)
+    {
+      uint32_t visited;
+
+      return add_string(&_tree,_window,node_,matchPos_,&visited);
+    }
+
+    void remove(uint32_t node_) { delete_string(&_tree,node_); }
+
+    void literal(uint32_t c_) { WriteBits(&_bs,1,c_,8); }
+
+    void
+    phrase(uint32_t matchPos_,
+           uint32_t matchLen_,
+           uint32_t)
+    {
+      WriteBits(&_bs,0,phrase_code(matchPos_,matchLen_),IndexBits + LengthBits);
+    }
+
+  private:
+    unsigned char     _window[WindowMirrorSize];
+    Tree              _tree;
+    EncodeState       _state;
+    CompressBitStream _bs;
+  };
+
+  /*
+   * A plain streaming decoder. Complete output words are delivered
+   * through sf; finish() returns 0 or COMP_ERR_DATAREMAINS or
+   * COMP_ERR_DATAMISSING as DeleteDecompressor() would.
+   */
+  class Decoder
+  {
+  public:
+    Decoder(CompSpanFunc  sf_,
+            void         *userData_)
+      : _sf(sf_),
+        _userData(userData_),
+        _pos(1),
+        _spanBytes(0),
+        _eos(false)
+    {
+      memset(_window,0,sizeof(_window));
+      InitBitStream(&_bs);
+    }
+
+  public:
+    void
+    feed(const void *data_,
+         uint32_t    numDataWords_)
+    {
+      /* As with a Decompressor nothing past the marker is decoded */
+      if(_eos)
+        {
+          if(numDataWords_)
+            FeedBitStream(&_bs,data_,numDataWords_);
+          return;
+        }
+
+      FeedBitStream(&_bs,data_,numDataWords_);
+      _eos = decode(*this,&_bs,_window,&_pos);
+      flush_output();
+    }
+
+    int
+    finish()
+    {
+      flush_output();
+
+      if(_bs.bs_Error)
+        return COMP_ERR_DATAMISSING;
+      if(_bs.bs_NumDataWords)
+        return COMP_ERR_DATAREMAINS;
+
+      return 0;
+    }
+
+  public:
+    /* Bytes are stored in stream order, so the span is already in
+     * the stream's big endian word order.
+     */
+    void
+    put(uint32_t c_)
+    {
+      ((uint8_t*)_span)[_spanBytes++] = (uint8_t)c_;
+      if(_spanBytes == sizeof(_span))
+        flush_output();
+    }
+
+    void literal() {}
+
+    void
+    phrase(uint32_t,
+           uint32_t)
+    {
+    }
+
+  private:
+    /* A partial last word is kept for the next feed */
+    void
+    flush_output()
+    {
+      uint32_t numWords;
+      uint32_t partial;
+
+      numWords = (_spanBytes / sizeof(uint32_t));
+      partial  = (_spanBytes % sizeof(uint32_t));
+      if(numWords)
+        (*_sf)(_userData,_span,numWords);
+      if(partial)
+        memcpy(_span,&_span[numWords],partial);
+      _spanBytes = partial;
+    }
+
+  private:
+    CompSpanFunc        _sf;
+    void               *_userData;
+    uint32_t            _pos;
+    uint32_t            _spanBytes;
+    bool                _eos;
+    unsigned char       _window[WindowSize];
+    DecompressBitStream _bs;
+    uint32_t            _span[SPAN_WORDS];
+  };
+};
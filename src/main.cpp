@@ -2,18 +2,32 @@
 #include "compress.hpp"
 #include "fmt.hpp"
 #include "options.hpp"
+#include "subcmd_bench.hpp"
 #include "subcmd_check.hpp"
 #include "subcmd_compress.hpp"
 #include "subcmd_decompress.hpp"
+#include "subcmd_scan.hpp"
 #include "version.hpp"
 
 #include <unistd.h>
 
 #include <cstdio>
 #include <filesystem>
+#include <map>
+#include <string>
 
 namespace fs = std::filesystem;
 
+// "-" is accepted in place of an existing file to read stdin
+static const CLI::Validator ExistingFileOrStdin =
+  CLI::Validator([](std::string &s_)
+                 {
+                   if(s_ == "-")
+                     return std::string();
+                   return CLI::ExistingFile(s_);
+                 },
+                 "FILE");
+
 
 static
 void
@@ -23,15 +37,81 @@ generate_compress_argparser(CLI::App &app_,
   CLI::App *subcmd;
 
   subcmd = app_.add_subcommand("compress","Compress input file");
-  subcmd->add_option("input-filepath",opts_.input_filepath)
-    ->description("Path to input file")
+  subcmd->add_option("filepaths",opts_.filepaths)
+    ->description("Input file and optional output file (default: input + '.compressed'), "
+                  "'-' for stdin or stdout (default output for stdin), "
+                  "or with --batch input files and directories")
+    ->type_name("PATH");
+  subcmd->add_flag("--batch",opts_.batch)
+    ->description("Compress each input to input + '.compressed', recursing into directories");
+  subcmd->add_option("--manifest",opts_.manifest_filepath)
+    ->description("File listing one input path per line, implies --batch")
     ->type_name("PATH")
-    ->check(CLI::ExistingFile)
-    ->required();
-  subcmd->add_option("output-filepath",opts_.output_filepath)
-    ->description("Path to output file (default: input + '.compressed')")
+    ->check(CLI::ExistingFile);
+  subcmd->add_option("-j,--jobs",opts_.jobs)
+    ->description("Number of files compressed concurrently in batch mode "
+                  "or segments with --split (default: # of cores)")
+    ->type_name("N");
+  subcmd->add_option("--prefetch",opts_.prefetch)
+    ->description("Number of inputs read ahead and outputs written back on I/O "
+                  "threads in batch mode (default: 2 per job)")
+    ->type_name("N");
+  subcmd->add_option("--chunk-size",opts_.chunk_size)
+    ->description("Size of I/O blocks fed to the codec (default: 1MiB)")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_flag("--mmap",opts_.mmap)
+    ->description("Memory map the input and output files");
+  subcmd->add_option("--level",opts_.level)
+    ->description("Compression level (default: sdk)")
+    ->type_name("LEVEL")
+    ->transform(CLI::CheckedTransformer(std::map<std::string,int32_t>{{"sdk",COMP_LEVEL_SDK},
+                                                                       {"fast",COMP_LEVEL_FAST},
+                                                                       {"lazy",COMP_LEVEL_LAZY},
+                                                                       {"optimal",COMP_LEVEL_OPTIMAL}}));
+  subcmd->add_option("--split",opts_.split_size)
+    ->description("Compress independent segments of SIZE, at least 4KiB, in parallel "
+                  "into a 3ct container (not a raw 3DO stream) which decompress decodes "
+                  "in parallel")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_flag("--split-loss",opts_.split_loss)
+    ->description("With --split also compress as a single stream and report the difference");
+  subcmd->add_flag("--stats",opts_.stats)
+    ->description("Report token, match length and offset counts and match finder work");
+  subcmd->add_option("--store-ratio",opts_.store_ratio)
+    ->description("Sample each input first and skip compressing it, reporting it as "
+                  "stored and removing any earlier output, when the estimated output exceeds "
+                  "RATIO of the input (e.g. 0.95)")
+    ->type_name("RATIO")
+    ->check(CLI::Range(0.0,4.0));
+  subcmd->add_flag("--verify",opts_.verify)
+    ->description("Decompress the output as it is produced and fail, removing the "
+                  "output, if it doesn't match the input");
+  subcmd->add_flag("--pipeline",opts_.pipeline)
+    ->description("Find matches and pack the output on separate threads, for a faster "
+                  "single file when a core is spare. The output is the same");
+  subcmd->add_option("--cache",opts_.cache_dirpath)
+    ->description("Copy the output of unchanged inputs from DIR instead of compressing "
+                  "them and store new outputs there, keyed by the SHA-256 of the input "
+                  "and the options that affect the output")
+    ->type_name("DIR");
+  subcmd->add_option("--cache-size",opts_.cache_size)
+    ->description("Size the --cache directory is trimmed to after each run, "
+                  "least recently used entries first (default: 1GiB)")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_option("--dictionary",opts_.dictionary_filepath)
+    ->description("Preset the window with the last 4078 bytes of PATH, such as an earlier "
+                  "revision of the input; the output then needs the same --dictionary "
+                  "to decompress and can't be read by the SDK")
     ->type_name("PATH")
-    ->option_text("PATH:FILE");
+    ->check(CLI::ExistingFile);
+  subcmd->add_option("--report",opts_.report)
+    ->description("Print the report as yaml or as json, one object per line per file "
+                  "with wall and CPU time, MB/s, ratio and peak RSS added (default: yaml)")
+    ->type_name("FORMAT")
+    ->check(CLI::IsMember({"yaml","json"}));
 
   auto func = std::bind(SubCmd::compress,std::cref(opts_));
   subcmd->callback(func);
@@ -46,19 +126,87 @@ generate_decompress_argparser(CLI::App &app_,
 
   subcmd = app_.add_subcommand("decompress","Decompress input file");
   subcmd->add_option("input-filepath",opts_.input_filepath)
-    ->description("Path to input file")
+    ->description("Path to input file, '-' for stdin")
     ->type_name("PATH")
-    ->check(CLI::ExistingFile)
+    ->check(ExistingFileOrStdin)
     ->required();
   subcmd->add_option("output-filepath",opts_.output_filepath)
-    ->description("Path to output file (default: input + '.decompressed')")
+    ->description("Path to output file, '-' for stdout (default: input + '.decompressed', "
+                  "stdout for stdin)")
     ->type_name("PATH")
     ->option_text("PATH:FILE");
+  subcmd->add_option("--chunk-size",opts_.chunk_size)
+    ->description("Size of I/O blocks fed to the codec (default: 1MiB)")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_flag("--mmap",opts_.mmap)
+    ->description("Memory map the input file instead of reading it");
+  subcmd->add_flag("--stats",opts_.stats)
+    ->description("Report token, match length and offset counts (not for --split containers)");
+  subcmd->add_option("-j,--jobs",opts_.jobs)
+    ->description("Number of segments decoded concurrently for --split "
+                  "containers (default: # of cores)")
+    ->type_name("N");
+  subcmd->add_option("--range",opts_.range)
+    ->description("Only output LEN bytes (to the end if empty) from OFFSET of a --split "
+                  "container, decoding just the segments that cover them")
+    ->type_name("OFFSET:LEN");
+  subcmd->add_option("--dictionary",opts_.dictionary_filepath)
+    ->description("Dictionary the input was compressed with")
+    ->type_name("PATH")
+    ->check(CLI::ExistingFile);
+  subcmd->add_flag("--strict",opts_.strict)
+    ->description("Fail at the first token that can't be part of a valid stream, or "
+                  "if the end of stream marker is missing, instead of decoding it all");
+  subcmd->add_option("--report",opts_.report)
+    ->description("Print the report as yaml or as json, one object per line with wall "
+                  "and CPU time, MB/s, ratio and peak RSS added (default: yaml)")
+    ->type_name("FORMAT")
+    ->check(CLI::IsMember({"yaml","json"}));
 
   auto func = std::bind(SubCmd::decompress,std::cref(opts_));
   subcmd->callback(func);
 }
 
+static
+void
+generate_scan_argparser(CLI::App &app_,
+                        Options  &opts_)
+{
+  CLI::App *subcmd;
+
+  subcmd = app_.add_subcommand("scan");
+  subcmd->description("Finds compressed streams inside a file such as a disc image by "
+                      "trying to decode them at every aligned offset");
+  subcmd->add_option("input-filepath",opts_.input_filepath)
+    ->description("Path to the file to scan")
+    ->type_name("PATH")
+    ->check(CLI::ExistingFile)
+    ->required();
+  subcmd->add_option("--align",opts_.align)
+    ->description("Only try offsets that are a multiple of N (default: 4)")
+    ->type_name("N");
+  subcmd->add_option("--min-size",opts_.min_size)
+    ->description("Ignore streams that decompress to less than SIZE (default: 256)")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_option("--max-size",opts_.max_size)
+    ->description("Give up on a candidate once it decompresses to more than SIZE "
+                  "(default: 4MiB)")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_option("--extract",opts_.extract_dirpath)
+    ->description("Write each stream found to DIR as FILE.OFFSET.decompressed, "
+                  "the offset in hex")
+    ->type_name("DIR");
+  subcmd->add_option("-j,--jobs",opts_.jobs)
+    ->description("Number of threads trying offsets (default: # of cores)")
+    ->type_name("N");
+
+  auto func = std::bind(SubCmd::scan,std::cref(opts_));
+  subcmd->callback(func);
+}
+
 static
 void
 generate_check_argparser(CLI::App &app_,
@@ -68,9 +216,45 @@ generate_check_argparser(CLI::App &app_,
 
   subcmd = app_.add_subcommand("check");
   subcmd->description("Checks the compressor and decompressor against data "
-                      "generated by the 3DO SDK compression library");
+                      "generated by the 3DO SDK compression library and round "
+                      "trips every level and feature without an SDK equivalent");
+  subcmd->add_option("dirpaths",opts_.filepaths)
+    ->description("Directories of golden pairs, each an original FILE and the SDK's "
+                  "FILE.compressed, to check in both directions as well")
+    ->type_name("PATH")
+    ->check(CLI::ExistingDirectory);
+  subcmd->add_option("-j,--jobs",opts_.jobs)
+    ->description("Number of golden pairs checked concurrently (default: # of cores)")
+    ->type_name("N");
 
-  subcmd->callback(SubCmd::check);
+  auto func = std::bind(SubCmd::check,std::cref(opts_));
+  subcmd->callback(func);
+}
+
+static
+void
+generate_bench_argparser(CLI::App &app_,
+                         Options  &opts_)
+{
+  CLI::App *subcmd;
+
+  subcmd = app_.add_subcommand("bench");
+  subcmd->description("Benchmarks compression and decompression at every level over "
+                      "synthetic zero, random and text corpora plus any given paths");
+  subcmd->add_option("filepaths",opts_.filepaths)
+    ->description("Files or directories to benchmark as additional corpora")
+    ->type_name("PATH")
+    ->check(CLI::ExistingPath);
+  subcmd->add_option("--size",opts_.bench_size)
+    ->description("Size of each synthetic corpus (default: 4MiB)")
+    ->type_name("SIZE")
+    ->transform(CLI::AsSizeValue(false));
+  subcmd->add_option("--iterations",opts_.iterations)
+    ->description("Number of runs per measurement, the fastest is reported (default: 3)")
+    ->type_name("N");
+
+  auto func = std::bind(SubCmd::bench,std::cref(opts_));
+  subcmd->callback(func);
 }
 
 static
@@ -91,7 +275,9 @@ generate_argparser(CLI::App &app_,
 
   generate_compress_argparser(app_,opts_);
   generate_decompress_argparser(app_,opts_);
+  generate_scan_argparser(app_,opts_);
   generate_check_argparser(app_,opts_);
+  generate_bench_argparser(app_,opts_);
 }
 
 int
@@ -111,13 +297,20 @@ main(int    argc_,
     {
       return app.exit(e_);
     }
+  // Errors go to stderr and fail the process so that a pipeline
+  // doesn't take them for data. Any report already printed is
+  // flushed first so the error follows it.
   catch(const std::system_error &e_)
     {
-      fmt::print("{} ({})\n",e_.what(),e_.code().message());
+      fflush(stdout);
+      fmt::print(stderr,"{} ({})\n",e_.what(),e_.code().message());
+      return 1;
     }
   catch(const std::runtime_error &e_)
     {
-      fmt::print("{}\n",e_.what());
+      fflush(stdout);
+      fmt::print(stderr,"{}\n",e_.what());
+      return 1;
     }
 
   return 0;
@@ -0,0 +1,225 @@
+#include "mapped_file.hpp"
+
+#include "fmt.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+
+#ifdef _WIN32
+
+static
+std::string
+last_error_string()
+{
+  DWORD err;
+  char buf[256];
+
+  err = GetLastError();
+  buf[0] = '\0';
+  FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                 NULL,err,0,buf,sizeof(buf),NULL);
+
+  return buf;
+}
+
+MappedFile::MappedFile()
+  : _data(NULL),
+    _size(0),
+    _writable(false),
+    _file(INVALID_HANDLE_VALUE),
+    _mapping(NULL)
+{
+}
+
+void
+MappedFile::open_read(const fs::path &filepath_)
+{
+  LARGE_INTEGER size;
+
+  _file = CreateFileW(filepath_.wstring().c_str(),
+                      GENERIC_READ,
+                      FILE_SHARE_READ,
+                      NULL,
+                      OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                      NULL);
+  if(_file == INVALID_HANDLE_VALUE)
+    throw fmt::exception("ERROR: failed to open {} - {}",filepath_,last_error_string());
+
+  if(!GetFileSizeEx(_file,&size))
+    throw fmt::exception("ERROR: failed to stat {} - {}",filepath_,last_error_string());
+
+  _size     = size.QuadPart;
+  _writable = false;
+  if(_size == 0)
+    return;
+
+  _mapping = CreateFileMappingW(_file,NULL,PAGE_READONLY,0,0,NULL);
+  if(_mapping == NULL)
+    throw fmt::exception("ERROR: failed to map {} - {}",filepath_,last_error_string());
+
+  _data = (uint8_t*)MapViewOfFile(_mapping,FILE_MAP_READ,0,0,0);
+  if(_data == NULL)
+    throw fmt::exception("ERROR: failed to map {} - {}",filepath_,last_error_string());
+}
+
+void
+MappedFile::create(const fs::path &filepath_,
+                   std::size_t     capacity_)
+{
+  LARGE_INTEGER size;
+
+  _file = CreateFileW(filepath_.wstring().c_str(),
+                      GENERIC_READ | GENERIC_WRITE,
+                      0,
+                      NULL,
+                      CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL,
+                      NULL);
+  if(_file == INVALID_HANDLE_VALUE)
+    throw fmt::exception("ERROR: failed to open {} - {}",filepath_,last_error_string());
+
+  _size     = capacity_;
+  _writable = true;
+  if(_size == 0)
+    return;
+
+  size.QuadPart = _size;
+  _mapping = CreateFileMappingW(_file,NULL,PAGE_READWRITE,
+                                size.HighPart,size.LowPart,NULL);
+  if(_mapping == NULL)
+    throw fmt::exception("ERROR: failed to map {} - {}",filepath_,last_error_string());
+
+  _data = (uint8_t*)MapViewOfFile(_mapping,FILE_MAP_WRITE,0,0,0);
+  if(_data == NULL)
+    throw fmt::exception("ERROR: failed to map {} - {}",filepath_,last_error_string());
+}
+
+void
+MappedFile::close(std::size_t used_)
+{
+  LARGE_INTEGER size;
+
+  if(_data)
+    UnmapViewOfFile(_data);
+  if(_mapping)
+    CloseHandle(_mapping);
+
+  if(_file != INVALID_HANDLE_VALUE)
+    {
+      if(_writable)
+        {
+          size.QuadPart = used_;
+          SetFilePointerEx(_file,size,NULL,FILE_BEGIN);
+          SetEndOfFile(_file);
+        }
+      CloseHandle(_file);
+    }
+
+  _data    = NULL;
+  _size    = 0;
+  _mapping = NULL;
+  _file    = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+  : _data(NULL),
+    _size(0),
+    _writable(false),
+    _fd(-1)
+{
+}
+
+void
+MappedFile::open_read(const fs::path &filepath_)
+{
+  int rv;
+  void *addr;
+  struct stat st;
+
+  _fd = ::open(filepath_.string().c_str(),O_RDONLY);
+  if(_fd == -1)
+    throw fmt::exception("ERROR: failed to open {} - {}",filepath_,strerror(errno));
+
+  rv = ::fstat(_fd,&st);
+  if(rv == -1)
+    throw fmt::exception("ERROR: failed to stat {} - {}",filepath_,strerror(errno));
+
+  _size     = st.st_size;
+  _writable = false;
+  if(_size == 0)
+    return;
+
+  addr = ::mmap(NULL,_size,PROT_READ,MAP_PRIVATE,_fd,0);
+  if(addr == MAP_FAILED)
+    throw fmt::exception("ERROR: failed to map {} - {}",filepath_,strerror(errno));
+
+  _data = (uint8_t*)addr;
+  ::madvise(_data,_size,MADV_SEQUENTIAL);
+}
+
+void
+MappedFile::create(const fs::path &filepath_,
+                   std::size_t     capacity_)
+{
+  int rv;
+  void *addr;
+
+  _fd = ::open(filepath_.string().c_str(),O_RDWR|O_CREAT|O_TRUNC,0666);
+  if(_fd == -1)
+    throw fmt::exception("ERROR: failed to open {} - {}",filepath_,strerror(errno));
+
+  _size     = capacity_;
+  _writable = true;
+  if(_size == 0)
+    return;
+
+  rv = ::ftruncate(_fd,_size);
+  if(rv == -1)
+    throw fmt::exception("ERROR: failed to size {} - {}",filepath_,strerror(errno));
+
+  addr = ::mmap(NULL,_size,PROT_READ|PROT_WRITE,MAP_SHARED,_fd,0);
+  if(addr == MAP_FAILED)
+    throw fmt::exception("ERROR: failed to map {} - {}",filepath_,strerror(errno));
+
+  _data = (uint8_t*)addr;
+}
+
+void
+MappedFile::close(std::size_t used_)
+{
+  if(_data)
+    ::munmap(_data,_size);
+
+  if(_fd != -1)
+    {
+      if(_writable)
+        (void)!::ftruncate(_fd,used_);
+      ::close(_fd);
+    }
+
+  _data = NULL;
+  _size = 0;
+  _fd   = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  close(_size);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/*
+ * A thin wrapper over mmap (POSIX) / CreateFileMapping (Windows).
+ *
+ * open_read() maps an existing file read-only. create() creates or
+ * truncates a file, sizes it to the given capacity and maps it
+ * read-write so callers can write output directly into the page
+ * cache. close() unmaps and, for writable mappings, trims the file to
+ * the number of bytes actually used.
+ */
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+  void open_read(const std::filesystem::path &filepath);
+  void create(const std::filesystem::path &filepath,
+              std::size_t                  capacity);
+  void close(std::size_t used = 0);
+
+public:
+  uint8_t     *data() const { return _data; }
+  std::size_t  size() const { return _size; }
+
+private:
+  uint8_t     *_data;
+  std::size_t  _size;
+  bool         _writable;
+#ifdef _WIN32
+  void        *_file;
+  void        *_mapping;
+#else
+  int          _fd;
+#endif
+};
@@ -1,9 +1,39 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <string>
+#include <vector>
 
 struct Options
 {
   std::filesystem::path input_filepath;
   std::filesystem::path output_filepath;
+  std::vector<std::filesystem::path> filepaths;
+  std::filesystem::path manifest_filepath;
+  bool                  batch       = false;
+  unsigned              jobs        = 0;
+  unsigned              prefetch    = 0;
+  std::size_t           chunk_size  = (1024 * 1024);
+  bool                  mmap        = false;
+  std::size_t           split_size  = 0;
+  bool                  split_loss  = false;
+  bool                  stats       = false;
+  double                store_ratio = 0;
+  bool                  verify      = false;
+  bool                  pipeline    = false;
+  std::filesystem::path cache_dirpath;
+  std::size_t           cache_size  = (1024 * 1024 * 1024);
+  std::filesystem::path dictionary_filepath;
+  std::string           range;
+  bool                  strict      = false;
+  std::size_t           align       = 4;
+  std::size_t           min_size    = 256;
+  std::size_t           max_size    = (4 * 1024 * 1024);
+  std::filesystem::path extract_dirpath;
+  std::string           report      = "yaml";
+  int32_t               level       = 0;
+  std::size_t           bench_size  = (4 * 1024 * 1024);
+  unsigned              iterations  = 3;
 };
@@ -0,0 +1,126 @@
+#include "resource_usage.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+namespace l
+{
+  // User plus kernel time in seconds from GetProcessTimes() or
+  // GetThreadTimes(), which count in 100ns units
+  static
+  double
+  seconds(FILETIME const &kernel_,
+          FILETIME const &user_)
+  {
+    ULARGE_INTEGER k;
+    ULARGE_INTEGER u;
+
+    k.LowPart  = kernel_.dwLowDateTime;
+    k.HighPart = kernel_.dwHighDateTime;
+    u.LowPart  = user_.dwLowDateTime;
+    u.HighPart = user_.dwHighDateTime;
+
+    return ((k.QuadPart + u.QuadPart) / 10000000.0);
+  }
+}
+#else
+namespace l
+{
+  static
+  double
+  seconds(clockid_t clock_)
+  {
+    struct timespec ts;
+
+    if(clock_gettime(clock_,&ts) != 0)
+      return 0;
+
+    return (ts.tv_sec + (ts.tv_nsec / 1000000000.0));
+  }
+}
+#endif
+
+std::size_t
+ResourceUsage::peak_rss()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+
+  if(!K32GetProcessMemoryInfo(GetCurrentProcess(),&pmc,sizeof(pmc)))
+    return 0;
+
+  return pmc.PeakWorkingSetSize;
+#else
+  struct rusage ru;
+
+  if(getrusage(RUSAGE_SELF,&ru) != 0)
+    return 0;
+
+  return ((std::size_t)ru.ru_maxrss * 1024);
+#endif
+}
+
+double
+ResourceUsage::thread_cpu_seconds()
+{
+#ifdef _WIN32
+  FILETIME creation;
+  FILETIME exit;
+  FILETIME kernel;
+  FILETIME user;
+
+  if(!GetThreadTimes(GetCurrentThread(),&creation,&exit,&kernel,&user))
+    return 0;
+
+  return l::seconds(kernel,user);
+#else
+  return l::seconds(CLOCK_THREAD_CPUTIME_ID);
+#endif
+}
+
+double
+ResourceUsage::process_cpu_seconds()
+{
+#ifdef _WIN32
+  FILETIME creation;
+  FILETIME exit;
+  FILETIME kernel;
+  FILETIME user;
+
+  if(!GetProcessTimes(GetCurrentProcess(),&creation,&exit,&kernel,&user))
+    return 0;
+
+  return l::seconds(kernel,user);
+#else
+  return l::seconds(CLOCK_PROCESS_CPUTIME_ID);
+#endif
+}
+
+ResourceUsage::Stopwatch::Stopwatch(bool process_)
+  : _process(process_),
+    _wall(std::chrono::steady_clock::now()),
+    _cpu(process_ ?
+         ResourceUsage::process_cpu_seconds() :
+         ResourceUsage::thread_cpu_seconds())
+{
+}
+
+double
+ResourceUsage::Stopwatch::wall_seconds() const
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - _wall).count();
+}
+
+double
+ResourceUsage::Stopwatch::cpu_seconds() const
+{
+  return ((_process ?
+           ResourceUsage::process_cpu_seconds() :
+           ResourceUsage::thread_cpu_seconds()) - _cpu);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+/*
+ * What the process has used so far, for reports. Each is 0 where the
+ * platform can't tell.
+ */
+namespace ResourceUsage
+{
+  // Peak resident set size of the whole process in bytes
+  std::size_t peak_rss();
+
+  // CPU time, user plus system, of the calling thread or the process
+  double thread_cpu_seconds();
+  double process_cpu_seconds();
+
+  /*
+   * Wall and CPU time from construction to the call. The CPU time is
+   * that of the calling thread unless the work is spread over others,
+   * in which case it is the whole process's.
+   */
+  class Stopwatch
+  {
+  public:
+    explicit Stopwatch(bool process_ = false);
+
+  public:
+    double wall_seconds() const;
+    double cpu_seconds() const;
+
+  private:
+    bool                                  _process;
+    std::chrono::steady_clock::time_point _wall;
+    double                                _cpu;
+  };
+}
@@ -0,0 +1,151 @@
+#include "sha256.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace l
+{
+  static const uint32_t K[64] =
+    {
+      0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+      0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+      0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+      0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+      0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+      0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+      0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+      0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+    };
+
+  static
+  inline
+  uint32_t
+  rotr(uint32_t v_,
+       unsigned n_)
+  {
+    return ((v_ >> n_) | (v_ << (32 - n_)));
+  }
+}
+
+Sha256::Sha256()
+  : _state{0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,
+           0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19},
+    _block_size(0),
+    _total(0)
+{
+}
+
+void
+Sha256::compress(const uint8_t *block_)
+{
+  uint32_t w[64];
+  uint32_t s[8];
+  uint32_t t1;
+  uint32_t t2;
+
+  for(unsigned i = 0; i < 16; i++)
+    w[i] = (((uint32_t)block_[i * 4 + 0] << 24) |
+            ((uint32_t)block_[i * 4 + 1] << 16) |
+            ((uint32_t)block_[i * 4 + 2] <<  8) |
+            ((uint32_t)block_[i * 4 + 3] <<  0));
+  for(unsigned i = 16; i < 64; i++)
+    w[i] = (w[i - 16] +
+            (l::rotr(w[i - 15],7) ^ l::rotr(w[i - 15],18) ^ (w[i - 15] >> 3)) +
+            w[i - 7] +
+            (l::rotr(w[i - 2],17) ^ l::rotr(w[i - 2],19) ^ (w[i - 2] >> 10)));
+
+  memcpy(s,_state,sizeof(s));
+  for(unsigned i = 0; i < 64; i++)
+    {
+      t1 = (s[7] +
+            (l::rotr(s[4],6) ^ l::rotr(s[4],11) ^ l::rotr(s[4],25)) +
+            ((s[4] & s[5]) ^ (~s[4] & s[6])) +
+            l::K[i] +
+            w[i]);
+      t2 = ((l::rotr(s[0],2) ^ l::rotr(s[0],13) ^ l::rotr(s[0],22)) +
+            ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2])));
+      s[7] = s[6];
+      s[6] = s[5];
+      s[5] = s[4];
+      s[4] = (s[3] + t1);
+      s[3] = s[2];
+      s[2] = s[1];
+      s[1] = s[0];
+      s[0] = (t1 + t2);
+    }
+
+  for(unsigned i = 0; i < 8; i++)
+    _state[i] += s[i];
+}
+
+void
+Sha256::update(const void  *data_,
+               std::size_t  size_)
+{
+  std::size_t n;
+  const uint8_t *p;
+
+  p = (const uint8_t*)data_;
+  _total += size_;
+
+  if(_block_size)
+    {
+      n = std::min(size_,(sizeof(_block) - _block_size));
+      memcpy(&_block[_block_size],p,n);
+      _block_size += n;
+      p           += n;
+      size_       -= n;
+      if(_block_size < sizeof(_block))
+        return;
+      compress(_block);
+      _block_size = 0;
+    }
+
+  for(; size_ >= sizeof(_block); p += sizeof(_block), size_ -= sizeof(_block))
+    compress(p);
+
+  memcpy(_block,p,size_);
+  _block_size = size_;
+}
+
+Sha256::Digest
+Sha256::digest()
+{
+  Digest d;
+  uint64_t bits;
+  uint8_t pad[72] = {0x80};
+  uint8_t len[8];
+
+  bits = (_total * 8);
+  for(unsigned i = 0; i < 8; i++)
+    len[i] = (uint8_t)(bits >> (56 - (i * 8)));
+
+  // Pad to 56 bytes into a block, then the length in bits
+  update(pad,(1 + ((119 - _block_size) % 64)));
+  update(len,sizeof(len));
+
+  for(unsigned i = 0; i < 8; i++)
+    {
+      d[i * 4 + 0] = (uint8_t)(_state[i] >> 24);
+      d[i * 4 + 1] = (uint8_t)(_state[i] >> 16);
+      d[i * 4 + 2] = (uint8_t)(_state[i] >>  8);
+      d[i * 4 + 3] = (uint8_t)(_state[i] >>  0);
+    }
+
+  return d;
+}
+
+std::string
+Sha256::hex(Digest const &digest_)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+
+  for(auto b : digest_)
+    {
+      s += digits[b >> 4];
+      s += digits[b & 0xF];
+    }
+
+  return s;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * SHA-256 (FIPS 180-4). Used to name cache entries by their content,
+ * not for anything security related. update() may be called any
+ * number of times before digest(), which may be called once.
+ */
+class Sha256
+{
+public:
+  typedef std::array<uint8_t,32> Digest;
+
+public:
+  Sha256();
+
+public:
+  void   update(const void  *data,
+                std::size_t  size);
+  Digest digest();
+
+public:
+  static std::string hex(Digest const &digest);
+
+private:
+  void compress(const uint8_t *block);
+
+private:
+  uint32_t    _state[8];
+  uint8_t     _block[64];
+  std::size_t _block_size;
+  uint64_t    _total;
+};
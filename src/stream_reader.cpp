@@ -0,0 +1,126 @@
+#include "stream_reader.hpp"
+
+#include "fmt.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+
+StreamReader::StreamReader(FILE        *f_,
+                           std::size_t  bufsize_)
+  : _f(f_),
+    _next(0),
+    _held(false),
+    _eof(false),
+    _stop(false),
+    _error(0)
+{
+  bufsize_ = std::max(bufsize_,sizeof(uint32_t));
+  _bufs[0].data.resize(bufsize_);
+  _bufs[1].data.resize(bufsize_);
+
+  _thread = std::thread(&StreamReader::run,this);
+}
+
+// The thread is only waited on, never interrupted, so on a pipe this
+// can block until the writer sends one more block or closes.
+StreamReader::~StreamReader()
+{
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _stop = true;
+  }
+
+  _cv.notify_all();
+  _thread.join();
+}
+
+void
+StreamReader::run()
+{
+  int error;
+  unsigned idx;
+  std::size_t n;
+
+  idx = 0;
+  while(true)
+    {
+      Buffer &buf = _bufs[idx];
+
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+        _cv.wait(guard,[&](){ return (_stop || !buf.full); });
+        if(_stop)
+          return;
+      }
+
+      // fread() only comes up short at the end of input or on error
+      n     = fread(buf.data.data(),1,buf.data.size(),_f);
+      error = (ferror(_f) ? errno : 0);
+
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(error)
+          {
+            _error = error;
+            _eof   = true;
+          }
+        else
+          {
+            buf.len  = n;
+            buf.full = (n > 0);
+            _eof     = (n < buf.data.size());
+          }
+      }
+
+      _cv.notify_all();
+      if(error || (n < buf.data.size()))
+        return;
+
+      idx ^= 1;
+    }
+}
+
+std::size_t
+StreamReader::read(uint8_t **data_)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+
+  if(_held)
+    {
+      _bufs[_next].full = false;
+      _next ^= 1;
+      _held  = false;
+      _cv.notify_all();
+    }
+
+  _cv.wait(guard,[&](){ return (_bufs[_next].full || _eof); });
+
+  if(_bufs[_next].full)
+    {
+      _held  = true;
+      *data_ = _bufs[_next].data.data();
+      return _bufs[_next].len;
+    }
+
+  if(_error)
+    throw fmt::exception("ERROR: failed to read - {}",strerror(_error));
+
+  return 0;
+}
+
+void
+StreamReader::set_binary(FILE *f_)
+{
+#ifdef _WIN32
+  _setmode(_fileno(f_),_O_BINARY);
+#else
+  (void)f_;
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Reads a FILE on a background thread into two alternating buffers
+ * so the next block is being read while the caller processes the
+ * current one. Works on pipes as well as regular files and never
+ * holds more than two blocks in memory.
+ *
+ * read() returns the next block, which stays valid and writable until
+ * the following call to read(), or 0 at the end of input. A read
+ * error is rethrown from read() once the blocks before it have been
+ * consumed.
+ */
+class StreamReader
+{
+public:
+  StreamReader(FILE        *f,
+               std::size_t  bufsize);
+  ~StreamReader();
+
+public:
+  std::size_t read(uint8_t **data);
+
+public:
+  static void set_binary(FILE *f);
+
+private:
+  void run();
+
+private:
+  struct Buffer
+  {
+    std::vector<uint8_t> data;
+    std::size_t          len  = 0;
+    bool                 full = false;
+  };
+
+private:
+  FILE                    *_f;
+  Buffer                   _bufs[2];
+  unsigned                 _next;
+  bool                     _held;
+  bool                     _eof;
+  bool                     _stop;
+  int                      _error;
+  std::mutex               _lock;
+  std::condition_variable  _cv;
+  std::thread              _thread;
+};
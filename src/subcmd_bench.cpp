@@ -0,0 +1,393 @@
+#include "subcmd_bench.hpp"
+
+#include "compress.hpp"
+#include "cpu.hpp"
+#include "decompress.hpp"
+#include "fmt.hpp"
+#include "resource_usage.hpp"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace l
+{
+  struct Level
+  {
+    const char *name;
+    int32_t     level;
+  };
+
+  static const Level LEVELS[] =
+    {
+      {"sdk",     COMP_LEVEL_SDK},
+      {"fast",    COMP_LEVEL_FAST},
+      {"lazy",    COMP_LEVEL_LAZY},
+      {"optimal", COMP_LEVEL_OPTIMAL}
+    };
+
+  struct Corpus
+  {
+    std::string                       name;
+    std::vector<std::vector<uint8_t>> files;
+    std::size_t                       size = 0;
+  };
+
+  static
+  std::size_t
+  round_up_to_word(std::size_t v_)
+  {
+    return ((v_ + (sizeof(uint32_t) - 1)) & ~(sizeof(uint32_t) - 1));
+  }
+
+  // Fixed seed so every run and every release benchmarks the same bytes
+  static
+  uint64_t
+  xorshift(uint64_t &state_)
+  {
+    state_ ^= (state_ << 13);
+    state_ ^= (state_ >> 7);
+    state_ ^= (state_ << 17);
+
+    return state_;
+  }
+
+  static
+  std::vector<uint8_t>
+  gen_zeros(std::size_t size_)
+  {
+    return std::vector<uint8_t>(size_,0);
+  }
+
+  static
+  std::vector<uint8_t>
+  gen_random(std::size_t size_)
+  {
+    uint64_t state;
+    std::vector<uint8_t> buf(size_);
+
+    state = UINT64_C(0x9E3779B97F4A7C15);
+    for(auto &c : buf)
+      c = (uint8_t)(l::xorshift(state) >> 56);
+
+    return buf;
+  }
+
+  static
+  std::vector<uint8_t>
+  gen_text(std::size_t size_)
+  {
+    uint64_t state;
+    std::size_t words;
+    std::vector<uint8_t> buf;
+    static const char *vocab[] =
+      {
+        "the","3DO","opera","portfolio","cel","anim","aiff","sound","frame",
+        "bank","load","file","data","compress","window","phrase","index",
+        "length","stream","word","buffer","game","level","sprite","texture",
+        "palette","screen","music","track","sample","of","and","to","in"
+      };
+
+    buf.reserve(size_);
+    state = UINT64_C(0x2545F4914F6CDD1D);
+    words = 0;
+    while(buf.size() < size_)
+      {
+        const char *w = vocab[l::xorshift(state) % (sizeof(vocab) / sizeof(vocab[0]))];
+
+        buf.insert(buf.end(),w,w + strlen(w));
+        buf.push_back(((++words % 12) == 0) ? '\n' : ' ');
+      }
+    buf.resize(size_);
+
+    return buf;
+  }
+
+  static
+  void
+  add_file(fs::path const &filepath_,
+           Corpus         &corpus_)
+  {
+    FILE *f;
+    std::size_t size;
+    std::vector<uint8_t> buf;
+
+    size = fs::file_size(filepath_);
+    buf.resize(l::round_up_to_word(size),0);
+
+    f = fopen(filepath_.string().c_str(),"rb");
+    if(f == NULL)
+      throw fmt::exception("ERROR: failed to open {} - {}",filepath_,strerror(errno));
+    if(fread(buf.data(),1,size,f) != size)
+      {
+        fclose(f);
+        throw fmt::exception("ERROR: failed to read {} - {}",filepath_,strerror(errno));
+      }
+    fclose(f);
+
+    corpus_.size += buf.size();
+    corpus_.files.emplace_back(std::move(buf));
+  }
+
+  static
+  Corpus
+  load_corpus(fs::path const &path_)
+  {
+    Corpus corpus;
+    std::vector<fs::path> files;
+
+    corpus.name = path_.string();
+    if(!fs::is_directory(path_))
+      {
+        l::add_file(path_,corpus);
+        return corpus;
+      }
+
+    for(auto const &de : fs::recursive_directory_iterator(path_))
+      {
+        if(de.is_regular_file())
+          files.push_back(de.path());
+      }
+
+    std::sort(files.begin(),files.end());
+    for(auto const &file : files)
+      l::add_file(file,corpus);
+
+    return corpus;
+  }
+
+  static
+  Corpus
+  synthetic_corpus(const char           *name_,
+                   std::vector<uint8_t>  data_)
+  {
+    Corpus corpus;
+
+    data_.resize(l::round_up_to_word(data_.size()),0);
+
+    corpus.name = name_;
+    corpus.size = data_.size();
+    corpus.files.emplace_back(std::move(data_));
+
+    return corpus;
+  }
+
+  static
+  void
+  push_span(void           *words_,
+            const uint32_t *span_,
+            std::size_t     num_words_)
+  {
+    std::vector<uint32_t> *words = (std::vector<uint32_t>*)words_;
+
+    words->insert(words->end(),span_,span_ + num_words_);
+  }
+
+  static
+  void
+  compress(std::vector<uint8_t> const &src_,
+           int32_t                     level_,
+           void                       *workbuf_,
+           std::vector<uint32_t>      &dst_)
+  {
+    int rv;
+    Compressor *comp;
+
+    dst_.clear();
+
+    rv = CreateCompressorSpan(&comp,(CompSpanFunc)l::push_span,workbuf_,(void*)&dst_);
+    if(rv < 0)
+      throw std::runtime_error("CreateCompressor failed");
+
+    rv = SetCompressorLevel(comp,level_);
+    if(rv < 0)
+      throw std::runtime_error("SetCompressorLevel failed");
+
+    FeedCompressorBytes(comp,src_.data(),src_.size());
+    DeleteCompressor(comp);
+  }
+
+  static
+  void
+  stream_decompress(std::vector<uint32_t> const &src_,
+                    void                        *workbuf_,
+                    std::vector<uint32_t>       &dst_)
+  {
+    int rv;
+    Decompressor *decomp;
+
+    dst_.clear();
+
+    rv = CreateDecompressorSpan(&decomp,(CompSpanFunc)l::push_span,workbuf_,(void*)&dst_);
+    if(rv < 0)
+      throw std::runtime_error("CreateDecompressor failed");
+
+    FeedDecompressor(decomp,(void*)src_.data(),src_.size());
+    DeleteDecompressor(decomp);
+  }
+
+  // Best of N runs, in seconds
+  template<typename Func>
+  static
+  double
+  best_time(unsigned  iterations_,
+            Func     &&func_)
+  {
+    double best;
+    double secs;
+    std::chrono::steady_clock::time_point t0;
+
+    best = 0;
+    for(unsigned i = 0; i < std::max(iterations_,1U); i++)
+      {
+        t0 = std::chrono::steady_clock::now();
+        func_();
+        secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if((i == 0) || (secs < best))
+          best = secs;
+      }
+
+    return best;
+  }
+
+  static
+  double
+  mb_per_sec(std::size_t size_,
+             double      secs_)
+  {
+    return ((secs_ > 0) ? ((size_ / 1000000.0) / secs_) : 0);
+  }
+
+  static
+  double
+  ns_per_byte(std::size_t size_,
+              double      secs_)
+  {
+    return (size_ ? ((secs_ * 1000000000.0) / size_) : 0);
+  }
+
+  static
+  void
+  bench_corpus(Corpus const &corpus_,
+               unsigned      iterations_)
+  {
+    double secs;
+    std::size_t size;
+    std::unique_ptr<uint8_t[]> cworkbuf;
+    std::unique_ptr<uint8_t[]> dworkbuf;
+    std::vector<std::vector<uint32_t>> compressed;
+    std::vector<uint32_t> decompressed;
+
+    cworkbuf.reset(new uint8_t[GetCompressorWorkBufferSize()]);
+    dworkbuf.reset(new uint8_t[GetDecompressorWorkBufferSize()]);
+    compressed.resize(corpus_.files.size());
+
+    fmt::print("- corpus: {}\n"
+               "  - files: {}\n"
+               "  - size_in_bytes: {}\n"
+               ,
+               corpus_.name,
+               corpus_.files.size(),
+               corpus_.size);
+
+    for(auto const &level : LEVELS)
+      {
+        secs = l::best_time(iterations_,
+                            [&]()
+                            {
+                              for(std::size_t i = 0; i < corpus_.files.size(); i++)
+                                l::compress(corpus_.files[i],level.level,cworkbuf.get(),compressed[i]);
+                            });
+
+        size = 0;
+        for(auto const &c : compressed)
+          size += (c.size() * sizeof(uint32_t));
+
+        fmt::print("  - level: {}\n"
+                   "    - compressed_size_in_bytes: {}\n"
+                   "    - ratio: {:.4f}\n"
+                   "    - compress_mb_per_sec: {:.2f}\n"
+                   "    - compress_ns_per_byte: {:.2f}\n"
+                   "    - compress_memory_in_bytes: {}\n"
+                   ,
+                   level.name,
+                   size,
+                   (corpus_.size ? ((double)size / corpus_.size) : 0),
+                   l::mb_per_sec(corpus_.size,secs),
+                   l::ns_per_byte(corpus_.size,secs),
+                   GetCompressorLevelMemorySize(level.level));
+
+        // Decompression speed is reported against the uncompressed
+        // size so it compares directly with compression.
+        secs = l::best_time(iterations_,
+                            [&]()
+                            {
+                              for(std::size_t i = 0; i < corpus_.files.size(); i++)
+                                l::stream_decompress(compressed[i],dworkbuf.get(),decompressed);
+                            });
+
+        fmt::print("    - stream_decompress_mb_per_sec: {:.2f}\n"
+                   "    - stream_decompress_ns_per_byte: {:.2f}\n"
+                   "    - stream_decompress_memory_in_bytes: {}\n"
+                   ,
+                   l::mb_per_sec(corpus_.size,secs),
+                   l::ns_per_byte(corpus_.size,secs),
+                   GetDecompressorWorkBufferSize());
+
+        secs = l::best_time(iterations_,
+                            [&]()
+                            {
+                              for(std::size_t i = 0; i < corpus_.files.size(); i++)
+                                {
+                                  std::vector<uint8_t> const &file = corpus_.files[i];
+                                  int rv;
+
+                                  decompressed.resize(file.size() / sizeof(uint32_t));
+                                  rv = SimpleDecompress((void*)compressed[i].data(),
+                                                        compressed[i].size(),
+                                                        decompressed.data(),
+                                                        decompressed.size());
+                                  if((rv < 0) ||
+                                     (memcmp(decompressed.data(),file.data(),file.size()) != 0))
+                                    throw fmt::exception("ERROR: {} level {} failed to round trip",
+                                                         corpus_.name,
+                                                         level.name);
+                                }
+                            });
+
+        fmt::print("    - simple_decompress_mb_per_sec: {:.2f}\n"
+                   "    - simple_decompress_ns_per_byte: {:.2f}\n"
+                   ,
+                   l::mb_per_sec(corpus_.size,secs),
+                   l::ns_per_byte(corpus_.size,secs));
+      }
+  }
+}
+
+void
+SubCmd::bench(Options const &opts_)
+{
+  std::vector<l::Corpus> corpora;
+
+  corpora.emplace_back(l::synthetic_corpus("zeros",l::gen_zeros(opts_.bench_size)));
+  corpora.emplace_back(l::synthetic_corpus("random",l::gen_random(opts_.bench_size)));
+  corpora.emplace_back(l::synthetic_corpus("text",l::gen_text(opts_.bench_size)));
+  for(auto const &path : opts_.filepaths)
+    corpora.emplace_back(l::load_corpus(path));
+
+  fmt::print("- kernels: {}\n",cpu_level_name(cpu_level()));
+
+  for(auto const &corpus : corpora)
+    l::bench_corpus(corpus,opts_.iterations);
+
+  fmt::print("- peak_rss_in_bytes: {}\n",ResourceUsage::peak_rss());
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "options.hpp"
+
+namespace SubCmd
+{
+  void bench(Options const &opts);
+}
@@ -1,10 +1,24 @@
 #include "subcmd_check.hpp"
 
 #include "compress.hpp"
+#include "container.hpp"
+#include "cpu.hpp"
 #include "decompress.hpp"
 #include "fmt.hpp"
+#include "mapped_file.hpp"
+#include "work_pool.hpp"
 
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -132,7 +146,16 @@ namespace l
   }
 
   static
-  void
+  uint32_t
+  next_random(uint32_t &seed_)
+  {
+    seed_ = (seed_ * 1103515245) + 12345;
+
+    return ((seed_ >> 16) & 0x7FFF);
+  }
+
+  static
+  bool
   check_compression()
   {
     int rv;
@@ -140,6 +163,8 @@ namespace l
     Compressor *comp;
     std::vector<uint32_t> local_compressed_data;
 
+    local_compressed_data.reserve(compressed_data_len / sizeof(uint32_t));
+
     rv = CreateCompressor(&comp,(CompFunc)l::write_word,NULL,(void*)&local_compressed_data);
     if(rv < 0)
       throw std::runtime_error("CreateCompressor failed");
@@ -152,14 +177,11 @@ namespace l
 
     rv = memcmp(local_compressed_data.data(),compressed_data,compressed_data_len);
 
-    if(rv == 0)
-      fmt::print("* output of 3ct compressor matches SDK\n");
-    else
-      fmt::print("* output of 3ct compressor does NOT match SDK");
+    return (rv == 0);
   }
 
   static
-  void
+  bool
   check_decompression()
   {
     int rv;
@@ -167,6 +189,8 @@ namespace l
     Decompressor *decomp;
     std::vector<uint32_t> local_uncompressed_data;
 
+    local_uncompressed_data.reserve(uncompressed_data_len / sizeof(uint32_t));
+
     rv = CreateDecompressor(&decomp,(CompFunc)l::write_word,NULL,(void*)&local_uncompressed_data);
     if(rv < 0)
       throw std::runtime_error("CreateCompressor failed");
@@ -179,16 +203,848 @@ namespace l
 
     rv = memcmp(local_uncompressed_data.data(),uncompressed_data,uncompressed_data_len);
 
-    if(rv == 0)
-      fmt::print("* output of 3ct decompressor matches SDK\n");
+    return (rv == 0);
+  }
+
+  static
+  bool
+  check_simple_decompression()
+  {
+    int rv;
+    std::vector<uint32_t> local_uncompressed_data;
+
+    local_uncompressed_data.resize(uncompressed_data_len / sizeof(uint32_t));
+
+    rv = SimpleDecompress((void*)compressed_data,
+                          compressed_data_len / sizeof(uint32_t),
+                          local_uncompressed_data.data(),
+                          local_uncompressed_data.size());
+    if(rv >= 0)
+      rv = memcmp(local_uncompressed_data.data(),uncompressed_data,uncompressed_data_len);
+
+    return (rv == 0);
+  }
+
+  // The SDK stream followed by data that isn't part of it, as found
+  // in disc images. However the input is split into feeds nothing
+  // past the end of stream marker may be decoded.
+  static
+  bool
+  check_trailing_data()
+  {
+    int rv;
+    uint32_t seed;
+    uint32_t *words;
+    uint32_t num_words;
+    Decompressor *decomp;
+    std::vector<uint8_t> input(compressed_data,compressed_data + compressed_data_len);
+    std::vector<uint32_t> local_uncompressed_data;
+
+    seed = 1;
+    for(unsigned i = 0; i < 4096; i++)
+      input.push_back((uint8_t)l::next_random(seed));
+
+    words     = (uint32_t*)input.data();
+    num_words = (input.size() / sizeof(uint32_t));
+    for(uint32_t chunk : {1U,3U,64U,num_words})
+      {
+        local_uncompressed_data.clear();
+
+        rv = CreateDecompressor(&decomp,(CompFunc)l::write_word,NULL,(void*)&local_uncompressed_data);
+        if(rv < 0)
+          throw std::runtime_error("CreateDecompressor failed");
+
+        for(uint32_t i = 0; i < num_words; i += chunk)
+          FeedDecompressor(decomp,&words[i],std::min(chunk,num_words - i));
+
+        rv = DeleteDecompressor(decomp);
+        if(rv != COMP_ERR_DATAREMAINS)
+          return false;
+
+        if(local_uncompressed_data.size() != (uncompressed_data_len / sizeof(uint32_t)))
+          return false;
+        if(memcmp(local_uncompressed_data.data(),uncompressed_data,uncompressed_data_len) != 0)
+          return false;
+      }
+
+    return true;
+  }
+
+  // Every compressor level, the SDK's first
+  static const int32_t all_levels[] =
+    {COMP_LEVEL_SDK,COMP_LEVEL_FAST,COMP_LEVEL_LAZY,COMP_LEVEL_OPTIMAL};
+
+  // The embedded data and a pseudo-random buffer of literal runs and
+  // copies of earlier data from up to twice the window back, so some
+  // repeats can't be matched
+  static
+  std::vector<std::vector<uint8_t>>
+  round_trip_inputs()
+  {
+    uint32_t seed;
+    uint32_t len;
+    std::size_t from;
+    std::vector<uint8_t> mixed;
+
+    seed = 1;
+    while(mixed.size() < (64 * 1024))
+      {
+        len = (1 + (l::next_random(seed) % 24));
+        if(mixed.empty() || (l::next_random(seed) & 1))
+          {
+            while(len--)
+              mixed.push_back((uint8_t)l::next_random(seed));
+            continue;
+          }
+
+        from = (mixed.size() - 1 - (l::next_random(seed) % std::min<std::size_t>(mixed.size(),8192)));
+        while(len--)
+          mixed.push_back(mixed[from++]);
+      }
+    mixed.resize(64 * 1024);
+
+    return {std::vector<uint8_t>(uncompressed_data,uncompressed_data + uncompressed_data_len),
+            mixed};
+  }
+
+  static
+  int
+  compress_bytes(int32_t                     level_,
+                 std::vector<uint8_t> const &src_,
+                 std::vector<uint8_t> const &dict_,
+                 std::vector<uint32_t>      &stream_)
+  {
+    int rv;
+    Compressor *comp;
+
+    stream_.clear();
+
+    rv = CreateCompressor(&comp,(CompFunc)l::write_word,NULL,(void*)&stream_);
+    if(rv < 0)
+      return rv;
+
+    rv = SetCompressorLevel(comp,level_);
+    if((rv >= 0) && !dict_.empty())
+      rv = SetCompressorDictionary(comp,dict_.data(),dict_.size());
+    if(rv >= 0)
+      rv = FeedCompressorBytes(comp,src_.data(),src_.size());
+    if(rv < 0)
+      {
+        DeleteCompressor(comp);
+        return rv;
+      }
+
+    return DeleteCompressor(comp);
+  }
+
+  // Returns what DeleteDecompressor() does. max_words_ is only used
+  // when strict_.
+  static
+  int
+  decompress_words(std::vector<uint32_t> const &stream_,
+                   std::vector<uint8_t> const  &dict_,
+                   bool                         strict_,
+                   uint64_t                     max_words_,
+                   std::vector<uint32_t>       &out_)
+  {
+    int rv;
+    Decompressor *decomp;
+
+    out_.clear();
+
+    rv = CreateDecompressor(&decomp,(CompFunc)l::write_word,NULL,(void*)&out_);
+    if(rv < 0)
+      return rv;
+
+    if(!dict_.empty())
+      SetDecompressorDictionary(decomp,dict_.data(),dict_.size());
+    if(strict_)
+      SetDecompressorStrict(decomp,max_words_);
+    FeedDecompressor(decomp,(void*)stream_.data(),stream_.size());
+
+    return DeleteDecompressor(decomp);
+  }
+
+  static
+  bool
+  same_bytes(std::vector<uint32_t> const &words_,
+             std::vector<uint8_t> const  &src_)
+  {
+    return ((words_.size() * sizeof(uint32_t)) == src_.size() &&
+            (memcmp(words_.data(),src_.data(),src_.size()) == 0));
+  }
+
+  // What every stream must do, whichever way it was produced
+  static
+  bool
+  decodes_to(std::vector<uint32_t> const &stream_,
+             std::vector<uint8_t> const  &src_)
+  {
+    int rv;
+    std::vector<uint32_t> out;
+
+    if(stream_.size() > GetCompressedSizeBound(src_.size() / sizeof(uint32_t)))
+      return false;
+    if(GetDecompressedSize(stream_.data(),stream_.size()) != (int32_t)(src_.size() / sizeof(uint32_t)))
+      return false;
+
+    out.resize(src_.size() / sizeof(uint32_t));
+    rv = SimpleDecompress((void*)stream_.data(),stream_.size(),out.data(),out.size());
+    if((rv != (int)out.size()) || !l::same_bytes(out,src_))
+      return false;
+
+    rv = l::decompress_words(stream_,{},false,0,out);
+
+    return ((rv == 0) && l::same_bytes(out,src_));
+  }
+
+  template<int32_t LEVEL>
+  static
+  bool
+  check_level()
+  {
+    std::vector<uint32_t> stream;
+
+    for(auto const &src : l::round_trip_inputs())
+      {
+        if(l::compress_bytes(LEVEL,src,{},stream) < 0)
+          return false;
+        if(!l::decodes_to(stream,src))
+          return false;
+      }
+
+    return true;
+  }
+
+  // One context per level for every stream, including one after a
+  // stream of the other input, must give what a new context does
+  static
+  bool
+  check_reuse()
+  {
+    int rv;
+    Compressor *comp;
+    Decompressor *decomp;
+    std::vector<uint32_t> out;
+    std::vector<uint32_t> fresh;
+    std::vector<std::vector<uint8_t>> srcs;
+
+    srcs = l::round_trip_inputs();
+    srcs.push_back(srcs[0]);
+
+    for(int32_t level : l::all_levels)
+      {
+        rv = CreateCompressor(&comp,(CompFunc)l::write_word,NULL,(void*)&out);
+        if(rv < 0)
+          throw std::runtime_error("CreateCompressor failed");
+        SetCompressorLevel(comp,level);
+
+        rv = 0;
+        for(std::size_t i = 0; (rv >= 0) && (i < srcs.size()); i++)
+          {
+            out.clear();
+            if(i)
+              ResetCompressor(comp,(CompFunc)l::write_word,(void*)&out);
+            FeedCompressorBytes(comp,srcs[i].data(),srcs[i].size());
+            rv = FinishCompressor(comp);
+            if((rv < 0) || (l::compress_bytes(level,srcs[i],{},fresh) < 0) || (out != fresh))
+              rv = -1;
+          }
+        DeleteCompressor(comp);
+        if(rv < 0)
+          return false;
+      }
+
+    rv = CreateDecompressor(&decomp,(CompFunc)l::write_word,NULL,(void*)&out);
+    if(rv < 0)
+      throw std::runtime_error("CreateDecompressor failed");
+
+    for(std::size_t i = 0; (rv >= 0) && (i < srcs.size()); i++)
+      {
+        out.clear();
+        if(i)
+          ResetDecompressor(decomp,(CompFunc)l::write_word,(void*)&out);
+        l::compress_bytes(COMP_LEVEL_FAST,srcs[i],{},fresh);
+        FeedDecompressor(decomp,fresh.data(),fresh.size());
+        rv = FinishDecompressor(decomp);
+        if((rv < 0) || !l::same_bytes(out,srcs[i]))
+          rv = -1;
+      }
+    DeleteDecompressor(decomp);
+
+    return (rv >= 0);
+  }
+
+  // Feeds of any size, none a multiple of a word, must give what a
+  // single feed does
+  static
+  bool
+  check_byte_feeds()
+  {
+    int rv;
+    std::size_t n;
+    Compressor *comp;
+    std::vector<uint32_t> out;
+    std::vector<uint32_t> whole;
+    static const std::size_t splits[] = {1,3,5,7,4093};
+
+    for(auto const &src : l::round_trip_inputs())
+      {
+        for(int32_t level : l::all_levels)
+          {
+            out.clear();
+            rv = CreateCompressor(&comp,(CompFunc)l::write_word,NULL,(void*)&out);
+            if(rv < 0)
+              throw std::runtime_error("CreateCompressor failed");
+            SetCompressorLevel(comp,level);
+
+            for(std::size_t i = 0, j = 0; i < src.size(); i += n, j++)
+              {
+                n = std::min(splits[j % 5],src.size() - i);
+                FeedCompressorBytes(comp,&src[i],n);
+              }
+
+            rv = DeleteCompressor(comp);
+            if((rv < 0) || (l::compress_bytes(level,src,{},whole) < 0) || (out != whole))
+              return false;
+          }
+      }
+
+    return true;
+  }
+
+  // The dictionary is longer than the window so only its tail is
+  // used. A stream that leans on it is smaller and, decoded without
+  // it, reaches back before the start of the stream.
+  static
+  bool
+  check_dictionary()
+  {
+    int rv;
+    std::vector<uint8_t> src;
+    std::vector<uint8_t> dict;
+    std::vector<uint32_t> out;
+    std::vector<uint32_t> plain;
+    std::vector<uint32_t> stream;
+
+    src  = l::round_trip_inputs()[1];
+    dict = src;
+    dict.resize(8192);
+    src.erase(src.begin(),src.begin() + 6144);
+
+    for(int32_t level : l::all_levels)
+      {
+        if(l::compress_bytes(level,src,dict,stream) < 0)
+          return false;
+        if(l::compress_bytes(level,src,{},plain) < 0)
+          return false;
+        if(stream.size() >= plain.size())
+          return false;
+
+        rv = l::decompress_words(stream,dict,false,0,out);
+        if((rv != 0) || !l::same_bytes(out,src))
+          return false;
+
+        rv = l::decompress_words(stream,{},true,0,out);
+        if(rv != COMP_ERR_BADREF)
+          return false;
+      }
+
+    return true;
+  }
+
+  // Both strict decoders must accept a whole stream and give the same
+  // error and bit offset for one truncated, one reaching back before
+  // its start and one larger than allowed
+  static
+  bool
+  check_strict()
+  {
+    int rv;
+    uint64_t bit;
+    uint32_t stream_words;
+    std::vector<uint8_t> src;
+    std::vector<uint32_t> out;
+    std::vector<uint32_t> stream;
+    std::vector<uint32_t> truncated;
+    uint32_t bad_ref[2];
+    Decompressor *decomp;
+    // A literal 'a', then a phrase at bit 9 copying from 4093 bytes
+    // back, then the end of stream marker
+    static const uint8_t bad_ref_data[] = {0xB0, 0x80, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    memcpy(bad_ref,bad_ref_data,sizeof(bad_ref));
+
+    src = l::round_trip_inputs()[1];
+    if(l::compress_bytes(COMP_LEVEL_FAST,src,{},stream) < 0)
+      return false;
+
+    out.resize(src.size() / sizeof(uint32_t));
+    rv = StrictDecompress(stream.data(),stream.size(),out.data(),out.size(),&stream_words,&bit);
+    if((rv != (int)out.size()) || (stream_words != stream.size()) || !l::same_bytes(out,src))
+      return false;
+    if(l::decompress_words(stream,{},true,out.size(),out) != 0)
+      return false;
+
+    rv = StrictDecompress(stream.data(),stream.size(),out.data(),out.size() - 1,NULL,&bit);
+    if(rv != COMP_ERR_OVERFLOW)
+      return false;
+    if(l::decompress_words(stream,{},true,out.size() - 1,out) != COMP_ERR_OVERFLOW)
+      return false;
+
+    truncated.assign(stream.begin(),stream.begin() + (stream.size() / 2));
+    rv = StrictDecompress(truncated.data(),truncated.size(),out.data(),out.size(),NULL,&bit);
+    if((rv != COMP_ERR_DATAMISSING) || (bit != ((uint64_t)truncated.size() * 32)))
+      return false;
+    if(l::decompress_words(truncated,{},true,0,out) != COMP_ERR_DATAMISSING)
+      return false;
+
+    out.resize(2);
+    rv = StrictDecompress(bad_ref,2,out.data(),out.size(),NULL,&bit);
+    if((rv != COMP_ERR_BADREF) || (bit != 9))
+      return false;
+
+    rv = CreateDecompressor(&decomp,(CompFunc)l::write_word,NULL,(void*)&out);
+    if(rv < 0)
+      throw std::runtime_error("CreateDecompressor failed");
+    out.clear();
+    SetDecompressorStrict(decomp,0);
+    rv = FeedDecompressor(decomp,bad_ref,2);
+    GetDecompressorPosition(decomp,&bit);
+    DeleteDecompressor(decomp);
+
+    return ((rv == COMP_ERR_BADREF) && (bit == 9));
+  }
+
+  static
+  std::vector<uint8_t>
+  read_file(fs::path const &filepath_)
+  {
+    MappedFile f;
+
+    f.open_read(filepath_);
+
+    return std::vector<uint8_t>(f.data(),f.data() + f.size());
+  }
+
+  // A container of an input which isn't a whole number of segments or
+  // words decoded whole and in ranges within, across and past its
+  // segments
+  static
+  bool
+  check_container_ranges(std::vector<uint8_t> const &src_,
+                         fs::path const             &container_filepath_,
+                         fs::path const             &output_filepath_)
+  {
+    FILE *f;
+    uint64_t end;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> range;
+    static const uint64_t ranges[][2] =
+      {
+        {0,1},{4095,2},{5000,10000},{0,UINT64_MAX},{65532,100},{65533,1}
+      };
+
+    Container::compress(src_.data(),src_.size(),container_filepath_,4096,COMP_LEVEL_FAST,2);
+
+    data = l::read_file(container_filepath_);
+    if(!Container::is_container(data.data(),data.size()))
+      return false;
+
+    Container::decompress(data.data(),data.size(),output_filepath_,2);
+    if(l::read_file(output_filepath_) != src_)
+      return false;
+
+    for(auto const &r : ranges)
+      {
+        f = tmpfile();
+        if(f == NULL)
+          throw fmt::exception("ERROR: failed to create temporary file - {}",strerror(errno));
+
+        range.resize(src_.size());
+        Container::decompress_range(data.data(),data.size(),r[0],r[1],f);
+        rewind(f);
+        range.resize(fread(range.data(),1,range.size(),f));
+        fclose(f);
+
+        end = (r[0] + std::min<uint64_t>(r[1],src_.size() - r[0]));
+        if(range != std::vector<uint8_t>(src_.begin() + r[0],src_.begin() + end))
+          return false;
+      }
+
+    try
+      {
+        Container::decompress_range(data.data(),data.size(),src_.size() + 1,1,NULL);
+      }
+    catch(const std::exception &)
+      {
+        return true;
+      }
+
+    return false;
+  }
+
+  static
+  bool
+  check_container()
+  {
+    bool ok;
+    std::error_code ec;
+    std::vector<uint8_t> src;
+    fs::path container_filepath;
+    fs::path output_filepath;
+
+    src = l::round_trip_inputs()[1];
+    src.resize(src.size() - 3);
+
+    output_filepath     = (fs::temp_directory_path() / fmt::format("3ct-check.{}",getpid()));
+    container_filepath  = output_filepath;
+    container_filepath += ".3ctc";
+
+    try
+      {
+        ok = l::check_container_ranges(src,container_filepath,output_filepath);
+      }
+    catch(const std::exception &)
+      {
+        ok = false;
+      }
+
+    fs::remove(container_filepath,ec);
+    fs::remove(output_filepath,ec);
+
+    return ok;
+  }
+
+  // Runs check_ with each build of the codec's kernels the CPU can
+  // run, see cpu.hpp, which must all pass, and returns the names of
+  // those that didn't
+  static
+  std::string
+  failed_kernels(bool (*check_)())
+  {
+    int level;
+    std::string failed;
+
+    level = cpu_level();
+    for(int l = CPU_LEVEL_BASELINE; l <= cpu_level_supported(); l++)
+      {
+        cpu_set_level(l);
+        if(!check_())
+          failed += fmt::format(" {}",cpu_level_name(l));
+      }
+    cpu_set_level(level);
+
+    return failed;
+  }
+
+  static
+  void
+  check_sdk(const char *what_,
+            bool      (*check_)())
+  {
+    std::string failed;
+
+    failed = l::failed_kernels(check_);
+    if(failed.empty())
+      fmt::print("* output of 3ct {} matches SDK\n",what_);
+    else
+      fmt::print("* output of 3ct {} does NOT match SDK with kernels:{}\n",what_,failed);
+  }
+
+  // For what the SDK has no equivalent of, checked against itself
+  static
+  void
+  check_round_trip(const char *what_,
+                   bool      (*check_)())
+  {
+    std::string failed;
+
+    failed = l::failed_kernels(check_);
+    if(failed.empty())
+      fmt::print("* 3ct {} round trips\n",what_);
     else
-      fmt::print("* output of 3ct decompressor does NOT match SDK");
+      fmt::print("* 3ct {} does NOT round trip with kernels:{}\n",what_,failed);
+  }
+
+  // A golden pair is an original file next to the SDK's output for
+  // it, named like compress names its output.
+  struct Golden
+  {
+    fs::path    src_filepath;
+    fs::path    compressed_filepath;
+    std::size_t src_size        = 0;
+    std::size_t compressed_size = 0;
+    bool        compress_ok     = false;
+    bool        decompress_ok   = false;
+    bool        simple_ok       = false;
+    double      compress_secs   = 0;
+    double      decompress_secs = 0;
+    double      simple_secs     = 0;
+    std::string error;
+
+    bool ok() const { return (error.empty() && compress_ok && decompress_ok && simple_ok); }
+  };
+
+  static
+  void
+  find_golden(fs::path const      &dir_,
+              std::vector<Golden> &pairs_)
+  {
+    Golden g;
+    fs::path src;
+    std::vector<fs::path> found;
+
+    if(!fs::is_directory(dir_))
+      throw fmt::exception("ERROR: {} is not a directory",dir_);
+
+    for(auto const &de : fs::recursive_directory_iterator(dir_))
+      {
+        if(!de.is_regular_file() || (de.path().extension() != ".compressed"))
+          continue;
+
+        src = de.path();
+        src.replace_extension();
+        if(fs::is_regular_file(src))
+          found.push_back(src);
+      }
+
+    std::sort(found.begin(),found.end());
+    for(auto const &f : found)
+      {
+        g.src_filepath         = f;
+        g.compressed_filepath  = f;
+        g.compressed_filepath += ".compressed";
+        pairs_.push_back(g);
+      }
+  }
+
+  static
+  void
+  push_span(void           *words_,
+            const uint32_t *span_,
+            std::size_t     num_words_)
+  {
+    std::vector<uint32_t> *words = (std::vector<uint32_t>*)words_;
+
+    words->insert(words->end(),span_,span_ + num_words_);
+  }
+
+  static
+  double
+  seconds_since(std::chrono::steady_clock::time_point t0_)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count();
+  }
+
+  // Decoded output is word padded with zeros
+  static
+  bool
+  matches_original(const uint8_t *decoded_,
+                   std::size_t    decoded_size_,
+                   const uint8_t *src_,
+                   std::size_t    src_size_)
+  {
+    std::size_t padded;
+
+    padded = ((src_size_ + 3) & ~(std::size_t)3);
+    if(decoded_size_ != padded)
+      return false;
+    if(memcmp(decoded_,src_,src_size_) != 0)
+      return false;
+
+    return std::all_of(&decoded_[src_size_],&decoded_[padded],
+                       [](uint8_t c_) { return (c_ == 0); });
+  }
+
+  static
+  void
+  check_golden(Golden &g_,
+               void   *workbuf_)
+  {
+    int rv;
+    Compressor *comp;
+    Decompressor *decomp;
+    MappedFile src;
+    MappedFile compressed;
+    std::vector<uint32_t> words;
+    std::chrono::steady_clock::time_point t0;
+    static const uint8_t zeros[sizeof(uint32_t)] = {0};
+
+    src.open_read(g_.src_filepath);
+    compressed.open_read(g_.compressed_filepath);
+    g_.src_size        = src.size();
+    g_.compressed_size = compressed.size();
+    if(g_.compressed_size & 0x3)
+      throw fmt::exception("ERROR: {} is not a multiple of 4 bytes",g_.compressed_filepath);
+
+    words.reserve(std::max(g_.compressed_size,g_.src_size + 3) / sizeof(uint32_t));
+
+    t0 = std::chrono::steady_clock::now();
+    rv = CreateCompressorSpan(&comp,(CompSpanFunc)l::push_span,workbuf_,(void*)&words);
+    if(rv < 0)
+      throw std::runtime_error("CreateCompressor failed");
+    FeedCompressorBytes(comp,src.data(),src.size());
+    if(src.size() & 0x3)
+      FeedCompressorBytes(comp,zeros,sizeof(uint32_t) - (src.size() & 0x3));
+    DeleteCompressor(comp);
+    g_.compress_secs = l::seconds_since(t0);
+    g_.compress_ok   = ((words.size() * sizeof(uint32_t) == g_.compressed_size) &&
+                        (memcmp(words.data(),compressed.data(),g_.compressed_size) == 0));
+
+    words.clear();
+    t0 = std::chrono::steady_clock::now();
+    rv = CreateDecompressorSpan(&decomp,(CompSpanFunc)l::push_span,NULL,(void*)&words);
+    if(rv < 0)
+      throw std::runtime_error("CreateDecompressor failed");
+    FeedDecompressor(decomp,compressed.data(),g_.compressed_size / sizeof(uint32_t));
+    rv = DeleteDecompressor(decomp);
+    g_.decompress_secs = l::seconds_since(t0);
+    g_.decompress_ok   = ((rv == 0) &&
+                          l::matches_original((const uint8_t*)words.data(),
+                                              words.size() * sizeof(uint32_t),
+                                              src.data(),
+                                              src.size()));
+
+    words.assign((src.size() + 3) / sizeof(uint32_t),0);
+    t0 = std::chrono::steady_clock::now();
+    rv = SimpleDecompress(compressed.data(),
+                          g_.compressed_size / sizeof(uint32_t),
+                          words.data(),
+                          words.size());
+    g_.simple_secs = l::seconds_since(t0);
+    g_.simple_ok   = ((rv >= 0) &&
+                      l::matches_original((const uint8_t*)words.data(),
+                                          rv * sizeof(uint32_t),
+                                          src.data(),
+                                          src.size()));
+  }
+
+  static
+  std::string
+  describe(bool        ok_,
+           std::size_t size_,
+           double      secs_)
+  {
+    return fmt::format("{} ({:.2f} MB/s)",
+                       (ok_ ? "matches SDK" : "does NOT match SDK"),
+                       (secs_ > 0 ? (size_ / secs_ / 1000000.0) : 0.0));
+  }
+
+  static
+  void
+  print_golden(Golden const &g_)
+  {
+    if(!g_.error.empty())
+      {
+        fmt::print("- golden: {}\n"
+                   "  - error: {}\n"
+                   ,
+                   g_.src_filepath,
+                   g_.error);
+        return;
+      }
+
+    fmt::print("- golden: {}\n"
+               "  - size_in_bytes: {}\n"
+               "  - compressed_size_in_bytes: {}\n"
+               "  - compressor: {}\n"
+               "  - decompressor: {}\n"
+               "  - simple_decompressor: {}\n"
+               ,
+               g_.src_filepath,
+               g_.src_size,
+               g_.compressed_size,
+               l::describe(g_.compress_ok,g_.src_size,g_.compress_secs),
+               l::describe(g_.decompress_ok,g_.src_size,g_.decompress_secs),
+               l::describe(g_.simple_ok,g_.src_size,g_.simple_secs));
+  }
+
+  // Throughput is reported per thread, summed over every pair, so it
+  // doesn't depend on the number of jobs.
+  static
+  void
+  check_golden_dirs(Options const &opts_)
+  {
+    std::size_t next;
+    std::size_t failed;
+    std::mutex print_lock;
+    std::vector<bool> done;
+    std::vector<Golden> pairs;
+    std::vector<std::unique_ptr<uint8_t[]>> workbufs;
+    Golden total;
+
+    for(auto const &dir : opts_.filepaths)
+      l::find_golden(dir,pairs);
+    if(pairs.empty())
+      throw std::runtime_error("ERROR: no golden pairs (FILE and FILE.compressed) found");
+
+    WorkPool pool(opts_.jobs ? opts_.jobs : WorkPool::default_threads());
+    for(unsigned i = 0; i < pool.size(); i++)
+      workbufs.emplace_back(new uint8_t[GetCompressorWorkBufferSize()]);
+
+    next = 0;
+    done.resize(pairs.size(),false);
+    pool.run(pairs.size(),
+             [&](std::size_t task_,
+                 unsigned    worker_)
+             {
+               try
+                 {
+                   l::check_golden(pairs[task_],workbufs[worker_].get());
+                 }
+               catch(const std::exception &e_)
+                 {
+                   pairs[task_].error = e_.what();
+                 }
+
+               std::lock_guard<std::mutex> guard(print_lock);
+               done[task_] = true;
+               while((next < done.size()) && done[next])
+                 l::print_golden(pairs[next++]);
+             });
+
+    failed = 0;
+    for(auto const &g : pairs)
+      {
+        failed                += !g.ok();
+        total.src_size        += g.src_size;
+        total.compress_secs   += g.compress_secs;
+        total.decompress_secs += g.decompress_secs;
+        total.simple_secs     += g.simple_secs;
+      }
+
+    fmt::print("* {} of {} golden pairs match SDK\n"
+               "* compressor: {:.2f} MB/s, decompressor: {:.2f} MB/s, "
+               "simple decompressor: {:.2f} MB/s\n"
+               ,
+               pairs.size() - failed,
+               pairs.size(),
+               (total.compress_secs > 0 ? (total.src_size / total.compress_secs / 1000000.0) : 0.0),
+               (total.decompress_secs > 0 ? (total.src_size / total.decompress_secs / 1000000.0) : 0.0),
+               (total.simple_secs > 0 ? (total.src_size / total.simple_secs / 1000000.0) : 0.0));
+
+    if(failed)
+      throw fmt::exception("ERROR: {} golden pairs do NOT match SDK",failed);
   }
 }
 
 void
-SubCmd::check()
+SubCmd::check(Options const &opts_)
 {
-  l::check_compression();
-  l::check_decompression();
+  l::check_sdk("compressor",l::check_compression);
+  l::check_sdk("decompressor",l::check_decompression);
+  l::check_sdk("simple decompressor",l::check_simple_decompression);
+  l::check_sdk("decompressor with trailing data",l::check_trailing_data);
+  l::check_round_trip("fast compressor",l::check_level<COMP_LEVEL_FAST>);
+  l::check_round_trip("lazy compressor",l::check_level<COMP_LEVEL_LAZY>);
+  l::check_round_trip("optimal compressor",l::check_level<COMP_LEVEL_OPTIMAL>);
+  l::check_round_trip("compressor and decompressor reused",l::check_reuse);
+  l::check_round_trip("compressor fed odd byte counts",l::check_byte_feeds);
+  l::check_round_trip("dictionary",l::check_dictionary);
+  l::check_round_trip("strict decompressor",l::check_strict);
+  l::check_round_trip("container and ranges",l::check_container);
+
+  if(!opts_.filepaths.empty())
+    l::check_golden_dirs(opts_);
 }
@@ -1,7 +1,8 @@
 #pragma once
 
+#include "options.hpp"
 
 namespace SubCmd
 {
-  void check();
+  void check(Options const &opts);
 }
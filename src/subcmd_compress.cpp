@@ -1,13 +1,32 @@
 #include "subcmd_compress.hpp"
 
+#include "async_io.hpp"
+#include "buffered_writer.hpp"
 #include "compress.hpp"
+#include "compress_cache.hpp"
+#include "container.hpp"
+#include "decompress.hpp"
 #include "fmt.hpp"
+#include "json.hpp"
+#include "mapped_file.hpp"
+#include "resource_usage.hpp"
+#include "sha256.hpp"
+#include "stream_reader.hpp"
+#include "verifier.hpp"
+#include "version.hpp"
+#include "work_pool.hpp"
+#include "worker_arena.hpp"
 
 #include <errno.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -20,108 +39,1479 @@ namespace l
     return ((v_ & 0x3) == 0);
   }
 
+  // "-" stands for stdin or stdout
+  static
+  bool
+  is_stdio(fs::path const &filepath_)
+  {
+    return (filepath_ == "-");
+  }
+
   static
   std::size_t
-  file_size(FILE *f_)
+  round_up_to_word(std::size_t v_)
+  {
+    return ((v_ + (sizeof(uint32_t) - 1)) & ~(sizeof(uint32_t) - 1));
+  }
+
+  static
+  void
+  count_span(void           *count_,
+             const uint32_t *words_,
+             std::size_t     num_words_)
+  {
+    *(std::size_t*)count_ += (num_words_ * sizeof(uint32_t));
+  }
+
+  // A trailing partial word is zero padded
+  static
+  void
+  pad_to_word(Compressor  *comp_,
+              std::size_t  size_)
   {
-    long orig_pos;
-    long end_pos;
+    static const uint8_t zeros[sizeof(uint32_t)] = {0};
+
+    if(comp_ && !l::multiple_of_4(size_))
+      FeedCompressorBytes(comp_,zeros,l::round_up_to_word(size_) - size_);
+  }
+
+  // Used to report how the selected level compares to the SDK
+  // compressor. Returns NULL when no comparison was requested.
+  static
+  Compressor*
+  create_sdk_counter(std::size_t *sdk_size_)
+  {
+    int rv;
+    Compressor *comp;
+
+    if(sdk_size_ == NULL)
+      return NULL;
 
-    orig_pos = ftell(f_);
-    fseek(f_,0L,SEEK_END);
-    end_pos = ftell(f_);
-    fseek(f_,orig_pos,SEEK_SET);
+    *sdk_size_ = 0;
+    rv = CreateCompressorSpan(&comp,(CompSpanFunc)l::count_span,NULL,(void*)sdk_size_);
+    if(rv < 0)
+      throw std::runtime_error("CreateCompressor failed");
 
-    return end_pos;
+    return comp;
   }
 
+  static
+  Compressor*
+  create_compressor(CompSpanFunc                sf_,
+                    void                       *userdata_,
+                    void                       *workbuf_,
+                    int32_t                     level_,
+                    std::vector<uint8_t> const &dict_,
+                    CompressorStats            *stats_,
+                    bool                        pipeline_)
+  {
+    int rv;
+    Compressor *comp;
+
+    rv = CreateCompressorSpan(&comp,sf_,workbuf_,userdata_);
+    if(rv < 0)
+      throw std::runtime_error("CreateCompressor failed");
+
+    rv = SetCompressorLevel(comp,level_);
+    if(rv < 0)
+      throw std::runtime_error("SetCompressorLevel failed");
+
+    rv = SetCompressorDictionary(comp,dict_.data(),dict_.size());
+    if(rv < 0)
+      throw std::runtime_error("SetCompressorDictionary failed");
+
+    if(stats_)
+      SetCompressorStats(comp,stats_);
+
+    rv = SetCompressorPipelined(comp,pipeline_);
+    if(rv < 0)
+      throw std::runtime_error("SetCompressorPipelined failed");
+
+    return comp;
+  }
+
+  // Returns the size of the output. The input is read ahead on
+  // another thread and may be a pipe.
+  static
+  std::size_t
+  compress(FILE                       *src_,
+           FILE                       *dst_,
+           std::size_t                 chunk_size_,
+           int32_t                     level_,
+           std::vector<uint8_t> const &dict_,
+           void                       *workbuf_,
+           std::size_t                *sdk_size_,
+           CompressorStats            *stats_,
+           bool                        verify_,
+           bool                        pipeline_,
+           std::size_t                &src_size_)
+  {
+    void *userdata;
+    uint8_t *buf;
+    std::size_t n;
+    std::size_t total;
+    Compressor *comp;
+    Compressor *sdk;
+    CompSpanFunc sf;
+    std::unique_ptr<Verifier> verifier;
+
+    chunk_size_ = (chunk_size_ ? chunk_size_ : 1);
+
+    StreamReader sr(src_,chunk_size_);
+    BufferedWriter bw(dst_,l::round_up_to_word(chunk_size_));
+
+    sf       = (CompSpanFunc)BufferedWriter::write_span;
+    userdata = (void*)&bw;
+    if(verify_)
+      {
+        verifier.reset(new Verifier(sf,userdata));
+        verifier->dictionary(dict_.data(),dict_.size());
+        sf       = Verifier::write_span;
+        userdata = (void*)verifier.get();
+      }
+
+    comp = l::create_compressor(sf,userdata,workbuf_,level_,dict_,stats_,pipeline_);
+
+    sdk = l::create_sdk_counter(sdk_size_);
+
+    // Reads may be any length, only the end of input needs padding
+    total = 0;
+    while((n = sr.read(&buf)) != 0)
+      {
+        if(verifier)
+          verifier->expect(buf,n);
+        FeedCompressorBytes(comp,buf,n);
+        if(sdk)
+          FeedCompressorBytes(sdk,buf,n);
+        total += n;
+      }
+
+    l::pad_to_word(comp,total);
+    l::pad_to_word(sdk,total);
+
+    DeleteCompressor(comp);
+    if(sdk)
+      DeleteCompressor(sdk);
+    if(verifier)
+      verifier->finish();
+
+    bw.flush();
+    src_size_ = total;
+
+    return bw.written();
+  }
+
+  struct Span
+  {
+    uint32_t *dest;
+    uint32_t *max;
+    bool      overflow;
+  };
+
   static
   void
-  write_word(void     *f_,
-             uint32_t  word_)
+  put_span(void           *span_,
+           const uint32_t *words_,
+           std::size_t     num_words_)
   {
-    FILE *f = (FILE*)f_;
-    fwrite(&word_,1,sizeof(word_),f);
+    Span *span = (Span*)span_;
+
+    if(num_words_ > (std::size_t)(span->max - span->dest))
+      {
+        span->overflow = true;
+        num_words_     = (span->max - span->dest);
+      }
+
+    memcpy(span->dest,words_,num_words_ * sizeof(uint32_t));
+    span->dest += num_words_;
+  }
+
+  // GetCompressedSizeBound() in bytes for an input of size_ bytes
+  static
+  std::size_t
+  compressed_size_bound(std::size_t size_)
+  {
+    uint32_t words;
+
+    words = GetCompressedSizeBound(l::round_up_to_word(size_) / sizeof(uint32_t));
+
+    return ((std::size_t)words * sizeof(uint32_t));
+  }
+
+  static
+  std::size_t
+  compress_mmap(const fs::path             &src_filepath_,
+                const fs::path             &dst_filepath_,
+                int32_t                     level_,
+                std::vector<uint8_t> const &dict_,
+                void                       *workbuf_,
+                std::size_t                *sdk_size_,
+                CompressorStats            *stats_,
+                bool                        verify_,
+                bool                        pipeline_)
+  {
+    Span span;
+    void *userdata;
+    std::size_t words;
+    Compressor *comp;
+    Compressor *sdk;
+    CompSpanFunc sf;
+    MappedFile src;
+    MappedFile dst;
+    std::unique_ptr<Verifier> verifier;
+
+    src.open_read(src_filepath_);
+    dst.create(dst_filepath_,l::compressed_size_bound(src.size()));
+
+    span.dest     = (uint32_t*)dst.data();
+    span.max      = (uint32_t*)(dst.data() + dst.size());
+    span.overflow = false;
+
+    sf       = (CompSpanFunc)l::put_span;
+    userdata = (void*)&span;
+    if(verify_)
+      {
+        verifier.reset(new Verifier(sf,userdata,src.data(),src.size()));
+        verifier->dictionary(dict_.data(),dict_.size());
+        sf       = Verifier::write_span;
+        userdata = (void*)verifier.get();
+      }
+
+    comp = l::create_compressor(sf,userdata,workbuf_,level_,dict_,stats_,pipeline_);
+
+    sdk = l::create_sdk_counter(sdk_size_);
+
+    FeedCompressorBytes(comp,src.data(),src.size());
+    if(sdk)
+      FeedCompressorBytes(sdk,src.data(),src.size());
+
+    l::pad_to_word(comp,src.size());
+    l::pad_to_word(sdk,src.size());
+
+    DeleteCompressor(comp);
+    if(sdk)
+      DeleteCompressor(sdk);
+    if(span.overflow)
+      throw std::runtime_error("ERROR: compressed output exceeded size bound");
+    if(verifier)
+      verifier->finish();
+
+    words = (span.dest - (uint32_t*)dst.data());
+    dst.close(words * sizeof(uint32_t));
+
+    return (words * sizeof(uint32_t));
   }
 
   static
   void
-  compress(FILE *src_,
-           FILE *dst_)
+  push_span(void           *words_,
+            const uint32_t *span_,
+            std::size_t     num_words_)
+  {
+    std::vector<uint32_t> *words = (std::vector<uint32_t>*)words_;
+
+    words->insert(words->end(),span_,span_ + num_words_);
+  }
+
+  // The in memory equivalent of compress_mmap() for inputs that have
+  // already been read. Returns the size of the output.
+  static
+  std::size_t
+  compress_buffer(const uint8_t              *src_,
+                  std::size_t                 size_,
+                  int32_t                     level_,
+                  std::vector<uint8_t> const &dict_,
+                  void                       *workbuf_,
+                  std::size_t                *sdk_size_,
+                  CompressorStats            *stats_,
+                  bool                        verify_,
+                  bool                        pipeline_,
+                  std::vector<uint32_t>      &words_)
+  {
+    void *userdata;
+    Compressor *comp;
+    Compressor *sdk;
+    CompSpanFunc sf;
+    std::unique_ptr<Verifier> verifier;
+
+    words_.clear();
+    words_.reserve(l::compressed_size_bound(size_) / sizeof(uint32_t));
+
+    sf       = (CompSpanFunc)l::push_span;
+    userdata = (void*)&words_;
+    if(verify_)
+      {
+        verifier.reset(new Verifier(sf,userdata,src_,size_));
+        verifier->dictionary(dict_.data(),dict_.size());
+        sf       = Verifier::write_span;
+        userdata = (void*)verifier.get();
+      }
+
+    comp = l::create_compressor(sf,userdata,workbuf_,level_,dict_,stats_,pipeline_);
+
+    sdk = l::create_sdk_counter(sdk_size_);
+
+    FeedCompressorBytes(comp,src_,size_);
+    if(sdk)
+      FeedCompressorBytes(sdk,src_,size_);
+
+    l::pad_to_word(comp,size_);
+    l::pad_to_word(sdk,size_);
+
+    DeleteCompressor(comp);
+    if(sdk)
+      DeleteCompressor(sdk);
+    if(verifier)
+      verifier->finish();
+
+    return (words_.size() * sizeof(uint32_t));
+  }
+
+  // Size of the input compressed as one stream at the same level,
+  // used to report what splitting into segments costs.
+  static
+  std::size_t
+  single_stream_size(const uint8_t *src_,
+                     std::size_t    size_,
+                     int32_t        level_)
   {
     int rv;
+    std::size_t count;
     Compressor *comp;
 
-    rv = CreateCompressor(&comp,(CompFunc)l::write_word,NULL,(void*)dst_);
+    count = 0;
+    rv = CreateCompressorSpan(&comp,(CompSpanFunc)l::count_span,NULL,(void*)&count);
     if(rv < 0)
       throw std::runtime_error("CreateCompressor failed");
 
-    while(true)
+    rv = SetCompressorLevel(comp,level_);
+    if(rv < 0)
+      throw std::runtime_error("SetCompressorLevel failed");
+
+    FeedCompressorBytes(comp,src_,size_);
+    l::pad_to_word(comp,size_);
+
+    DeleteCompressor(comp);
+
+    return count;
+  }
+
+  struct Result
+  {
+    fs::path    src_filepath;
+    fs::path    dst_filepath;
+    std::size_t src_file_size = 0;
+    std::size_t dst_file_size = 0;
+    std::size_t sdk_file_size = 0;
+    bool        sdk_compared  = false;
+    std::size_t segment_size  = 0;
+    std::size_t segments      = 0;
+    std::size_t single_size   = 0;
+    bool        loss_compared = false;
+    bool        has_stats     = false;
+    bool        stored        = false;
+    bool        verified      = false;
+    bool        mismatch      = false;
+    bool        cached        = false;
+    uint64_t    probe_size    = 0;
+    double      wall_secs     = 0;
+    double      cpu_secs      = 0;
+    CompressorStats stats = {};
+    std::string error;
+  };
+
+  static
+  void
+  compress_split(Options const &opts_,
+                 const uint8_t *src_,
+                 std::size_t    size_,
+                 unsigned       jobs_,
+                 Result        &r_)
+  {
+    Container::Info info;
+
+    info = Container::compress(src_,
+                               size_,
+                               r_.dst_filepath,
+                               opts_.split_size,
+                               opts_.level,
+                               jobs_,
+                               (r_.has_stats ? &r_.stats : NULL),
+                               opts_.verify);
+
+    r_.dst_file_size = info.size;
+    r_.segment_size  = info.segment_size;
+    r_.segments      = info.segments;
+    r_.verified      = opts_.verify;
+
+    r_.loss_compared = opts_.split_loss;
+    if(r_.loss_compared)
+      r_.single_size = l::single_stream_size(src_,size_,opts_.level);
+  }
+
+  static
+  void
+  compress_split(Options const &opts_,
+                 unsigned       jobs_,
+                 Result        &r_)
+  {
+    MappedFile src;
+
+    src.open_read(r_.src_filepath);
+
+    l::compress_split(opts_,src.data(),src.size(),jobs_,r_);
+  }
+
+  // Enough evenly spaced samples to judge most inputs while costing a
+  // small fraction of compressing anything larger.
+  static constexpr std::size_t PROBE_SAMPLE_SIZE = (256 * 1024);
+
+  // Returns true if the input should be stored rather than compressed
+  static
+  bool
+  probe(Options const &opts_,
+        const uint8_t *src_,
+        std::size_t    size_,
+        Result        &r_)
+  {
+    int rv;
+
+    rv = EstimateCompressedSize(src_,size_,l::PROBE_SAMPLE_SIZE,&r_.probe_size);
+    if(rv < 0)
+      throw std::runtime_error("EstimateCompressedSize failed");
+
+    return (r_.probe_size > (opts_.store_ratio * size_));
+  }
+
+  static
+  bool
+  probe(Options const &opts_,
+        Result        &r_)
+  {
+    MappedFile src;
+
+    src.open_read(r_.src_filepath);
+
+    return l::probe(opts_,src.data(),src.size(),r_);
+  }
+
+  static
+  FILE*
+  open(fs::path const &filepath_,
+       const char     *mode_)
+  {
+    FILE *f;
+
+    if(l::is_stdio(filepath_))
+      {
+        f = ((mode_[0] == 'r') ? stdin : stdout);
+        StreamReader::set_binary(f);
+        return f;
+      }
+
+    f = fopen(filepath_.string().c_str(),mode_);
+    if(f == NULL)
+      throw fmt::exception("ERROR: failed to open {} - {}",filepath_,strerror(errno));
+
+    return f;
+  }
+
+  // Returns non-zero, as fclose(), if buffered output failed to write
+  static
+  int
+  close(fs::path const &filepath_,
+        FILE           *f_)
+  {
+    if(l::is_stdio(filepath_))
+      return fflush(f_);
+    return fclose(f_);
+  }
+
+  // Shared by every file compressed in a run
+  struct Context
+  {
+    CompressCache        *cache = NULL;
+    std::vector<uint8_t>  dictionary;
+  };
+
+  // Only the part of the file the compressor would keep is read
+  static
+  std::vector<uint8_t>
+  read_dictionary(fs::path const &filepath_)
+  {
+    MappedFile f;
+    std::size_t n;
+
+    f.open_read(filepath_);
+    n = std::min(f.size(),(std::size_t)COMP_DICTIONARY_SIZE);
+
+    return std::vector<uint8_t>(f.data() + (f.size() - n),f.data() + f.size());
+  }
+
+  static
+  void
+  compress_path(Options const &opts_,
+                Context const &ctx_,
+                void          *workbuf_,
+                unsigned       split_jobs_,
+                Result        &r_)
+  {
+    FILE *src;
+    FILE *dst;
+    bool stdio;
+    std::size_t *sdk_size;
+    std::error_code ec;
+
+    stdio = (l::is_stdio(r_.src_filepath) || l::is_stdio(r_.dst_filepath));
+    if(!l::is_stdio(r_.src_filepath))
+      {
+        if(!fs::is_regular_file(r_.src_filepath))
+          throw fmt::exception("ERROR: {} is not a regular file",r_.src_filepath);
+        r_.src_file_size = fs::file_size(r_.src_filepath);
+      }
+
+    r_.has_stats = opts_.stats;
+
+    if(opts_.store_ratio > 0)
+      {
+        if(stdio)
+          throw std::runtime_error("ERROR: --store-ratio can not be used with stdin or stdout");
+        r_.stored = l::probe(opts_,r_);
+        if(r_.stored)
+          {
+            // Else an earlier run's output would be taken for this input's
+            fs::remove(r_.dst_filepath,ec);
+            return;
+          }
+      }
+
+    if(opts_.split_size)
+      {
+        if(stdio)
+          throw std::runtime_error("ERROR: --split can not be used with stdin or stdout");
+        if(!ctx_.dictionary.empty())
+          throw std::runtime_error("ERROR: --dictionary can not be used with --split");
+        return l::compress_split(opts_,split_jobs_,r_);
+      }
+
+    r_.sdk_compared  = (opts_.level == COMP_LEVEL_OPTIMAL);
+    sdk_size = (r_.sdk_compared ? &r_.sdk_file_size : NULL);
+
+    if(opts_.mmap)
+      {
+        if(stdio)
+          throw std::runtime_error("ERROR: --mmap can not be used with stdin or stdout");
+        r_.dst_file_size = l::compress_mmap(r_.src_filepath,
+                                            r_.dst_filepath,
+                                            opts_.level,
+                                            ctx_.dictionary,
+                                            workbuf_,
+                                            sdk_size,
+                                            (r_.has_stats ? &r_.stats : NULL),
+                                            opts_.verify,
+                                            opts_.pipeline);
+        r_.verified = opts_.verify;
+        return;
+      }
+
+    src = l::open(r_.src_filepath,"rb");
+    try
       {
-        uint32_t w;
+        dst = l::open(r_.dst_filepath,"wb");
+      }
+    catch(...)
+      {
+        l::close(r_.src_filepath,src);
+        throw;
+      }
 
-        w = 0;
-        rv = fread(&w,1,sizeof(w),src_);
-        if((rv == 0) && (feof(src_) || ferror(src_)))
-          break;
-        FeedCompressor(comp,&w,1);
+    try
+      {
+        r_.dst_file_size = l::compress(src,
+                                       dst,
+                                       opts_.chunk_size,
+                                       opts_.level,
+                                       ctx_.dictionary,
+                                       workbuf_,
+                                       sdk_size,
+                                       (r_.has_stats ? &r_.stats : NULL),
+                                       opts_.verify,
+                                       opts_.pipeline,
+                                       r_.src_file_size);
+      }
+    catch(...)
+      {
+        l::close(r_.src_filepath,src);
+        l::close(r_.dst_filepath,dst);
+        throw;
       }
 
-    rv = DeleteCompressor(comp);
+    l::close(r_.src_filepath,src);
+    if(l::close(r_.dst_filepath,dst) != 0)
+      throw fmt::exception("ERROR: failed to write {} - {}",r_.dst_filepath,strerror(errno));
+    r_.verified = opts_.verify;
+  }
+
+  // Everything that affects the output besides the input itself
+  static
+  std::string
+  cache_salt(Options const              &opts_,
+             std::vector<uint8_t> const &dict_)
+  {
+    Sha256 sha;
+
+    sha.update(dict_.data(),dict_.size());
+
+    return fmt::format("3ct {}.{}.{} level {} split {} store-ratio {} dictionary {}",
+                       VERSION_MAJOR,
+                       VERSION_MINOR,
+                       VERSION_PATCH,
+                       opts_.level,
+                       opts_.split_size,
+                       opts_.store_ratio,
+                       (dict_.empty() ? std::string("none") : Sha256::hex(sha.digest())));
+  }
+
+  static
+  bool
+  fetch_cached(Options const     &opts_,
+               CompressCache     &cache_,
+               std::string const &key_,
+               std::size_t        src_size_,
+               Result            &r_)
+  {
+    if(!cache_.fetch(key_,r_.dst_filepath,&r_.dst_file_size))
+      return false;
+
+    r_.cached        = true;
+    r_.src_file_size = src_size_;
+    r_.segment_size  = opts_.split_size;
+
+    return true;
+  }
+
+  // Output that fails verification is removed rather than left
+  // looking like a valid stream. With a cache the output is copied
+  // from it when possible and stored in it otherwise.
+  static
+  void
+  compress_file(Options const &opts_,
+                Context const &ctx_,
+                void          *workbuf_,
+                unsigned       split_jobs_,
+                Result        &r_)
+  {
+    std::string key;
+    std::error_code ec;
+    CompressCache *cache;
+
+    cache = ctx_.cache;
+    if(cache)
+      {
+        if(l::is_stdio(r_.src_filepath) || l::is_stdio(r_.dst_filepath))
+          throw std::runtime_error("ERROR: --cache can not be used with stdin or stdout");
+        if(!fs::is_regular_file(r_.src_filepath))
+          throw fmt::exception("ERROR: {} is not a regular file",r_.src_filepath);
+
+        key = cache->key(r_.src_filepath);
+        if(l::fetch_cached(opts_,*cache,key,fs::file_size(r_.src_filepath),r_))
+          return;
+      }
+
+    try
+      {
+        l::compress_path(opts_,ctx_,workbuf_,split_jobs_,r_);
+      }
+    catch(const Verifier::Mismatch &e_)
+      {
+        r_.mismatch = true;
+        if(!l::is_stdio(r_.dst_filepath))
+          fs::remove(r_.dst_filepath,ec);
+        throw;
+      }
+
+    if(cache && !r_.stored)
+      cache->store(key,r_.dst_filepath);
+  }
+
+  static
+  std::string
+  offset_bucket_name(int bucket_)
+  {
+    if(bucket_ == 0)
+      return "1";
+    if(bucket_ == (STATS_OFFSET_COUNT - 1))
+      return fmt::format("{}",1 << bucket_);
+
+    return fmt::format("{}-{}",1 << bucket_,(2 << bucket_) - 1);
+  }
+
+  static
+  void
+  print_stats(FILE                  *out_,
+              CompressorStats const &stats_)
+  {
+    std::string lengths;
+    std::string offsets;
+
+    // Phrases are 3 to 18 bytes long
+    for(int i = 3; i < STATS_LENGTH_COUNT; i++)
+      lengths += fmt::format("{}{}: {}",
+                             (lengths.empty() ? "" : ", "),
+                             i,
+                             stats_.cs_PhraseLengths[i]);
+    for(int i = 0; i < STATS_OFFSET_COUNT; i++)
+      offsets += fmt::format("{}{}: {}",
+                             (offsets.empty() ? "" : ", "),
+                             l::offset_bucket_name(i),
+                             stats_.cs_PhraseOffsets[i]);
+
+    fmt::print(out_,
+               "- stats:\n"
+               "  - literals: {}\n"
+               "  - phrases: {}\n"
+               "  - phrase_lengths: {{{}}}\n"
+               "  - phrase_offsets: {{{}}}\n"
+               "  - searches: {}\n"
+               "  - nodes_visited: {}\n"
+               "  - nodes_per_search: {:.2f}\n"
+               "  - tree_deletions: {}\n"
+               "  - words_written: {}\n"
+               ,
+               stats_.cs_Literals,
+               stats_.cs_Phrases,
+               lengths,
+               offsets,
+               stats_.cs_Searches,
+               stats_.cs_NodesVisited,
+               (stats_.cs_Searches ?
+                ((double)stats_.cs_NodesVisited / stats_.cs_Searches) :
+                0.0),
+               stats_.cs_Deletions,
+               stats_.cs_WordsWritten);
+  }
+
+  static
+  void
+  print_yaml_result(Result const &r_)
+  {
+    FILE *out;
+
+    // Keep the report out of the data when it goes to stdout
+    out = (l::is_stdio(r_.dst_filepath) ? stderr : stdout);
+
+    if(!r_.error.empty())
+      {
+        fmt::print(out,
+                   "- input:\n"
+                   "  - filepath: {}\n"
+                   "- error: {}\n"
+                   ,
+                   r_.src_filepath,
+                   r_.error);
+        return;
+      }
+
+    // Nothing was written so there is nothing to pad or report on
+    if(r_.stored)
+      {
+        fmt::print(out,
+                   "- input:\n"
+                   "  - filepath: {}\n"
+                   "  - size_in_bytes: {}\n"
+                   "- output:\n"
+                   "  - stored: true\n"
+                   "  - estimated_size_in_bytes: {}\n"
+                   "  - estimated_ratio: {:.3f}\n"
+                   ,
+                   r_.src_filepath,
+                   r_.src_file_size,
+                   r_.probe_size,
+                   (r_.src_file_size ?
+                    ((double)r_.probe_size / r_.src_file_size) :
+                    0.0));
+        return;
+      }
+
+    // The container records the exact size so no padding is kept
+    if(!l::multiple_of_4(r_.src_file_size) && (r_.segment_size == 0))
+      fmt::print(stderr,
+                 "WARNING - {} is not a multiple of 4 bytes. "
+                 "Uncompressing this file will result in a file padded with zeros.\n",
+                 r_.src_filepath);
+
+    fmt::print(out,
+               "- input:\n"
+               "  - filepath: {}\n"
+               "  - size_in_bytes: {}\n"
+               "  - size_in_words: {}\n"
+               "- output:\n"
+               "  - filepath: {}\n"
+               "  - size_in_bytes: {}\n"
+               "  - size_in_words: {}\n"
+               ,
+               r_.src_filepath,
+               r_.src_file_size,
+               r_.src_file_size / sizeof(uint32_t),
+               r_.dst_filepath,
+               r_.dst_file_size,
+               r_.dst_file_size / sizeof(uint32_t));
+
+    if(r_.verified)
+      fmt::print(out,"  - verified: true\n");
+
+    if(r_.cached)
+      fmt::print(out,"  - cached: true\n");
+
+    if(r_.sdk_compared)
+      fmt::print(out,
+                 "  - sdk_size_in_bytes: {}\n"
+                 "  - sdk_delta_in_bytes: {}\n"
+                 ,
+                 r_.sdk_file_size,
+                 (int64_t)r_.dst_file_size - (int64_t)r_.sdk_file_size);
+
+    if(r_.segments)
+      fmt::print(out,
+                 "  - segment_size_in_bytes: {}\n"
+                 "  - segments: {}\n"
+                 ,
+                 r_.segment_size,
+                 r_.segments);
+
+    if(r_.loss_compared)
+      fmt::print(out,
+                 "  - single_stream_size_in_bytes: {}\n"
+                 "  - split_loss_in_bytes: {}\n"
+                 "  - split_loss_percent: {:.3f}\n"
+                 ,
+                 r_.single_size,
+                 (int64_t)r_.dst_file_size - (int64_t)r_.single_size,
+                 (r_.single_size ?
+                  ((((double)r_.dst_file_size / r_.single_size) - 1.0) * 100.0) :
+                  0.0));
+
+    if(r_.has_stats)
+      l::print_stats(out,r_.stats);
+  }
+
+  static
+  double
+  mb_per_sec(std::size_t size_,
+             double      secs_)
+  {
+    return ((secs_ > 0) ? ((size_ / 1000000.0) / secs_) : 0);
+  }
+
+  static
+  JsonObject
+  json_stats(CompressorStats const &stats_)
+  {
+    JsonObject rv;
+    JsonObject lengths;
+    JsonObject offsets;
+
+    for(int i = 3; i < STATS_LENGTH_COUNT; i++)
+      lengths.add(std::to_string(i),stats_.cs_PhraseLengths[i]);
+    for(int i = 0; i < STATS_OFFSET_COUNT; i++)
+      offsets.add(l::offset_bucket_name(i),stats_.cs_PhraseOffsets[i]);
+
+    rv.add("literals",stats_.cs_Literals)
+      .add("phrases",stats_.cs_Phrases)
+      .add("phrase_lengths",lengths)
+      .add("phrase_offsets",offsets)
+      .add("searches",stats_.cs_Searches)
+      .add("nodes_visited",stats_.cs_NodesVisited)
+      .add("nodes_per_search",(stats_.cs_Searches ?
+                               ((double)stats_.cs_NodesVisited / stats_.cs_Searches) :
+                               0.0))
+      .add("tree_deletions",stats_.cs_Deletions)
+      .add("words_written",stats_.cs_WordsWritten);
+
+    return rv;
+  }
+
+  // The YAML report on one line, plus timings and memory use. The
+  // peak RSS is the process's so far.
+  static
+  void
+  print_json_result(Result const &r_)
+  {
+    FILE *out;
+    JsonObject rv;
+    JsonObject input;
+    JsonObject output;
+
+    out = (l::is_stdio(r_.dst_filepath) ? stderr : stdout);
+
+    input.add("filepath",r_.src_filepath.string());
+    if(!r_.error.empty())
+      {
+        rv.add("input",input)
+          .add("error",r_.error);
+        fmt::print(out,"{}\n",rv.str());
+        return;
+      }
+
+    input.add("size_in_bytes",r_.src_file_size)
+      .add("size_in_words",r_.src_file_size / sizeof(uint32_t));
+
+    if(r_.stored)
+      {
+        output.add("stored",true)
+          .add("estimated_size_in_bytes",r_.probe_size)
+          .add("estimated_ratio",(r_.src_file_size ?
+                                  ((double)r_.probe_size / r_.src_file_size) :
+                                  0.0));
+      }
+    else
+      {
+        if(!l::multiple_of_4(r_.src_file_size) && (r_.segment_size == 0))
+          fmt::print(stderr,
+                     "WARNING - {} is not a multiple of 4 bytes. "
+                     "Uncompressing this file will result in a file padded with zeros.\n",
+                     r_.src_filepath);
+
+        output.add("filepath",r_.dst_filepath.string())
+          .add("size_in_bytes",r_.dst_file_size)
+          .add("size_in_words",r_.dst_file_size / sizeof(uint32_t));
+        if(r_.verified)
+          output.add("verified",true);
+        if(r_.cached)
+          output.add("cached",true);
+        if(r_.sdk_compared)
+          output.add("sdk_size_in_bytes",r_.sdk_file_size)
+            .add("sdk_delta_in_bytes",(int64_t)r_.dst_file_size - (int64_t)r_.sdk_file_size);
+        if(r_.segments)
+          output.add("segment_size_in_bytes",r_.segment_size)
+            .add("segments",r_.segments);
+        if(r_.loss_compared)
+          output.add("single_stream_size_in_bytes",r_.single_size)
+            .add("split_loss_in_bytes",(int64_t)r_.dst_file_size - (int64_t)r_.single_size)
+            .add("split_loss_percent",(r_.single_size ?
+                                       ((((double)r_.dst_file_size / r_.single_size) - 1.0) * 100.0) :
+                                       0.0));
+      }
+
+    rv.add("input",input)
+      .add("output",output)
+      .add("wall_time_in_seconds",r_.wall_secs)
+      .add("cpu_time_in_seconds",r_.cpu_secs)
+      .add("mb_per_sec",l::mb_per_sec(r_.src_file_size,r_.wall_secs));
+    if(!r_.stored)
+      rv.add("ratio",(r_.src_file_size ?
+                      ((double)r_.dst_file_size / r_.src_file_size) :
+                      0.0));
+    rv.add("peak_rss_in_bytes",ResourceUsage::peak_rss());
+    if(r_.has_stats)
+      rv.add("stats",l::json_stats(r_.stats));
+
+    fmt::print(out,"{}\n",rv.str());
+  }
+
+  static
+  void
+  print_result(Options const &opts_,
+               Result const  &r_)
+  {
+    if(opts_.report == "json")
+      l::print_json_result(r_);
+    else
+      l::print_yaml_result(r_);
+  }
+
+  // Trims the cache to its size cap and reports on this run's use of it
+  static
+  void
+  finish_cache(Options const &opts_,
+               CompressCache *cache_)
+  {
+    JsonObject json;
+    CompressCache::Stats s;
+
+    if(!cache_)
+      return;
+
+    cache_->trim();
+    s = cache_->stats();
+
+    if(opts_.report == "json")
+      {
+        json.add("dirpath",cache_->dirpath().string())
+          .add("hits",s.hits)
+          .add("misses",s.misses)
+          .add("stores",s.stores)
+          .add("evictions",s.evictions)
+          .add("entries",s.entries)
+          .add("size_in_bytes",s.size);
+        fmt::print("{}\n",JsonObject().add("cache",json).str());
+        return;
+      }
+
+    fmt::print("- cache:\n"
+               "  - dirpath: {}\n"
+               "  - hits: {}\n"
+               "  - misses: {}\n"
+               "  - stores: {}\n"
+               "  - evictions: {}\n"
+               "  - entries: {}\n"
+               "  - size_in_bytes: {}\n"
+               ,
+               cache_->dirpath(),
+               s.hits,
+               s.misses,
+               s.stores,
+               s.evictions,
+               s.entries,
+               s.size);
+  }
+
+  static
+  fs::path
+  default_dst_filepath(fs::path const &src_filepath_)
+  {
+    fs::path dst_filepath;
+
+    dst_filepath  = src_filepath_;
+    dst_filepath += ".compressed";
+
+    return dst_filepath;
+  }
+
+  // Directories are walked recursively in sorted order so the report
+  // is stable between runs. Previous outputs are skipped.
+  static
+  void
+  add_inputs(fs::path const        &path_,
+             std::vector<fs::path> &inputs_)
+  {
+    std::vector<fs::path> files;
+
+    if(!fs::is_directory(path_))
+      {
+        inputs_.push_back(path_);
+        return;
+      }
+
+    for(auto const &de : fs::recursive_directory_iterator(path_))
+      {
+        if(!de.is_regular_file())
+          continue;
+        if(de.path().extension() == ".compressed")
+          continue;
+        files.push_back(de.path());
+      }
+
+    std::sort(files.begin(),files.end());
+    inputs_.insert(inputs_.end(),files.begin(),files.end());
+  }
+
+  static
+  void
+  read_manifest(fs::path const        &filepath_,
+                std::vector<fs::path> &inputs_)
+  {
+    FILE *f;
+    char buf[4096];
+    std::string line;
+
+    f = fopen(filepath_.string().c_str(),"r");
+    if(f == NULL)
+      throw fmt::exception("ERROR: failed to open {} - {}",filepath_,strerror(errno));
+
+    while(fgets(buf,sizeof(buf),f) != NULL)
+      {
+        line = buf;
+        while(!line.empty() && ((line.back() == '\n') || (line.back() == '\r')))
+          line.pop_back();
+        if(line.empty() || (line[0] == '#'))
+          continue;
+        l::add_inputs(line,inputs_);
+      }
+
+    fclose(f);
+  }
+
+  // Compresses an input the prefetcher has read. Returns true if
+  // words_ holds output still to be written to r_.dst_filepath.
+  static
+  bool
+  compress_loaded(Options const              &opts_,
+                  Context const              &ctx_,
+                  std::vector<uint8_t> const &src_,
+                  void                       *workbuf_,
+                  Result                     &r_,
+                  std::vector<uint32_t>      &words_)
+  {
+    std::size_t *sdk_size;
+    std::error_code ec;
+
+    r_.src_file_size = src_.size();
+    r_.has_stats     = opts_.stats;
+
+    if(opts_.store_ratio > 0)
+      {
+        r_.stored = l::probe(opts_,src_.data(),src_.size(),r_);
+        if(r_.stored)
+          {
+            if(!l::is_stdio(r_.dst_filepath))
+              fs::remove(r_.dst_filepath,ec);
+            return false;
+          }
+      }
+
+    if(opts_.split_size)
+      {
+        if(!ctx_.dictionary.empty())
+          throw std::runtime_error("ERROR: --dictionary can not be used with --split");
+        l::compress_split(opts_,src_.data(),src_.size(),1,r_);
+        return false;
+      }
+
+    r_.sdk_compared = (opts_.level == COMP_LEVEL_OPTIMAL);
+    sdk_size = (r_.sdk_compared ? &r_.sdk_file_size : NULL);
+
+    try
+      {
+        r_.dst_file_size = l::compress_buffer(src_.data(),
+                                              src_.size(),
+                                              opts_.level,
+                                              ctx_.dictionary,
+                                              workbuf_,
+                                              sdk_size,
+                                              (r_.has_stats ? &r_.stats : NULL),
+                                              opts_.verify,
+                                              opts_.pipeline,
+                                              words_);
+      }
+    catch(const Verifier::Mismatch &)
+      {
+        r_.mismatch = true;
+        throw;
+      }
+    r_.verified = opts_.verify;
+
+    return true;
+  }
+
+  // compress_loaded() through the cache when there is one
+  static
+  bool
+  compress_cached(Options const              &opts_,
+                  Context const              &ctx_,
+                  std::vector<uint8_t> const &src_,
+                  void                       *workbuf_,
+                  Result                     &r_,
+                  std::vector<uint32_t>      &words_)
+  {
+    bool write;
+    std::string key;
+    CompressCache *cache;
+
+    cache = ctx_.cache;
+    if(!cache)
+      return l::compress_loaded(opts_,ctx_,src_,workbuf_,r_,words_);
+
+    key = cache->key(src_.data(),src_.size());
+    if(l::fetch_cached(opts_,*cache,key,src_.size(),r_))
+      return false;
+
+    write = l::compress_loaded(opts_,ctx_,src_,workbuf_,r_,words_);
+    if(write)
+      cache->store(key,words_.data(),(words_.size() * sizeof(uint32_t)));
+    else if(!r_.stored)
+      cache->store(key,r_.dst_filepath);
+
+    return write;
+  }
+
+  // Results are printed in input order as soon as every earlier file
+  // has finished, independent of the number of workers.
+  class Reporter
+  {
+  public:
+    Reporter(Options const       &opts_,
+             std::vector<Result> &results_)
+      : _opts(opts_),
+        _results(results_),
+        _done(results_.size(),false),
+        _next(0)
+    {
+    }
+
+  public:
+    void
+    done(std::size_t i_)
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+
+      _done[i_] = true;
+      while((_next < _done.size()) && _done[_next])
+        l::print_result(_opts,_results[_next++]);
+    }
+
+  private:
+    Options const       &_opts;
+    std::vector<Result> &_results;
+    std::vector<bool>    _done;
+    std::size_t          _next;
+    std::mutex           _lock;
+  };
+
+  // What a worker's arena needs for a file: the compressor with its
+  // level's memory and any pipeline, the probe's and the SDK size
+  // counter's compressors and the verifier's decompressor. A split
+  // file's segments don't fit and are allocated as without an arena.
+  static
+  std::unique_ptr<WorkerArena>
+  create_worker_arena(Options const &opts_)
+  {
+    std::size_t n;
+    std::size_t sizes[6];
+
+    n = 0;
+    sizes[n++] = GetCompressorWorkBufferSize();
+    sizes[n++] = (GetCompressorLevelMemorySize(opts_.level) - GetCompressorWorkBufferSize());
+    if(opts_.pipeline)
+      sizes[n++] = GetCompressorPipelineMemorySize();
+    if(opts_.store_ratio > 0)
+      sizes[n++] = GetCompressorWorkBufferSize();
+    if(opts_.level == COMP_LEVEL_OPTIMAL)
+      sizes[n++] = GetCompressorWorkBufferSize();
+    if(opts_.verify)
+      sizes[n++] = GetDecompressorWorkBufferSize();
+
+    return std::unique_ptr<WorkerArena>(new WorkerArena(WorkerArena::size_for(sizes,n)));
+  }
+
+  // Each worker opens, reads and writes its own files. Used with
+  // --mmap where the page cache does the I/O.
+  static
+  void
+  compress_batch_sync(Options const       &opts_,
+                      Context const       &ctx_,
+                      WorkPool            &pool_,
+                      std::vector<Result> &results_)
+  {
+    Reporter reporter(opts_,results_);
+    std::vector<std::unique_ptr<WorkerArena>> arenas;
+
+    // One codec arena per worker, released after every file it handles
+    for(unsigned i = 0; i < pool_.size(); i++)
+      arenas.emplace_back(l::create_worker_arena(opts_));
+
+    pool_.run(results_.size(),
+              [&](std::size_t task_,
+                  unsigned    worker_)
+              {
+                ResourceUsage::Stopwatch sw;
+
+                try
+                  {
+                    WorkerArena::Scope scope(*arenas[worker_]);
+
+                    // Files are already spread over the workers so
+                    // segments of one file are not split further.
+                    l::compress_file(opts_,ctx_,NULL,1,results_[task_]);
+                  }
+                catch(const std::exception &e_)
+                  {
+                    results_[task_].error = e_.what();
+                  }
+
+                results_[task_].wall_secs = sw.wall_seconds();
+                results_[task_].cpu_secs  = sw.cpu_seconds();
+
+                reporter.done(task_);
+              });
+  }
+
+  // Inputs are read ahead and outputs written back on I/O threads so
+  // the workers only compress. At most `depth` inputs are held ahead
+  // of the workers and `depth` outputs queued behind them; larger
+  // inputs are streamed by the worker itself as in compress_file().
+  static constexpr unsigned    ASYNC_IO_THREADS   = 2;
+  static constexpr std::size_t ASYNC_MAX_FILE_SIZE = (64 * 1024 * 1024);
+
+  static
+  void
+  compress_batch_async(Options const               &opts_,
+                       Context const               &ctx_,
+                       WorkPool                    &pool_,
+                       std::vector<fs::path> const &inputs_,
+                       std::vector<Result>         &results_)
+  {
+    unsigned depth;
+    Reporter reporter(opts_,results_);
+    std::vector<std::unique_ptr<WorkerArena>> arenas;
+
+    for(unsigned i = 0; i < pool_.size(); i++)
+      arenas.emplace_back(l::create_worker_arena(opts_));
+
+    depth = (opts_.prefetch ? opts_.prefetch : (2 * pool_.size()));
+
+    FilePrefetcher prefetcher(inputs_,
+                              l::ASYNC_IO_THREADS,
+                              depth,
+                              l::ASYNC_MAX_FILE_SIZE);
+    FileWriter writer(l::ASYNC_IO_THREADS,
+                      depth,
+                      [&](std::size_t        i_,
+                          std::string const &error_)
+                      {
+                        if(!error_.empty())
+                          results_[i_].error = error_;
+                        reporter.done(i_);
+                      });
+
+    // Every worker takes whichever input is ready next
+    pool_.run(pool_.size(),
+              [&](std::size_t,
+                  unsigned    worker_)
+              {
+                bool write;
+                FilePrefetcher::File file;
+                std::vector<uint32_t> words;
+
+                while(prefetcher.next(file))
+                  {
+                    Result &r = results_[file.index];
+                    ResourceUsage::Stopwatch sw;
+
+                    write = false;
+                    try
+                      {
+                        WorkerArena::Scope scope(*arenas[worker_]);
+
+                        if(!file.error.empty())
+                          throw std::runtime_error(file.error);
+
+                        if(file.streamed)
+                          l::compress_file(opts_,ctx_,NULL,1,r);
+                        else
+                          write = l::compress_cached(opts_,
+                                                     ctx_,
+                                                     file.data,
+                                                     NULL,
+                                                     r,
+                                                     words);
+                      }
+                    catch(const std::exception &e_)
+                      {
+                        r.error = e_.what();
+                      }
+
+                    r.wall_secs = sw.wall_seconds();
+                    r.cpu_secs  = sw.cpu_seconds();
+
+                    std::vector<uint8_t>().swap(file.data);
+                    prefetcher.release();
+
+                    if(write)
+                      writer.submit(file.index,r.dst_filepath,std::move(words));
+                    else
+                      reporter.done(file.index);
+                  }
+              });
+
+    writer.finish();
+  }
+
+  static
+  void
+  compress_batch(Options const &opts_,
+                 Context const &ctx_)
+  {
+    std::size_t failures;
+    std::vector<Result> results;
+    std::vector<fs::path> inputs;
+
+    for(auto const &path : opts_.filepaths)
+      {
+        if(l::is_stdio(path))
+          throw std::runtime_error("ERROR: stdin can not be used with --batch");
+        l::add_inputs(path,inputs);
+      }
+    if(!opts_.manifest_filepath.empty())
+      l::read_manifest(opts_.manifest_filepath,inputs);
+
+    WorkPool pool(opts_.jobs ? opts_.jobs : WorkPool::default_threads());
+
+    results.resize(inputs.size());
+    for(std::size_t i = 0; i < inputs.size(); i++)
+      {
+        results[i].src_filepath = inputs[i];
+        results[i].dst_filepath = l::default_dst_filepath(inputs[i]);
+      }
+
+    if(opts_.mmap)
+      l::compress_batch_sync(opts_,ctx_,pool,results);
+    else
+      l::compress_batch_async(opts_,ctx_,pool,inputs,results);
+
+    l::finish_cache(opts_,ctx_.cache);
+
+    // Each file's error is also in the report but that may be going
+    // to stdout so they are repeated on stderr and fail the run
+    failures = 0;
+    for(auto const &r : results)
+      {
+        if(r.error.empty() && !r.mismatch)
+          continue;
+        failures++;
+        fmt::print(stderr,"{}: {}\n",r.src_filepath,r.error);
+      }
+
+    if(failures)
+      throw fmt::exception("ERROR: {} of {} files failed",
+                           failures,
+                           results.size());
   }
 }
 
 void
 SubCmd::compress(Options const &opts_)
 {
-  FILE *src;
-  FILE *dst;
-  fs::path src_filepath;
-  fs::path dst_filepath;
-  std::size_t src_file_size;
-  std::size_t dst_file_size;
-
-  src_filepath = opts_.input_filepath;
-  dst_filepath = opts_.output_filepath;
-  if(dst_filepath.empty())
-    {
-      dst_filepath  = src_filepath;
-      dst_filepath += ".compressed";
-    }
+  l::Result r;
+  l::Context ctx;
+  std::unique_ptr<CompressCache> cache;
+
+  if(!opts_.dictionary_filepath.empty())
+    ctx.dictionary = l::read_dictionary(opts_.dictionary_filepath);
+
+  if(!opts_.cache_dirpath.empty())
+    cache.reset(new CompressCache(opts_.cache_dirpath,
+                                  opts_.cache_size,
+                                  l::cache_salt(opts_,ctx.dictionary)));
+  ctx.cache = cache.get();
+
+  // Checked once here rather than failing every file of a batch
+  if(opts_.split_size && (opts_.split_size < CONTAINER_MIN_SEGMENT))
+    throw fmt::exception("ERROR: --split SIZE must be at least {} bytes",CONTAINER_MIN_SEGMENT);
+
+  if(opts_.batch || !opts_.manifest_filepath.empty())
+    return l::compress_batch(opts_,ctx);
+
+  if(opts_.filepaths.empty())
+    throw std::runtime_error("ERROR: no input file given");
+  if(opts_.filepaths.size() > 2)
+    throw std::runtime_error("ERROR: too many paths given, use --batch to compress multiple files");
+
+  r.src_filepath = opts_.filepaths[0];
+  if(opts_.filepaths.size() > 1)
+    r.dst_filepath = opts_.filepaths[1];
+  else if(l::is_stdio(r.src_filepath))
+    r.dst_filepath = "-";
+  else
+    r.dst_filepath = l::default_dst_filepath(r.src_filepath);
+
+  // --split compresses on other threads too
+  ResourceUsage::Stopwatch sw(true);
+
+  l::compress_file(opts_,ctx,NULL,opts_.jobs,r);
+  r.wall_secs = sw.wall_seconds();
+  r.cpu_secs  = sw.cpu_seconds();
 
-  src = fopen(src_filepath.string().c_str(),"rb");
-  if(src == NULL)
-    throw fmt::exception("ERROR: failed to open {} - {}",src_filepath,strerror(errno));
-
-  dst = fopen(dst_filepath.string().c_str(),"wb");
-  if(dst == NULL)
-    throw fmt::exception("ERROR: failed to open {} - {}",dst_filepath,strerror(errno));
-
-  src_file_size = l::file_size(src);
-  if(!l::multiple_of_4(src_file_size))
-    fmt::print(stderr,
-               "WARNING - input file is not a multiple of 4 bytes. "
-               "Uncompressing this file will result in a file padded with zeros.\n");
-
-  l::compress(src,dst);
-
-  dst_file_size = l::file_size(dst);
-  fmt::print("- input:\n"
-             "  - filepath: {}\n"
-             "  - size_in_bytes: {}\n"
-             "  - size_in_words: {}\n"
-             "- output:\n"
-             "  - filepath: {}\n"
-             "  - size_in_bytes: {}\n"
-             "  - size_in_words: {}\n"
-             ,
-             src_filepath,
-             src_file_size,
-             src_file_size / sizeof(uint32_t),
-             dst_filepath,
-             dst_file_size,
-             dst_file_size / sizeof(uint32_t));
-
-  fclose(src);
-  fclose(dst);
+  l::print_result(opts_,r);
+  l::finish_cache(opts_,ctx.cache);
 }
@@ -1,13 +1,23 @@
 #include "subcmd_decompress.hpp"
 
+#include "buffered_writer.hpp"
+#include "byteswap.hpp"
+#include "container.hpp"
 #include "decompress.hpp"
 #include "fmt.hpp"
+#include "json.hpp"
+#include "mapped_file.hpp"
+#include "resource_usage.hpp"
+#include "stream_reader.hpp"
 
 #include <errno.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -20,54 +30,529 @@ namespace l
     return ((v_ & 0x3) == 0);
   }
 
+  // "-" stands for stdin or stdout
+  static
+  bool
+  is_stdio(fs::path const &filepath_)
+  {
+    return (filepath_ == "-");
+  }
+
   static
   std::size_t
-  file_size(FILE *f_)
+  round_up_to_word(std::size_t v_)
+  {
+    return ((v_ + (sizeof(uint32_t) - 1)) & ~(sizeof(uint32_t) - 1));
+  }
+
+  // A raw stream can't start with the container magic so the first
+  // word is enough to refuse a container arriving through a pipe.
+  static
+  bool
+  is_container_header(const uint8_t *data_,
+                      std::size_t    size_)
   {
-    long orig_pos;
-    long end_pos;
+    uint32_t magic;
+
+    if(size_ < sizeof(magic))
+      return false;
 
-    orig_pos = ftell(f_);
-    fseek(f_,0L,SEEK_END);
-    end_pos = ftell(f_);
-    fseek(f_,orig_pos,SEEK_SET);
+    memcpy(&magic,data_,sizeof(magic));
 
-    return end_pos;
+    return (::byteswap_if_little_endian(magic) == CONTAINER_MAGIC);
+  }
+
+  static
+  const char*
+  error_string(int rv_)
+  {
+    switch(rv_)
+      {
+      case COMP_ERR_DATAREMAINS:
+        return "data after the end of stream marker";
+      case COMP_ERR_DATAMISSING:
+        return "no end of stream marker";
+      case COMP_ERR_OVERFLOW:
+        return "output too large";
+      case COMP_ERR_BADREF:
+        return "reference before the start of the stream";
+      default:
+        return "decompression failed";
+      }
   }
 
   static
   void
-  write_word(void     *f_,
-             uint32_t  word_)
+  throw_invalid_stream(const fs::path &src_filepath_,
+                       int             rv_,
+                       uint64_t        bit_)
   {
-    FILE *f = (FILE*)f_;
-    fwrite(&word_,1,sizeof(word_),f);
+    throw fmt::exception("ERROR: {} is not a valid stream - {} at byte {} bit {}",
+                         src_filepath_,
+                         l::error_string(rv_),
+                         bit_ / 8,
+                         bit_ % 8);
   }
 
+  // Only strict mode treats a bad stream as an error. The position is
+  // taken before the decompressor is deleted.
   static
   void
-  decompress(FILE *src_,
-             FILE *dst_)
+  finish(Decompressor   *decomp_,
+         bool            strict_,
+         const fs::path &src_filepath_)
+  {
+    int rv;
+    uint64_t bit;
+
+    bit = 0;
+    GetDecompressorPosition(decomp_,&bit);
+    rv = DeleteDecompressor(decomp_);
+    if(strict_ && (rv < 0))
+      l::throw_invalid_stream(src_filepath_,rv,bit);
+  }
+
+  // Returns the size of the output. The input is read ahead on
+  // another thread and may be a pipe.
+  static
+  std::size_t
+  decompress(FILE                       *src_,
+             FILE                       *dst_,
+             std::size_t                 chunk_size_,
+             std::vector<uint8_t> const &dict_,
+             bool                        strict_,
+             const fs::path             &src_filepath_,
+             DecompressorStats          *stats_,
+             std::size_t                &src_size_)
+  {
+    int rv;
+    uint8_t *buf;
+    std::size_t n;
+    Decompressor *decomp;
+
+    chunk_size_ = l::round_up_to_word(chunk_size_ ? chunk_size_ : 1);
+
+    StreamReader sr(src_,chunk_size_);
+    BufferedWriter bw(dst_,chunk_size_);
+
+    rv = CreateDecompressorSpan(&decomp,(CompSpanFunc)BufferedWriter::write_span,NULL,(void*)&bw);
+    if(rv < 0)
+      throw std::runtime_error("CreateDecompressor failed");
+
+    SetDecompressorDictionary(decomp,dict_.data(),dict_.size());
+
+    if(strict_)
+      SetDecompressorStrict(decomp,0);
+
+    if(stats_)
+      SetDecompressorStats(decomp,stats_);
+
+    src_size_ = 0;
+    while((n = sr.read(&buf)) != 0)
+      {
+        if((src_size_ == 0) && l::is_container_header(buf,n))
+          {
+            DeleteDecompressor(decomp);
+            throw std::runtime_error("ERROR: 3ct containers must be decompressed from a file");
+          }
+
+        // A trailing partial word is zero padded. Only the last block
+        // can be short and blocks are whole words so there is room.
+        if(!l::multiple_of_4(n))
+          memset(&buf[n],0,l::round_up_to_word(n) - n);
+
+        // A strict failure makes further feeds no-ops but the rest of
+        // the input has to be read to report its size
+        FeedDecompressor(decomp,buf,l::round_up_to_word(n) / sizeof(uint32_t));
+        src_size_ += n;
+      }
+
+    bw.flush();
+    l::finish(decomp,strict_,src_filepath_);
+
+    return bw.written();
+  }
+
+  static
+  std::size_t
+  decompress_mmap(const fs::path             &src_filepath_,
+                  FILE                       *dst_,
+                  std::size_t                 chunk_size_,
+                  std::vector<uint8_t> const &dict_,
+                  bool                        strict_,
+                  DecompressorStats          *stats_)
   {
     int rv;
+    uint32_t tail;
+    std::size_t words;
     Decompressor *decomp;
+    MappedFile src;
 
-    rv = CreateDecompressor(&decomp,(CompFunc)l::write_word,NULL,(void*)dst_);
+    src.open_read(src_filepath_);
+
+    BufferedWriter bw(dst_,chunk_size_);
+
+    rv = CreateDecompressorSpan(&decomp,(CompSpanFunc)BufferedWriter::write_span,NULL,(void*)&bw);
     if(rv < 0)
       throw std::runtime_error("CreateDecompressor failed");
 
-    while(true)
+    SetDecompressorDictionary(decomp,dict_.data(),dict_.size());
+
+    if(strict_)
+      SetDecompressorStrict(decomp,0);
+
+    if(stats_)
+      SetDecompressorStats(decomp,stats_);
+
+    words = (src.size() / sizeof(uint32_t));
+    FeedDecompressor(decomp,src.data(),words);
+
+    // A trailing partial word is zero padded
+    if(!l::multiple_of_4(src.size()))
+      {
+        tail = 0;
+        memcpy(&tail,&src.data()[words * sizeof(uint32_t)],src.size() & 0x3);
+        FeedDecompressor(decomp,&tail,1);
+      }
+
+    bw.flush();
+    l::finish(decomp,strict_,src_filepath_);
+
+    return bw.written();
+  }
+
+  // Decodes a mapped input straight into an output mapping sized
+  // exactly with GetDecompressedSize(). Returns false, having written
+  // nothing, for the inputs SimpleDecompress() doesn't handle as the
+  // streaming decoder does: a trailing partial word or a stream that
+  // doesn't end cleanly. In strict mode StrictDecompress() decodes
+  // it, which fails for the same streams streaming decoding would.
+  static
+  bool
+  decompress_mmap_to_mmap(const fs::path &src_filepath_,
+                          const fs::path &dst_filepath_,
+                          bool            strict_,
+                          std::size_t    &dst_size_)
+  {
+    uint64_t bit;
+    int32_t words;
+    MappedFile src;
+    MappedFile dst;
+    std::error_code ec;
+
+    src.open_read(src_filepath_);
+    if(!l::multiple_of_4(src.size()))
+      return false;
+
+    words = GetDecompressedSize(src.data(),src.size() / sizeof(uint32_t));
+    if(words < 0)
+      return false;
+
+    dst.create(dst_filepath_,(std::size_t)words * sizeof(uint32_t));
+    if(strict_)
+      words = StrictDecompress(src.data(),
+                               src.size() / sizeof(uint32_t),
+                               dst.data(),
+                               words,
+                               NULL,
+                               &bit);
+    else
+      words = SimpleDecompress(src.data(),
+                               src.size() / sizeof(uint32_t),
+                               dst.data(),
+                               words);
+    if(words < 0)
+      {
+        dst.close();
+        fs::remove(dst_filepath_,ec);
+        if(strict_)
+          l::throw_invalid_stream(src_filepath_,words,bit);
+        throw fmt::exception("ERROR: failed to decompress {}",src_filepath_);
+      }
+
+    dst_size_ = ((std::size_t)words * sizeof(uint32_t));
+    dst.close(dst_size_);
+
+    return true;
+  }
+
+  static
+  std::string
+  offset_bucket_name(int bucket_)
+  {
+    if(bucket_ == 0)
+      return "1";
+    if(bucket_ == (STATS_OFFSET_COUNT - 1))
+      return fmt::format("{}",1 << bucket_);
+
+    return fmt::format("{}-{}",1 << bucket_,(2 << bucket_) - 1);
+  }
+
+  static
+  void
+  print_stats(FILE                    *out_,
+              DecompressorStats const &stats_)
+  {
+    std::string lengths;
+    std::string offsets;
+
+    // Phrases are 3 to 18 bytes long
+    for(int i = 3; i < STATS_LENGTH_COUNT; i++)
+      lengths += fmt::format("{}{}: {}",
+                             (lengths.empty() ? "" : ", "),
+                             i,
+                             stats_.ds_PhraseLengths[i]);
+    for(int i = 0; i < STATS_OFFSET_COUNT; i++)
+      offsets += fmt::format("{}{}: {}",
+                             (offsets.empty() ? "" : ", "),
+                             l::offset_bucket_name(i),
+                             stats_.ds_PhraseOffsets[i]);
+
+    fmt::print(out_,
+               "- stats:\n"
+               "  - literals: {}\n"
+               "  - phrases: {}\n"
+               "  - phrase_lengths: {{{}}}\n"
+               "  - phrase_offsets: {{{}}}\n"
+               "  - words_read: {}\n"
+               "  - words_written: {}\n"
+               ,
+               stats_.ds_Literals,
+               stats_.ds_Phrases,
+               lengths,
+               offsets,
+               stats_.ds_WordsRead,
+               stats_.ds_WordsWritten);
+  }
+
+  static
+  double
+  mb_per_sec(std::size_t size_,
+             double      secs_)
+  {
+    return ((secs_ > 0) ? ((size_ / 1000000.0) / secs_) : 0);
+  }
+
+  static
+  JsonObject
+  json_stats(DecompressorStats const &stats_)
+  {
+    JsonObject rv;
+    JsonObject lengths;
+    JsonObject offsets;
+
+    for(int i = 3; i < STATS_LENGTH_COUNT; i++)
+      lengths.add(std::to_string(i),stats_.ds_PhraseLengths[i]);
+    for(int i = 0; i < STATS_OFFSET_COUNT; i++)
+      offsets.add(l::offset_bucket_name(i),stats_.ds_PhraseOffsets[i]);
+
+    rv.add("literals",stats_.ds_Literals)
+      .add("phrases",stats_.ds_Phrases)
+      .add("phrase_lengths",lengths)
+      .add("phrase_offsets",offsets)
+      .add("words_read",stats_.ds_WordsRead)
+      .add("words_written",stats_.ds_WordsWritten);
+
+    return rv;
+  }
+
+  // stats_ is NULL unless --stats was given. The time is from the
+  // start of the subcommand.
+  static
+  void
+  print_result(Options const                  &opts_,
+               const fs::path                 &src_filepath_,
+               std::size_t                     src_file_size_,
+               const fs::path                 &dst_filepath_,
+               std::size_t                     dst_file_size_,
+               ResourceUsage::Stopwatch const &sw_,
+               DecompressorStats const        *stats_ = NULL)
+  {
+    FILE *out;
+    double wall_secs;
+    JsonObject rv;
+    JsonObject input;
+    JsonObject output;
+
+    // Keep the report out of the data when it goes to stdout
+    out = (l::is_stdio(dst_filepath_) ? stderr : stdout);
+
+    if(opts_.report != "json")
+      {
+        fmt::print(out,
+                   "- input:\n"
+                   "  - filepath: {}\n"
+                   "  - size_in_bytes: {}\n"
+                   "  - size_in_words: {}\n"
+                   "- output:\n"
+                   "  - filepath: {}\n"
+                   "  - size_in_bytes: {}\n"
+                   "  - size_in_words: {}\n"
+                   ,
+                   src_filepath_,
+                   src_file_size_,
+                   src_file_size_ / sizeof(uint32_t),
+                   dst_filepath_,
+                   dst_file_size_,
+                   dst_file_size_ / sizeof(uint32_t));
+        if(stats_)
+          l::print_stats(out,*stats_);
+        return;
+      }
+
+    wall_secs = sw_.wall_seconds();
+
+    input.add("filepath",src_filepath_.string())
+      .add("size_in_bytes",src_file_size_)
+      .add("size_in_words",src_file_size_ / sizeof(uint32_t));
+    output.add("filepath",dst_filepath_.string())
+      .add("size_in_bytes",dst_file_size_)
+      .add("size_in_words",dst_file_size_ / sizeof(uint32_t));
+
+    rv.add("input",input)
+      .add("output",output)
+      .add("wall_time_in_seconds",wall_secs)
+      .add("cpu_time_in_seconds",sw_.cpu_seconds())
+      .add("mb_per_sec",l::mb_per_sec(dst_file_size_,wall_secs))
+      .add("ratio",(dst_file_size_ ?
+                    ((double)src_file_size_ / dst_file_size_) :
+                    0.0))
+      .add("peak_rss_in_bytes",ResourceUsage::peak_rss());
+    if(stats_)
+      rv.add("stats",l::json_stats(*stats_));
+
+    fmt::print(out,"{}\n",rv.str());
+  }
+
+  static
+  bool
+  is_container(const fs::path &filepath_)
+  {
+    MappedFile src;
+
+    src.open_read(filepath_);
+
+    return Container::is_container(src.data(),src.size());
+  }
+
+  // Either number may be decimal, hex (0x) or octal (0)
+  static
+  uint64_t
+  parse_number(std::string const &s_,
+               std::string const &range_)
+  {
+    std::size_t pos;
+    uint64_t v;
+
+    try
+      {
+        v = std::stoull(s_,&pos,0);
+      }
+    catch(const std::exception &)
+      {
+        pos = 0;
+      }
+
+    if(s_.empty() || (pos != s_.size()))
+      throw fmt::exception("ERROR: invalid range '{}', expected OFFSET:LEN",range_);
+
+    return v;
+  }
+
+  static
+  void
+  parse_range(std::string const &range_,
+              uint64_t          &offset_,
+              uint64_t          &length_)
+  {
+    std::size_t colon;
+
+    colon = range_.find(':');
+    if(colon == std::string::npos)
+      throw fmt::exception("ERROR: invalid range '{}', expected OFFSET:LEN",range_);
+
+    offset_ = l::parse_number(range_.substr(0,colon),range_);
+    if(colon + 1 == range_.size())
+      length_ = UINT64_MAX;
+    else
+      length_ = l::parse_number(range_.substr(colon + 1),range_);
+  }
+
+  static
+  std::size_t
+  decompress_range(const fs::path    &src_filepath_,
+                   const fs::path    &dst_filepath_,
+                   std::string const &range_)
+  {
+    FILE *dst;
+    uint64_t offset;
+    uint64_t length;
+    std::size_t written;
+    MappedFile src;
+
+    l::parse_range(range_,offset,length);
+
+    src.open_read(src_filepath_);
+    if(!Container::is_container(src.data(),src.size()))
+      throw std::runtime_error("ERROR: --range needs a 3ct container, "
+                               "raw streams can only be decoded from the start");
+
+    if(l::is_stdio(dst_filepath_))
+      {
+        dst = stdout;
+        StreamReader::set_binary(dst);
+      }
+    else
       {
-        uint32_t w;
+        dst = fopen(dst_filepath_.string().c_str(),"wb");
+        if(dst == NULL)
+          throw fmt::exception("ERROR: failed to open {} - {}",dst_filepath_,strerror(errno));
+      }
 
-        w = 0;
-        rv = fread(&w,1,sizeof(w),src_);
-        if((rv == 0) && (feof(src_) || ferror(src_)))
-          break;
-        FeedDecompressor(decomp,&w,1);
+    try
+      {
+        written = Container::decompress_range(src.data(),src.size(),offset,length,dst);
       }
+    catch(...)
+      {
+        if(!l::is_stdio(dst_filepath_))
+          fclose(dst);
+        throw;
+      }
+
+    if(l::is_stdio(dst_filepath_) ? (fflush(dst) != 0) : (fclose(dst) != 0))
+      throw fmt::exception("ERROR: failed to write {} - {}",dst_filepath_,strerror(errno));
+
+    return written;
+  }
+
+  // Only the part of the file the compressor would have kept is read
+  static
+  std::vector<uint8_t>
+  read_dictionary(fs::path const &filepath_)
+  {
+    MappedFile f;
+    std::size_t n;
+
+    f.open_read(filepath_);
+    n = std::min(f.size(),(std::size_t)COMP_DICTIONARY_SIZE);
 
-    rv = DeleteDecompressor(decomp);
+    return std::vector<uint8_t>(f.data() + (f.size() - n),f.data() + f.size());
+  }
+
+  static
+  std::size_t
+  decompress_container(const fs::path &src_filepath_,
+                       const fs::path &dst_filepath_,
+                       unsigned        jobs_)
+  {
+    MappedFile src;
+    Container::Info info;
+
+    src.open_read(src_filepath_);
+    info = Container::decompress(src.data(),src.size(),dst_filepath_,jobs_);
+
+    return info.size;
   }
 }
 
@@ -76,52 +561,135 @@ SubCmd::decompress(Options const &opts_)
 {
   FILE *src;
   FILE *dst;
+  int rv;
+  std::error_code ec;
   fs::path src_filepath;
   fs::path dst_filepath;
   std::size_t src_file_size;
   std::size_t dst_file_size;
+  DecompressorStats stats;
+  std::vector<uint8_t> dict;
+  // Containers are decoded on other threads too
+  ResourceUsage::Stopwatch sw(true);
 
   src_filepath = opts_.input_filepath;
   dst_filepath = opts_.output_filepath;
-  if(dst_filepath.empty())
+  if(dst_filepath.empty() && l::is_stdio(src_filepath))
+    {
+      dst_filepath = "-";
+    }
+  else if(dst_filepath.empty())
     {
       dst_filepath  = src_filepath;
       dst_filepath += ".decompressed";
     }
 
-  src = fopen(src_filepath.string().c_str(),"rb");
-  if(src == NULL)
-    throw fmt::exception("ERROR: failed to open {} - {}",src_filepath,strerror(errno));
-
-  dst = fopen(dst_filepath.string().c_str(),"wb");
-  if(dst == NULL)
-    throw fmt::exception("ERROR: failed to open {} - {}",dst_filepath,strerror(errno));
-
-  src_file_size = l::file_size(src);
-  if(!l::multiple_of_4(src_file_size))
-    fmt::print(stderr,
-               "WARNING - input file is not a multiple of 4 bytes. "
-               "The file may be corrupted or not a 3DO compressed file.\n");
-
-  l::decompress(src,dst);
-
-  dst_file_size = l::file_size(dst);
-  fmt::print("- input:\n"
-             "  - filepath: {}\n"
-             "  - size_in_bytes: {}\n"
-             "  - size_in_words: {}\n"
-             "- output:\n"
-             "  - filepath: {}\n"
-             "  - size_in_bytes: {}\n"
-             "  - size_in_words: {}\n"
-             ,
-             src_filepath,
-             src_file_size,
-             src_file_size / sizeof(uint32_t),
-             dst_filepath,
-             dst_file_size,
-             dst_file_size / sizeof(uint32_t));
-
-  fclose(src);
-  fclose(dst);
+  if(!opts_.dictionary_filepath.empty())
+    dict = l::read_dictionary(opts_.dictionary_filepath);
+
+  if(!opts_.range.empty())
+    {
+      if(!dict.empty())
+        throw std::runtime_error("ERROR: --dictionary can not be used with --range");
+      if(l::is_stdio(src_filepath))
+        throw std::runtime_error("ERROR: --range can not be used with stdin");
+      src_file_size = fs::file_size(src_filepath);
+      dst_file_size = l::decompress_range(src_filepath,dst_filepath,opts_.range);
+      return l::print_result(opts_,src_filepath,src_file_size,dst_filepath,dst_file_size,sw);
+    }
+
+  src_file_size = 0;
+  if(!l::is_stdio(src_filepath))
+    {
+      src_file_size = fs::file_size(src_filepath);
+      if(l::is_container(src_filepath))
+        {
+          if(l::is_stdio(dst_filepath))
+            throw std::runtime_error("ERROR: 3ct containers can not be decompressed to stdout");
+          if(!dict.empty())
+            throw std::runtime_error("ERROR: --dictionary can not be used with 3ct containers");
+          dst_file_size = l::decompress_container(src_filepath,dst_filepath,opts_.jobs);
+          return l::print_result(opts_,src_filepath,src_file_size,dst_filepath,dst_file_size,sw);
+        }
+
+      if(!l::multiple_of_4(src_file_size))
+        fmt::print(stderr,
+                   "WARNING - input file is not a multiple of 4 bytes. "
+                   "The file may be corrupted or not a 3DO compressed file.\n");
+    }
+
+  if(opts_.mmap && l::is_stdio(src_filepath))
+    throw std::runtime_error("ERROR: --mmap can not be used with stdin");
+
+  // SimpleDecompress() has no stats or dictionary
+  if(opts_.mmap && !l::is_stdio(dst_filepath) && !opts_.stats && dict.empty())
+    {
+      if(l::decompress_mmap_to_mmap(src_filepath,dst_filepath,opts_.strict,dst_file_size))
+        return l::print_result(opts_,src_filepath,src_file_size,dst_filepath,dst_file_size,sw);
+    }
+
+  if(l::is_stdio(dst_filepath))
+    {
+      dst = stdout;
+      StreamReader::set_binary(dst);
+    }
+  else
+    {
+      dst = fopen(dst_filepath.string().c_str(),"wb");
+      if(dst == NULL)
+        throw fmt::exception("ERROR: failed to open {} - {}",dst_filepath,strerror(errno));
+    }
+
+  src = NULL;
+  try
+    {
+      if(opts_.mmap)
+        {
+          dst_file_size = l::decompress_mmap(src_filepath,dst,opts_.chunk_size,dict,opts_.strict,(opts_.stats ? &stats : NULL));
+        }
+      else if(l::is_stdio(src_filepath))
+        {
+          StreamReader::set_binary(stdin);
+          dst_file_size = l::decompress(stdin,dst,opts_.chunk_size,dict,opts_.strict,src_filepath,(opts_.stats ? &stats : NULL),src_file_size);
+        }
+      else
+        {
+          src = fopen(src_filepath.string().c_str(),"rb");
+          if(src == NULL)
+            throw fmt::exception("ERROR: failed to open {} - {}",src_filepath,strerror(errno));
+
+          dst_file_size = l::decompress(src,dst,opts_.chunk_size,dict,opts_.strict,src_filepath,(opts_.stats ? &stats : NULL),src_file_size);
+        }
+    }
+  catch(...)
+    {
+      // As compress --verify, a partial output is removed rather than
+      // left looking like a complete one
+      if(src)
+        fclose(src);
+      if(l::is_stdio(dst_filepath))
+        {
+          fflush(dst);
+        }
+      else
+        {
+          fclose(dst);
+          fs::remove(dst_filepath,ec);
+        }
+      throw;
+    }
+
+  if(src)
+    fclose(src);
+
+  // A write error may only show once the buffered tail is flushed
+  if(l::is_stdio(dst_filepath))
+    rv = fflush(dst);
+  else
+    rv = fclose(dst);
+  if(rv != 0)
+    throw fmt::exception("ERROR: failed to write {} - {}",dst_filepath,strerror(errno));
+
+  l::print_result(opts_,src_filepath,src_file_size,dst_filepath,dst_file_size,sw,
+                  (opts_.stats ? &stats : NULL));
 }
@@ -0,0 +1,289 @@
+#include "subcmd_scan.hpp"
+
+#include "decompress.hpp"
+#include "fmt.hpp"
+#include "mapped_file.hpp"
+#include "work_pool.hpp"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Bytes of image whose offsets make up one task. Small enough to keep
+// every worker busy to the end, large enough that merging is cheap.
+#define SCAN_TASK_SIZE (1024 * 1024)
+
+namespace l
+{
+  struct Stream
+  {
+    std::size_t offset          = 0;
+    std::size_t compressed_size = 0;
+    std::size_t size            = 0;
+  };
+
+  struct Scan
+  {
+    const uint8_t *image;
+    std::size_t    image_size;
+    std::size_t    align;
+    std::size_t    min_size;
+    uint32_t       max_words;
+  };
+
+  static
+  std::size_t
+  round_up(std::size_t v_,
+           std::size_t align_)
+  {
+    return (((v_ + align_ - 1) / align_) * align_);
+  }
+
+  // Where the next candidate after a stream is
+  static
+  std::size_t
+  stream_end(Scan const   &scan_,
+             Stream const &stream_)
+  {
+    return l::round_up(stream_.offset + stream_.compressed_size,scan_.align);
+  }
+
+  // Every stream starts with a literal, whose flag bit is the high bit
+  // of the first byte, which rules out half of all offsets for free.
+  static
+  bool
+  may_start_stream(const uint8_t *p_)
+  {
+    return (*p_ & 0x80);
+  }
+
+  // Tries every aligned offset in [start_,end_). A stream found is
+  // skipped over, nothing inside it is tried. Streams may run past
+  // end_.
+  static
+  void
+  scan_range(Scan const          &scan_,
+             std::size_t          start_,
+             std::size_t          end_,
+             uint8_t             *buf_,
+             std::vector<Stream> &found_)
+  {
+    int rv;
+    uint32_t words;
+    std::size_t offset;
+    Stream stream;
+
+    offset = l::round_up(start_,scan_.align);
+    while(offset < end_)
+      {
+        if(!l::may_start_stream(&scan_.image[offset]))
+          {
+            offset += scan_.align;
+            continue;
+          }
+
+        rv = StrictDecompress(&scan_.image[offset],
+                              (uint32_t)std::min((scan_.image_size - offset) / sizeof(uint32_t),
+                                                 (std::size_t)UINT32_MAX),
+                              buf_,
+                              scan_.max_words,
+                              &words,
+                              NULL);
+        if((rv < 0) || (((std::size_t)rv * sizeof(uint32_t)) < scan_.min_size))
+          {
+            offset += scan_.align;
+            continue;
+          }
+
+        stream.offset          = offset;
+        stream.compressed_size = ((std::size_t)words * sizeof(uint32_t));
+        stream.size            = ((std::size_t)rv * sizeof(uint32_t));
+        found_.push_back(stream);
+
+        offset = l::stream_end(scan_,stream);
+      }
+  }
+
+  // Each task skipped past the streams it found, but one starting
+  // inside a stream found by an earlier task is part of that stream
+  // and what it skipped over was never tried. That stretch is scanned
+  // again from the end of the earlier stream.
+  static
+  std::vector<Stream>
+  merge(Scan const                       &scan_,
+        std::vector<std::vector<Stream>> &found_,
+        uint8_t                          *buf_)
+  {
+    std::size_t end;
+    std::size_t done_to;
+    std::vector<Stream> rv;
+    std::vector<Stream> rescanned;
+
+    done_to = 0;
+    for(std::size_t task = 0; task < found_.size(); task++)
+      {
+        for(auto const &stream : found_[task])
+          {
+            if(stream.offset >= done_to)
+              {
+                rv.push_back(stream);
+                done_to = l::stream_end(scan_,stream);
+                continue;
+              }
+
+            end = std::min(l::stream_end(scan_,stream),
+                           std::min((task + 1) * SCAN_TASK_SIZE,scan_.image_size));
+            if(end <= done_to)
+              continue;
+
+            rescanned.clear();
+            l::scan_range(scan_,done_to,end,buf_,rescanned);
+            for(auto const &s : rescanned)
+              {
+                rv.push_back(s);
+                done_to = l::stream_end(scan_,s);
+              }
+            done_to = std::max(done_to,end);
+          }
+      }
+
+    return rv;
+  }
+
+  static
+  fs::path
+  extract_filepath(Options const  &opts_,
+                   const fs::path &image_filepath_,
+                   Stream const   &stream_)
+  {
+    return (opts_.extract_dirpath /
+            fmt::format("{}.{:08x}.decompressed",
+                        image_filepath_.filename().string(),
+                        stream_.offset));
+  }
+
+  static
+  void
+  extract(Scan const     &scan_,
+          Stream const   &stream_,
+          const fs::path &dst_filepath_,
+          uint8_t        *buf_)
+  {
+    int rv;
+    FILE *dst;
+
+    rv = StrictDecompress(&scan_.image[stream_.offset],
+                          stream_.compressed_size / sizeof(uint32_t),
+                          buf_,
+                          scan_.max_words,
+                          NULL,
+                          NULL);
+    if(rv < 0)
+      throw fmt::exception("ERROR: failed to decompress stream at {}",stream_.offset);
+
+    dst = fopen(dst_filepath_.string().c_str(),"wb");
+    if(dst == NULL)
+      throw fmt::exception("ERROR: failed to open {} - {}",dst_filepath_,strerror(errno));
+
+    if(fwrite(buf_,1,stream_.size,dst) != stream_.size)
+      {
+        fclose(dst);
+        throw fmt::exception("ERROR: failed to write {} - {}",dst_filepath_,strerror(errno));
+      }
+
+    if(fclose(dst) != 0)
+      throw fmt::exception("ERROR: failed to write {} - {}",dst_filepath_,strerror(errno));
+  }
+}
+
+void
+SubCmd::scan(Options const &opts_)
+{
+  std::size_t tasks;
+  std::size_t max_size;
+  MappedFile image;
+  l::Scan scan;
+  std::vector<l::Stream> streams;
+  std::vector<std::vector<l::Stream>> found;
+  std::vector<std::unique_ptr<uint8_t[]>> bufs;
+
+  if(opts_.align == 0)
+    throw std::runtime_error("ERROR: --align must be at least 1");
+
+  image.open_read(opts_.input_filepath);
+
+  max_size = std::min(opts_.max_size,((std::size_t)INT32_MAX & ~(sizeof(uint32_t) - 1)));
+
+  scan.image      = image.data();
+  scan.image_size = image.size();
+  scan.align      = opts_.align;
+  scan.min_size   = std::max(opts_.min_size,(std::size_t)1);
+  scan.max_words  = (uint32_t)(max_size / sizeof(uint32_t));
+
+  // Each worker decodes candidates into its own buffer, which is also
+  // what caps the size of a stream
+  WorkPool pool(opts_.jobs ? opts_.jobs : WorkPool::default_threads());
+  for(unsigned i = 0; i < pool.size(); i++)
+    bufs.emplace_back(new uint8_t[max_size]);
+
+  tasks = ((scan.image_size + SCAN_TASK_SIZE - 1) / SCAN_TASK_SIZE);
+  found.resize(tasks);
+  pool.run(tasks,
+           [&](std::size_t task_,
+               unsigned    worker_)
+           {
+             l::scan_range(scan,
+                           task_ * SCAN_TASK_SIZE,
+                           std::min((task_ + 1) * SCAN_TASK_SIZE,scan.image_size),
+                           bufs[worker_].get(),
+                           found[task_]);
+           });
+
+  streams = l::merge(scan,found,bufs[0].get());
+
+  if(!opts_.extract_dirpath.empty())
+    {
+      fs::create_directories(opts_.extract_dirpath);
+      pool.run(streams.size(),
+               [&](std::size_t task_,
+                   unsigned    worker_)
+               {
+                 l::extract(scan,
+                            streams[task_],
+                            l::extract_filepath(opts_,opts_.input_filepath,streams[task_]),
+                            bufs[worker_].get());
+               });
+    }
+
+  fmt::print("- input:\n"
+             "  - filepath: {}\n"
+             "  - size_in_bytes: {}\n"
+             ,
+             opts_.input_filepath,
+             scan.image_size);
+
+  for(auto const &stream : streams)
+    {
+      fmt::print("- stream:\n"
+                 "  - offset: {}\n"
+                 "  - compressed_size_in_bytes: {}\n"
+                 "  - size_in_bytes: {}\n"
+                 ,
+                 stream.offset,
+                 stream.compressed_size,
+                 stream.size);
+      if(!opts_.extract_dirpath.empty())
+        fmt::print("  - filepath: {}\n",
+                   l::extract_filepath(opts_,opts_.input_filepath,stream));
+    }
+
+  fmt::print("- streams_found: {}\n",streams.size());
+}
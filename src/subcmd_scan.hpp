@@ -0,0 +1,8 @@
+#pragma once
+
+#include "options.hpp"
+
+namespace SubCmd
+{
+  void scan(Options const &opts);
+}
@@ -1,5 +1,28 @@
 #pragma once
 
-#include <cstdint>
+/* Included by the public headers so C as well as C++ */
+#include <stddef.h>
+#include <stdint.h>
 
 typedef void (*CompFunc)(void *userData, uint32_t word);
+
+/*
+ * Batched alternative to CompFunc. The words are in the same memory
+ * order a CompFunc would receive them and remain valid only for the
+ * duration of the call.
+ */
+typedef void (*CompSpanFunc)(void *userData, const uint32_t *words, size_t numWords);
+
+/*
+ * Histogram sizes shared by the compressor and decompressor stats.
+ * Phrase lengths are indexed directly (3 to 18 are used) and offsets
+ * are bucketed by floor(log2(distance)) for distances of 1 to 4096.
+ */
+#define STATS_LENGTH_COUNT 19
+#define STATS_OFFSET_COUNT 13
+
+/*
+ * The most preset dictionary the compressor and decompressor keep: a
+ * window less the look ahead. See SetCompressorDictionary().
+ */
+#define COMP_DICTIONARY_SIZE 4078
@@ -0,0 +1,157 @@
+#include "verifier.hpp"
+
+#include "fmt.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+Verifier::Verifier(CompSpanFunc  next_,
+                   void         *next_userdata_)
+  : Verifier(next_,next_userdata_,NULL,0)
+{
+}
+
+Verifier::Verifier(CompSpanFunc   next_,
+                   void          *next_userdata_,
+                   const uint8_t *src_,
+                   std::size_t    src_size_)
+  : _next(next_),
+    _next_userdata(next_userdata_),
+    _decomp(NULL),
+    _data(src_),
+    _len(src_size_),
+    _pos(0),
+    _base(0),
+    _total(src_size_),
+    _padding(0),
+    _failed(false),
+    _fail_offset(0)
+{
+  int rv;
+
+  rv = CreateDecompressorSpan(&_decomp,Verifier::check_span,NULL,(void*)this);
+  if(rv < 0)
+    throw std::runtime_error("CreateDecompressor failed");
+}
+
+Verifier::~Verifier()
+{
+  if(_decomp)
+    DeleteDecompressor(_decomp);
+}
+
+void
+Verifier::dictionary(const void  *dict_,
+                     std::size_t  size_)
+{
+  int rv;
+
+  rv = SetDecompressorDictionary(_decomp,dict_,size_);
+  if(rv < 0)
+    throw std::runtime_error("SetDecompressorDictionary failed");
+}
+
+// Input that has been matched already is dropped once it makes up
+// most of the buffer so only the compressor's lag is kept around.
+void
+Verifier::expect(const void  *data_,
+                 std::size_t  size_)
+{
+  const uint8_t *data = (const uint8_t*)data_;
+  std::lock_guard<std::mutex> guard(_lock);
+
+  if(_pos > (_buf.size() / 2))
+    {
+      _buf.erase(_buf.begin(),_buf.begin() + _pos);
+      _base += _pos;
+      _pos   = 0;
+    }
+
+  _buf.insert(_buf.end(),data,data + size_);
+  _data   = _buf.data();
+  _len    = _buf.size();
+  _total += size_;
+}
+
+void
+Verifier::finish()
+{
+  int rv;
+
+  if(_decomp == NULL)
+    return;
+
+  rv = DeleteDecompressor(_decomp);
+  _decomp = NULL;
+
+  if(_failed)
+    throw Verifier::Mismatch(fmt::format("ERROR: verify failed - output differs "
+                                         "from input at byte {}",
+                                         _fail_offset));
+  if(rv < 0)
+    throw Verifier::Mismatch(fmt::format("ERROR: verify failed - decompressor "
+                                         "returned {}",
+                                         rv));
+  if(_pos != _len)
+    throw Verifier::Mismatch(fmt::format("ERROR: verify failed - output decodes "
+                                         "{} bytes short",
+                                         (_len - _pos)));
+  if(_padding != ((sizeof(uint32_t) - (_total & 0x3)) & 0x3))
+    throw Verifier::Mismatch(fmt::format("ERROR: verify failed - output decodes "
+                                         "{} bytes past the input",
+                                         _padding));
+}
+
+void
+Verifier::write_span(void           *verifier_,
+                     const uint32_t *words_,
+                     std::size_t     num_words_)
+{
+  Verifier *v = (Verifier*)verifier_;
+
+  (*v->_next)(v->_next_userdata,words_,num_words_);
+
+  std::lock_guard<std::mutex> guard(v->_lock);
+  FeedDecompressor(v->_decomp,(void*)words_,num_words_);
+}
+
+void
+Verifier::check_span(void           *verifier_,
+                     const uint32_t *words_,
+                     std::size_t     num_words_)
+{
+  std::size_t i;
+  std::size_t n;
+  std::size_t size;
+  const uint8_t *data;
+  Verifier *v = (Verifier*)verifier_;
+
+  if(v->_failed)
+    return;
+
+  data = (const uint8_t*)words_;
+  size = (num_words_ * sizeof(uint32_t));
+  n    = std::min(size,v->_len - v->_pos);
+  if(memcmp(&v->_data[v->_pos],data,n) != 0)
+    {
+      for(i = 0; data[i] == v->_data[v->_pos + i]; i++)
+        ;
+      v->_failed      = true;
+      v->_fail_offset = (v->_base + v->_pos + i);
+      return;
+    }
+  v->_pos += n;
+
+  // The decoder never gets ahead of the input so anything more is
+  // the padding of the last word
+  for(i = n; i < size; i++)
+    {
+      if(data[i] != 0)
+        {
+          v->_failed      = true;
+          v->_fail_offset = (v->_base + v->_pos + v->_padding);
+          return;
+        }
+      v->_padding++;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "decompress.hpp"
+#include "types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Checks compressor output as it is produced. write_span() matches
+ * the CompSpanFunc signature so a Verifier can stand in for the
+ * compressor's output callback: each span is passed on to the next
+ * callback and fed to a Decompressor whose output is compared with
+ * the input. The input is either given up front or, when it streams
+ * by, handed over with expect() before it is fed to the compressor.
+ * Output past the input is allowed only as the zero padding of a
+ * trailing partial word.
+ *
+ * Decoding runs inline on the thread delivering the output. It is a
+ * small fraction of the cost of compressing so a second thread
+ * wouldn't buy anything. A pipelined compressor delivers from its
+ * packer thread so expect() and write_span() are serialized.
+ *
+ * A stream compressed with a preset dictionary needs the same
+ * dictionary given to dictionary() before the first span.
+ *
+ * finish() throws Verifier::Mismatch if the stream doesn't decode to
+ * the input.
+ */
+class Verifier
+{
+public:
+  class Mismatch : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+public:
+  Verifier(CompSpanFunc  next,
+           void         *next_userdata);
+  Verifier(CompSpanFunc   next,
+           void          *next_userdata,
+           const uint8_t *src,
+           std::size_t    src_size);
+  ~Verifier();
+
+  Verifier(const Verifier&) = delete;
+  Verifier& operator=(const Verifier&) = delete;
+
+public:
+  void dictionary(const void  *dict,
+                  std::size_t  size);
+  void expect(const void  *data,
+              std::size_t  size);
+  void finish();
+
+public:
+  static void write_span(void           *verifier,
+                         const uint32_t *words,
+                         std::size_t     num_words);
+
+private:
+  static void check_span(void           *verifier,
+                         const uint32_t *words,
+                         std::size_t     num_words);
+
+private:
+  CompSpanFunc          _next;
+  void                 *_next_userdata;
+  Decompressor         *_decomp;
+  std::vector<uint8_t>  _buf;
+  const uint8_t        *_data;
+  std::size_t           _len;
+  std::size_t           _pos;
+  uint64_t              _base;
+  uint64_t              _total;
+  uint64_t              _padding;
+  bool                  _failed;
+  uint64_t              _fail_offset;
+  std::mutex            _lock;
+};
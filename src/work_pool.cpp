@@ -0,0 +1,137 @@
+#include "work_pool.hpp"
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace l
+{
+  struct Queue
+  {
+    std::mutex              lock;
+    std::deque<std::size_t> tasks;
+  };
+
+  static
+  bool
+  pop_front(Queue       &q_,
+            std::size_t &task_)
+  {
+    std::lock_guard<std::mutex> guard(q_.lock);
+
+    if(q_.tasks.empty())
+      return false;
+
+    task_ = q_.tasks.front();
+    q_.tasks.pop_front();
+
+    return true;
+  }
+
+  static
+  bool
+  pop_back(Queue       &q_,
+           std::size_t &task_)
+  {
+    std::lock_guard<std::mutex> guard(q_.lock);
+
+    if(q_.tasks.empty())
+      return false;
+
+    task_ = q_.tasks.back();
+    q_.tasks.pop_back();
+
+    return true;
+  }
+
+  // Tasks are never added once run() starts so a full pass over every
+  // queue coming up empty means there is nothing left to do.
+  static
+  bool
+  next_task(std::vector<std::unique_ptr<Queue>> &queues_,
+            unsigned                             worker_,
+            std::size_t                         &task_)
+  {
+    if(l::pop_front(*queues_[worker_],task_))
+      return true;
+
+    for(std::size_t i = 1; i < queues_.size(); i++)
+      {
+        if(l::pop_back(*queues_[(worker_ + i) % queues_.size()],task_))
+          return true;
+      }
+
+    return false;
+  }
+}
+
+WorkPool::WorkPool(unsigned threads_)
+  : _threads(threads_ ? threads_ : 1)
+{
+}
+
+unsigned
+WorkPool::default_threads()
+{
+  unsigned n;
+
+  n = std::thread::hardware_concurrency();
+
+  return (n ? n : 1);
+}
+
+void
+WorkPool::run(std::size_t     count_,
+              TaskFunc const &func_)
+{
+  unsigned nthreads;
+  std::mutex error_lock;
+  std::exception_ptr error;
+  std::vector<std::thread> threads;
+  std::vector<std::unique_ptr<l::Queue>> queues;
+
+  if(count_ == 0)
+    return;
+
+  nthreads = _threads;
+  if(nthreads > count_)
+    nthreads = count_;
+
+  for(unsigned i = 0; i < nthreads; i++)
+    queues.emplace_back(new l::Queue);
+  for(std::size_t i = 0; i < count_; i++)
+    queues[(i * nthreads) / count_]->tasks.push_back(i);
+
+  auto worker =
+    [&](unsigned worker_)
+    {
+      std::size_t task;
+
+      while(l::next_task(queues,worker_,task))
+        {
+          try
+            {
+              func_(task,worker_);
+            }
+          catch(...)
+            {
+              std::lock_guard<std::mutex> guard(error_lock);
+              if(!error)
+                error = std::current_exception();
+            }
+        }
+    };
+
+  for(unsigned i = 1; i < nthreads; i++)
+    threads.emplace_back(worker,i);
+  worker(0);
+
+  for(auto &t : threads)
+    t.join();
+
+  if(error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/*
+ * Runs a fixed number of independent tasks over a set of worker
+ * threads. Tasks are dealt out to per-worker queues up front in
+ * contiguous runs; a worker takes from the front of its own queue and,
+ * once that is empty, steals from the back of the others. The
+ * callback receives the task index and the index of the worker
+ * running it so callers can keep per-worker state such as
+ * preallocated codec work buffers.
+ *
+ * The first exception thrown by a task is rethrown from run() after
+ * all workers have stopped.
+ */
+class WorkPool
+{
+public:
+  typedef std::function<void(std::size_t task, unsigned worker)> TaskFunc;
+
+public:
+  explicit WorkPool(unsigned threads);
+
+public:
+  unsigned size() const { return _threads; }
+  void     run(std::size_t count, TaskFunc const &func);
+
+public:
+  static unsigned default_threads();
+
+private:
+  unsigned _threads;
+};
@@ -0,0 +1,69 @@
+#include "worker_arena.hpp"
+
+#include <cstdlib>
+
+WorkerArena::WorkerArena(std::size_t size_)
+  : _region(new uint8_t[size_])
+{
+  InitCompArena(&_arena,_region.get(),size_);
+  CompArenaAllocator(&_arena,&_arena_alloc);
+}
+
+std::size_t
+WorkerArena::size_for(std::size_t const *sizes_,
+                      std::size_t        count_)
+{
+  std::size_t size;
+
+  size = 0;
+  for(std::size_t i = 0; i < count_; i++)
+    size += (sizes_[i] + COMP_ARENA_ALIGN);
+
+  return size;
+}
+
+void*
+WorkerArena::alloc(void        *arena_,
+                   std::size_t  size_)
+{
+  void *ptr;
+  WorkerArena *wa = (WorkerArena*)arena_;
+
+  ptr = CompAlloc(&wa->_arena_alloc,size_);
+  if(ptr == NULL)
+    ptr = std::malloc(size_);
+
+  return ptr;
+}
+
+void
+WorkerArena::free(void *arena_,
+                  void *ptr_)
+{
+  uint8_t *ptr = (uint8_t*)ptr_;
+  WorkerArena *wa = (WorkerArena*)arena_;
+
+  if((ptr >= wa->_arena.ca_Base) && (ptr < (wa->_arena.ca_Base + wa->_arena.ca_Size)))
+    return;
+
+  std::free(ptr_);
+}
+
+WorkerArena::Scope::Scope(WorkerArena &arena_)
+  : _arena(arena_)
+{
+  CompAllocator alloc;
+
+  GetCompAllocator(&_prev);
+
+  alloc.ca_Alloc    = WorkerArena::alloc;
+  alloc.ca_Free     = WorkerArena::free;
+  alloc.ca_UserData = (void*)&_arena;
+  SetCompAllocator(&alloc);
+}
+
+WorkerArena::Scope::~Scope()
+{
+  SetCompAllocator(&_prev);
+  ResetCompArena(&_arena._arena);
+}
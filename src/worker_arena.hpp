@@ -0,0 +1,54 @@
+#pragma once
+
+#include "alloc.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * A codec arena for one worker thread. While a Scope is alive the
+ * contexts the thread creates are allocated from the worker's region,
+ * which the Scope releases in one go when it ends, so a batch doesn't
+ * go to the heap for every file. Whatever doesn't fit, such as the
+ * segments of a split file, falls back to malloc().
+ */
+class WorkerArena
+{
+public:
+  explicit WorkerArena(std::size_t size);
+
+  WorkerArena(const WorkerArena&) = delete;
+  WorkerArena& operator=(const WorkerArena&) = delete;
+
+public:
+  class Scope
+  {
+  public:
+    explicit Scope(WorkerArena &arena);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    WorkerArena   &_arena;
+    CompAllocator  _prev;
+  };
+
+public:
+  // Room for one allocation of each size, with the arena's alignment
+  static std::size_t size_for(std::size_t const *sizes,
+                              std::size_t        count);
+
+private:
+  static void* alloc(void        *arena,
+                     std::size_t  size);
+  static void  free(void *arena,
+                    void *ptr);
+
+private:
+  std::unique_ptr<uint8_t[]> _region;
+  CompArena                  _arena;
+  CompAllocator              _arena_alloc;
+};